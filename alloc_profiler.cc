@@ -0,0 +1,207 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ALLOC_PROFILER_HAVE_RDTSC
+#endif
+
+#include "alloc_profiler.h"
+#include "latency_histogram.h"
+#include "timing.h"
+
+static bool use_rdtsc            = false;
+static double nanoseconds_per_tick = 1.0;
+static uint64_t timer_overhead   = 0;
+
+static struct latency_histogram malloc_latency;
+static struct latency_histogram free_latency;
+static size_t size_counts[ALLOC_SIZE_BUCKETS];
+
+static long live_bytes = 0;
+static struct alloc_search_stats current;
+
+static inline uint64_t clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// rdtscp waits for the instructions before it, so the allocator
+// call cannot be reordered around the start or stop reading.
+//
+static inline uint64_t read_timer(void) {
+#ifdef ALLOC_PROFILER_HAVE_RDTSC
+    if (use_rdtsc) {
+        unsigned int aux;
+        return __rdtscp(&aux);
+    }
+#endif
+    return clock_ns();
+}
+
+static inline long ticks_to_ns(uint64_t ticks) {
+    ticks = ticks > timer_overhead ? ticks - timer_overhead : 0;
+    return (long)((double)ticks * nanoseconds_per_tick);
+}
+
+// Smallest back to back reading, taken off every measured call.
+//
+static uint64_t measure_timer_overhead(void) {
+    uint64_t smallest = UINT64_MAX;
+    for (size_t k = 0; k < 1000; k++) {
+        uint64_t start = read_timer();
+        uint64_t stop  = read_timer();
+        if (stop - start < smallest) smallest = stop - start;
+    }
+    return smallest;
+}
+
+void setup_alloc_profiler(void) {
+#ifdef ALLOC_PROFILER_HAVE_RDTSC
+    // Count TSC ticks over 20 ms of wall clock time. A TSC that
+    // does not tick at a sane rate is not used.
+    //
+    uint64_t wall_start = clock_ns();
+    unsigned int aux;
+    uint64_t tick_start = __rdtscp(&aux);
+    while (clock_ns() - wall_start < 20000000ULL) {
+    }
+    uint64_t tick_stop = __rdtscp(&aux);
+    uint64_t wall_stop = clock_ns();
+    if (tick_stop > tick_start) {
+        nanoseconds_per_tick = (double)(wall_stop - wall_start) / (double)(tick_stop - tick_start);
+        use_rdtsc            = nanoseconds_per_tick > 0.01 && nanoseconds_per_tick < 10.0;
+    }
+#endif
+    if (!use_rdtsc) {
+        nanoseconds_per_tick = 1.0;
+    }
+    timer_overhead = measure_timer_overhead();
+
+    init_latency_histogram(&malloc_latency);
+    init_latency_histogram(&free_latency);
+    memset(size_counts, 0, sizeof(size_counts));
+    memset(&current, 0, sizeof(current));
+    printf("Allocation profiler using %s, %0.3f ns per tick, %0.1f ns timer overhead.\n",
+           alloc_profiler_clock_name(), nanoseconds_per_tick,
+           (double)timer_overhead * nanoseconds_per_tick);
+}
+
+const char * alloc_profiler_clock_name(void) {
+    return use_rdtsc ? "rdtsc" : "clock_gettime";
+}
+
+static inline size_t size_bucket(size_t size) {
+    size_t bucket = size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+    return bucket < ALLOC_SIZE_BUCKETS ? bucket : ALLOC_SIZE_BUCKETS - 1;
+}
+
+void * profiled_malloc(size_t size) {
+    uint64_t start = read_timer();
+    void * ptr     = malloc(size);
+    uint64_t stop  = read_timer();
+
+    long nanoseconds = ticks_to_ns(stop - start);
+    record_latency(&malloc_latency, nanoseconds);
+    ++size_counts[size_bucket(size)];
+    ++current.malloc_calls;
+    current.malloc_nanoseconds += nanoseconds;
+
+    if (ptr != NULL) {
+        live_bytes += malloc_usable_size(ptr);
+        if (live_bytes - current.live_bytes_at_start > current.peak_live_bytes) {
+            current.peak_live_bytes = live_bytes - current.live_bytes_at_start;
+        }
+    }
+    return ptr;
+}
+
+void profiled_free(void * ptr) {
+    // Sized before it is handed back, outside the timed region.
+    //
+    long size = ptr == NULL ? 0 : (long)malloc_usable_size(ptr);
+
+    uint64_t start = read_timer();
+    free(ptr);
+    uint64_t stop  = read_timer();
+
+    long nanoseconds = ticks_to_ns(stop - start);
+    record_latency(&free_latency, nanoseconds);
+    ++current.free_calls;
+    current.free_nanoseconds += nanoseconds;
+    live_bytes -= size;
+}
+
+void begin_search_profile(void) {
+    memset(&current, 0, sizeof(current));
+    current.live_bytes_at_start = live_bytes;
+}
+
+void end_search_profile(struct alloc_search_stats * stats) {
+    current.retained_bytes = live_bytes - current.live_bytes_at_start;
+    *stats = current;
+}
+
+void reset_alloc_profile(void) {
+    init_latency_histogram(&malloc_latency);
+    init_latency_histogram(&free_latency);
+    memset(size_counts, 0, sizeof(size_counts));
+    begin_search_profile();
+}
+
+// Each profiled call also spends two timer readings inside the
+// search, which the allocator times leave out. Leave them out of
+// the search time too.
+//
+static double profiled_search_ns(long search_nanoseconds, size_t calls) {
+    double overhead = (double)calls * (double)timer_overhead * nanoseconds_per_tick;
+    double adjusted = (double)search_nanoseconds - overhead;
+    return adjusted > 0.0 ? adjusted : 1.0;
+}
+
+void print_search_profile(const struct alloc_search_stats * stats, long search_nanoseconds) {
+    double search_ns = profiled_search_ns(search_nanoseconds, stats->malloc_calls + stats->free_calls);
+    printf("malloc calls : %ld free calls: %ld\n", stats->malloc_calls, stats->free_calls);
+    printf("Measured percentage of time spent in malloc() %0.3f\n",
+           100.0 * (double)stats->malloc_nanoseconds / search_ns);
+    printf("Measured percentage of time spent in free(): %0.3f\n",
+           100.0 * (double)stats->free_nanoseconds / search_ns);
+    printf("Live bytes at start: %ld peak above start: %ld retained: %ld\n",
+           stats->live_bytes_at_start, stats->peak_live_bytes, stats->retained_bytes);
+}
+
+static void print_latency_line(const char * label, const struct latency_histogram * histogram) {
+    printf("%s latency [ns] p50: %lu p90: %lu p99: %lu p99.9: %lu max: %lu mean: %0.1f\n", label,
+           latency_at_percentile(histogram, 50.0), latency_at_percentile(histogram, 90.0),
+           latency_at_percentile(histogram, 99.0), latency_at_percentile(histogram, 99.9),
+           histogram->max, mean_latency(histogram));
+}
+
+void print_alloc_profile(long total_search_nanoseconds) {
+    size_t calls = malloc_latency.total + free_latency.total;
+    if (calls == 0) {
+        return;
+    }
+
+    printf("Allocation profile (%s): %lu malloc and %lu free calls\n",
+           alloc_profiler_clock_name(), malloc_latency.total, free_latency.total);
+    print_latency_line("malloc()", &malloc_latency);
+    print_latency_line("free()", &free_latency);
+
+    printf("Requested sizes [bytes]:");
+    for (size_t bucket = 0; bucket < ALLOC_SIZE_BUCKETS; bucket++) {
+        if (size_counts[bucket] == 0) continue;
+        size_t upper = (size_t)1 << bucket;
+        printf(" (%lu, %lu]: %lu", bucket == 0 ? 0 : upper / 2, upper, size_counts[bucket]);
+    }
+    printf("\n");
+
+    double search_ns = profiled_search_ns(total_search_nanoseconds, calls);
+    printf("Measured share of BFS time in the allocator: malloc() %0.3f%% free() %0.3f%% total %0.3f%%\n",
+           100.0 * malloc_latency.sum / search_ns, 100.0 * free_latency.sum / search_ns,
+           100.0 * (malloc_latency.sum + free_latency.sum) / search_ns);
+}
@@ -0,0 +1,72 @@
+#ifndef ALLOC_PROFILER_H_
+#define ALLOC_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An allocation profiler that plugs in through
+// queue::register_malloc() and queue::register_free().
+//
+// Every call is timed with rdtsc (clock_gettime() where there is no
+// TSC), converted to nanoseconds with a rate calibrated at setup, and
+// with the cost of reading the timer itself taken off. That measures
+// the allocator as the search actually sees it, fragmentation, cache
+// misses on free lists and all, rather than the warm, sequential case
+// of a microbenchmark.
+//
+// Requested sizes go into a power of two histogram, call latencies
+// into a latency_histogram each for malloc and free. Live bytes are
+// tracked with malloc_usable_size(), i.e. what the allocator really
+// holds, and the high-water mark is kept per search.
+//
+// Like the instrumented counters it replaces, it is not thread safe.
+//
+#define ALLOC_SIZE_BUCKETS 32
+
+struct alloc_search_stats {
+    size_t malloc_calls;
+    size_t free_calls;
+    long malloc_nanoseconds;
+    long free_nanoseconds;
+    // Bytes live when the search started, and the most held at
+    // once during it, above that.
+    //
+    long live_bytes_at_start;
+    long peak_live_bytes;
+    // Bytes still held at the end compared to the start.
+    //
+    long retained_bytes;
+};
+
+// Calibrates the timer. Call before registering the functions.
+//
+void setup_alloc_profiler(void);
+
+void * profiled_malloc(size_t size);
+void profiled_free(void * ptr);
+
+// Brackets one search. end_search_profile() fills stats with what
+// happened since the matching begin_search_profile().
+//
+void begin_search_profile(void);
+void end_search_profile(struct alloc_search_stats * stats);
+
+// Clears the histograms, e.g. after a warm-up or layout comparison.
+//
+void reset_alloc_profile(void);
+
+// Prints the search's allocator time as a fraction of
+// search_nanoseconds, its call counts and its live bytes.
+//
+void print_search_profile(const struct alloc_search_stats * stats, long search_nanoseconds);
+
+// Prints totals, size and latency histograms of every call profiled
+// so far, with the allocator's share of total_search_nanoseconds.
+//
+void print_alloc_profile(long total_search_nanoseconds);
+
+// Name of the timer in use, "rdtsc" or "clock_gettime".
+//
+const char * alloc_profiler_clock_name(void);
+
+#endif
@@ -0,0 +1,466 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "allocators.h"
+#include "memory_placement.h"
+
+static thread_local struct allocator_call_counts calls = { 0, 0 };
+
+struct allocator_call_counts allocator_calls(void) {
+    return calls;
+}
+
+void reset_allocator_calls(void) {
+    calls.malloc_calls = 0;
+    calls.free_calls   = 0;
+}
+
+static void no_op(void) {
+}
+
+// Regions.
+//
+// Every block the arena, pool and tcache hand out lies in a region
+// aligned to region_size whose first bytes are a region_header, so
+// the header of any block is at its address rounded down. Requests
+// too big for a region get a region of their own, still aligned, so
+// the same rounding finds their header.
+//
+// Regions are SMALL_REGION_SIZE, or one huge page when the placement
+// policy asks for huge pages, which madvise() cannot give a smaller
+// or unaligned mapping. The size is only chosen while no region is
+// live, since region_of() masks with it.
+//
+#define SMALL_REGION_SIZE (256 * 1024)
+#define BLOCK_ALIGN       16
+
+static size_t region_size  = SMALL_REGION_SIZE;
+static size_t live_regions = 0;
+
+enum region_kind {
+    REGION_SMALL,
+    REGION_LARGE
+};
+
+struct region_header {
+    enum region_kind kind;
+    // Block size for tcache regions.
+    //
+    unsigned int size_class;
+    size_t bytes;
+    struct region_header * next;
+};
+
+#define REGION_HEADER_SIZE ((sizeof(struct region_header) + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1))
+
+static inline struct region_header * region_of(void * ptr) {
+    return (struct region_header*)((uintptr_t)ptr & ~(uintptr_t)(region_size - 1));
+}
+
+// Maps a little more than asked for and unmaps the ends, which
+// leaves an aligned region that is given back to the system as soon
+// as it is freed. Regions follow the memory placement policy, so the
+// queue nodes of the frontier can be put on huge pages.
+//
+static struct region_header * allocate_region(size_t bytes, enum region_kind kind,
+                                              struct region_header ** list) {
+    if (live_regions == 0) {
+        size_t huge_page = placement_huge_page_size();
+        region_size = huge_page > SMALL_REGION_SIZE ? huge_page : SMALL_REGION_SIZE;
+    }
+    bytes = (bytes + region_size - 1) & ~(size_t)(region_size - 1);
+    char * mapped = (char*)mmap(NULL, bytes + region_size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return NULL;
+    }
+    char * aligned = (char*)(((uintptr_t)mapped + region_size - 1) & ~(uintptr_t)(region_size - 1));
+    if (aligned > mapped) {
+        munmap(mapped, aligned - mapped);
+    }
+    munmap(aligned + bytes, mapped + region_size - aligned);
+    place_region(aligned, bytes);
+    ++live_regions;
+
+    struct region_header * region = (struct region_header*)aligned;
+    region->kind       = kind;
+    region->size_class = 0;
+    region->bytes      = bytes;
+    region->next       = NULL;
+    if (list != NULL) {
+        region->next = *list;
+        *list        = region;
+    }
+    return region;
+}
+
+static void free_region(struct region_header * region) {
+    --live_regions;
+    munmap(region, region->bytes);
+}
+
+static void free_region_list(struct region_header ** list) {
+    while (*list != NULL) {
+        struct region_header * next = (*list)->next;
+        free_region(*list);
+        *list = next;
+    }
+}
+
+static void * allocate_large(size_t size) {
+    struct region_header * region = allocate_region(REGION_HEADER_SIZE + size, REGION_LARGE, NULL);
+    return region == NULL ? NULL : (char*)region + REGION_HEADER_SIZE;
+}
+
+// glibc.
+//
+static void * glibc_malloc(size_t size) {
+    ++calls.malloc_calls;
+    return malloc(size);
+}
+
+static void glibc_free(void * ptr) {
+    ++calls.free_calls;
+    free(ptr);
+}
+
+// Bump arena.
+//
+// Regions are kept on a list in the order they were first used. The
+// mark is a position in that list, and resetting to it reuses the
+// same regions, so after the first search the arena stops asking the
+// system for memory.
+//
+static struct region_header * arena_regions = NULL;
+static struct region_header * arena_tail     = NULL;
+static struct region_header * arena_current  = NULL;
+static char * arena_next                     = NULL;
+static char * arena_end                      = NULL;
+static struct region_header * mark_region    = NULL;
+static char * mark_next                      = NULL;
+
+static bool arena_advance(void) {
+    struct region_header * next = arena_current == NULL ? arena_regions : arena_current->next;
+    if (next == NULL) {
+        next = allocate_region(region_size, REGION_SMALL, NULL);
+        if (next == NULL) {
+            return false;
+        }
+        if (arena_tail == NULL) {
+            arena_regions = next;
+        } else {
+            arena_tail->next = next;
+        }
+        arena_tail = next;
+    }
+    arena_current = next;
+    arena_next    = (char*)next + REGION_HEADER_SIZE;
+    arena_end     = (char*)next + region_size;
+    return true;
+}
+
+static void * arena_malloc(size_t size) {
+    ++calls.malloc_calls;
+    size = (size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1);
+    if (size > region_size - REGION_HEADER_SIZE) {
+        return allocate_large(size);
+    }
+    if (arena_next == NULL || (size_t)(arena_end - arena_next) < size) {
+        if (!arena_advance()) {
+            return NULL;
+        }
+    }
+    void * ptr  = arena_next;
+    arena_next += size;
+    return ptr;
+}
+
+static void arena_free(void * ptr) {
+    ++calls.free_calls;
+    if (ptr != NULL && region_of(ptr)->kind == REGION_LARGE) {
+        free_region(region_of(ptr));
+    }
+}
+
+static void arena_mark(void) {
+    mark_region = arena_current;
+    mark_next   = arena_next;
+}
+
+static void arena_end_search(void) {
+    arena_current = mark_region;
+    arena_next    = mark_next;
+    arena_end     = mark_region == NULL ? NULL : (char*)mark_region + region_size;
+}
+
+static void arena_release(void) {
+    free_region_list(&arena_regions);
+    arena_tail    = NULL;
+    arena_current = NULL;
+    arena_next    = NULL;
+    arena_end     = NULL;
+    mark_region   = NULL;
+    mark_next     = NULL;
+}
+
+// Fixed-size node pool.
+//
+#define POOL_SLOT_SIZE 16
+
+struct free_block {
+    struct free_block * next;
+};
+
+static struct region_header * pool_regions = NULL;
+static struct free_block * pool_free_list  = NULL;
+
+static bool pool_refill(void) {
+    struct region_header * region = allocate_region(region_size, REGION_SMALL, &pool_regions);
+    if (region == NULL) {
+        return false;
+    }
+    // Thread the slots in address order, so that a fresh region is
+    // handed out sequentially.
+    //
+    char * first = (char*)region + REGION_HEADER_SIZE;
+    size_t slots = (region_size - REGION_HEADER_SIZE) / POOL_SLOT_SIZE;
+    for (size_t k = 0; k < slots; k++) {
+        struct free_block * block = (struct free_block*)(first + k * POOL_SLOT_SIZE);
+        block->next = k + 1 < slots ? (struct free_block*)(first + (k + 1) * POOL_SLOT_SIZE) : pool_free_list;
+    }
+    pool_free_list = (struct free_block*)first;
+    return true;
+}
+
+static void * pool_malloc(size_t size) {
+    ++calls.malloc_calls;
+    if (size > POOL_SLOT_SIZE) {
+        return allocate_large(size);
+    }
+    if (pool_free_list == NULL && !pool_refill()) {
+        return NULL;
+    }
+    struct free_block * block = pool_free_list;
+    pool_free_list = block->next;
+    return block;
+}
+
+static void pool_free(void * ptr) {
+    ++calls.free_calls;
+    if (ptr == NULL) return;
+    if (region_of(ptr)->kind == REGION_LARGE) {
+        free_region(region_of(ptr));
+        return;
+    }
+    struct free_block * block = (struct free_block*)ptr;
+    block->next    = pool_free_list;
+    pool_free_list = block;
+}
+
+static void pool_release(void) {
+    free_region_list(&pool_regions);
+    pool_free_list = NULL;
+}
+
+// Thread-caching size-class allocator.
+//
+// Size classes are powers of two from 16 to 2048 bytes. A region
+// holds blocks of one class, named in its header.
+//
+#define TCACHE_CLASSES     8
+#define TCACHE_MAX_SIZE    (16 << (TCACHE_CLASSES - 1))
+#define TCACHE_BATCH       32
+#define TCACHE_CACHE_LIMIT (2 * TCACHE_BATCH)
+
+struct central_cache {
+    std::mutex lock;
+    struct free_block * lists[TCACHE_CLASSES];
+    struct region_header * regions;
+    // Bumped by release(), so thread caches from before it are
+    // dropped instead of handing out freed memory.
+    //
+    unsigned int generation;
+};
+
+struct thread_cache {
+    struct free_block * lists[TCACHE_CLASSES];
+    size_t counts[TCACHE_CLASSES];
+    unsigned int generation;
+};
+
+static struct central_cache central;
+static thread_local struct thread_cache local_cache;
+
+static inline unsigned int size_class_of(size_t size) {
+    if (size <= 16) return 0;
+    return 64 - __builtin_clzll(size - 1) - 4;
+}
+
+static inline size_t class_size(unsigned int size_class) {
+    return (size_t)16 << size_class;
+}
+
+static inline void check_generation(void) {
+    if (local_cache.generation != central.generation) {
+        memset(&local_cache, 0, sizeof(local_cache));
+        local_cache.generation = central.generation;
+    }
+}
+
+// Moves up to TCACHE_BATCH blocks of size_class into the calling
+// thread's cache, carving a new region if the central list is empty.
+// Called with the central lock held.
+//
+static bool central_fill(unsigned int size_class) {
+    if (central.lists[size_class] == NULL) {
+        struct region_header * region = allocate_region(region_size, REGION_SMALL, &central.regions);
+        if (region == NULL) {
+            return false;
+        }
+        region->size_class = size_class;
+        size_t block  = class_size(size_class);
+        char * first  = (char*)region + REGION_HEADER_SIZE;
+        size_t blocks = (region_size - REGION_HEADER_SIZE) / block;
+        for (size_t k = blocks; k > 0; k--) {
+            struct free_block * free_block = (struct free_block*)(first + (k - 1) * block);
+            free_block->next          = central.lists[size_class];
+            central.lists[size_class] = free_block;
+        }
+    }
+
+    for (size_t k = 0; k < TCACHE_BATCH && central.lists[size_class] != NULL; k++) {
+        struct free_block * block        = central.lists[size_class];
+        central.lists[size_class]        = block->next;
+        block->next                      = local_cache.lists[size_class];
+        local_cache.lists[size_class]    = block;
+        ++local_cache.counts[size_class];
+    }
+    return true;
+}
+
+static void * tcache_malloc(size_t size) {
+    ++calls.malloc_calls;
+    if (size > TCACHE_MAX_SIZE) {
+        return allocate_large(size);
+    }
+    check_generation();
+
+    unsigned int size_class = size_class_of(size);
+    if (local_cache.lists[size_class] == NULL) {
+        std::lock_guard<std::mutex> guard(central.lock);
+        if (!central_fill(size_class)) {
+            return NULL;
+        }
+    }
+    struct free_block * block     = local_cache.lists[size_class];
+    local_cache.lists[size_class] = block->next;
+    --local_cache.counts[size_class];
+    return block;
+}
+
+static void tcache_free(void * ptr) {
+    ++calls.free_calls;
+    if (ptr == NULL) return;
+    struct region_header * region = region_of(ptr);
+    if (region->kind == REGION_LARGE) {
+        free_region(region);
+        return;
+    }
+    check_generation();
+
+    unsigned int size_class       = region->size_class;
+    struct free_block * block     = (struct free_block*)ptr;
+    block->next                   = local_cache.lists[size_class];
+    local_cache.lists[size_class] = block;
+
+    // Hand a batch back once the cache holds too many, so that
+    // memory freed by one thread can be reused by the others.
+    //
+    if (++local_cache.counts[size_class] > TCACHE_CACHE_LIMIT) {
+        std::lock_guard<std::mutex> guard(central.lock);
+        for (size_t k = 0; k < TCACHE_BATCH; k++) {
+            struct free_block * moved     = local_cache.lists[size_class];
+            local_cache.lists[size_class] = moved->next;
+            moved->next                   = central.lists[size_class];
+            central.lists[size_class]     = moved;
+        }
+        local_cache.counts[size_class] -= TCACHE_BATCH;
+    }
+}
+
+static void tcache_release(void) {
+    std::lock_guard<std::mutex> guard(central.lock);
+    free_region_list(&central.regions);
+    memset(central.lists, 0, sizeof(central.lists));
+    ++central.generation;
+}
+
+static const struct allocator_backend glibc_backend  = { "glibc", glibc_malloc, glibc_free, no_op, no_op, false, no_op };
+static const struct allocator_backend arena_backend  = { "arena", arena_malloc, arena_free, arena_mark, arena_end_search, true, arena_release };
+static const struct allocator_backend pool_backend   = { "pool", pool_malloc, pool_free, no_op, no_op, false, pool_release };
+static const struct allocator_backend tcache_backend = { "tcache", tcache_malloc, tcache_free, no_op, no_op, false, tcache_release };
+
+const struct allocator_backend * const allocator_backends[] = {
+    &glibc_backend,
+    &arena_backend,
+    &pool_backend,
+    &tcache_backend
+};
+const size_t allocator_backend_count = sizeof(allocator_backends) / sizeof(allocator_backends[0]);
+
+const struct allocator_backend * find_allocator_backend(const char * name) {
+    for (size_t b = 0; b < allocator_backend_count; b++) {
+        if (strcmp(allocator_backends[b]->name, name) == 0) {
+            return allocator_backends[b];
+        }
+    }
+    return NULL;
+}
+
+// Memory statistics.
+//
+static long read_status_kb(const char * field) {
+    FILE * status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        return -1;
+    }
+    char line[256];
+    long value    = -1;
+    size_t length = strlen(field);
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, field, length) == 0 && line[length] == ':') {
+            value = strtol(line + length + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return value;
+}
+
+long read_rss_kb(void) {
+    return read_status_kb("VmRSS");
+}
+
+long read_peak_rss_kb(void) {
+    return read_status_kb("VmHWM");
+}
+
+bool reset_peak_rss(void) {
+    // Writing 5 to clear_refs resets VmHWM to the current RSS,
+    // Linux 4.0 and later.
+    //
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool reset = write(fd, "5", 1) == 1;
+    close(fd);
+    return reset;
+}
@@ -0,0 +1,78 @@
+#ifndef ALLOCATORS_H_
+#define ALLOCATORS_H_
+
+#include <stddef.h>
+
+// Allocator backends that can be registered through
+// queue::register_malloc() and queue::register_free().
+//
+//  x glibc:  plain malloc() and free(), the baseline.
+//  x arena:  a bump allocator. free() does nothing, and the arena
+//            is reset to its mark after every search, so a search
+//            costs a pointer increment per node. Single threaded.
+//  x pool:   a free list of fixed 16 byte slots, the size of a
+//            linked_list::node. Anything bigger gets its own region.
+//            Single threaded.
+//  x tcache: a thread-caching size-class allocator. Each thread
+//            allocates from and frees to its own per-class lists,
+//            and only moves batches of blocks to and from a shared,
+//            locked central list when its cache runs dry or over.
+//
+// The arena, pool and tcache carve their memory from regions aligned
+// to their size, so free() finds a block's region, and how to free
+// it, by masking the address.
+//
+// Call counts are kept per thread, allocator_calls() returns those
+// of the calling thread.
+//
+struct allocator_backend {
+    const char * name;
+    void * (*malloc)(size_t size);
+    void (*free)(void * ptr);
+
+    // Remembers everything allocated so far as long lived. Called
+    // once the search state exists.
+    //
+    void (*mark)(void);
+
+    // Called after every search. The arena drops everything
+    // allocated since mark(), the others do nothing. Memory the
+    // caller still holds from after mark() has to be let go of
+    // first when reclaims_per_search is set.
+    //
+    void (*end_search)(void);
+    bool reclaims_per_search;
+
+    // Returns all memory to the system. Every block handed out must
+    // have been freed, or must no longer be used.
+    //
+    void (*release)(void);
+};
+
+struct allocator_call_counts {
+    size_t malloc_calls;
+    size_t free_calls;
+};
+
+// Returns NULL for a name other than the ones above.
+//
+const struct allocator_backend * find_allocator_backend(const char * name);
+
+// Every backend, in the order they are compared in.
+//
+extern const struct allocator_backend * const allocator_backends[];
+extern const size_t allocator_backend_count;
+
+struct allocator_call_counts allocator_calls(void);
+void reset_allocator_calls(void);
+
+// Resident set size and its high-water mark from /proc/self/status,
+// in KiB, or -1 where unavailable. reset_peak_rss() lowers the
+// high-water mark to the current RSS where the kernel supports it,
+// and returns FALSE otherwise.
+//
+long read_rss_kb(void);
+long read_peak_rss_kb(void);
+bool reset_peak_rss(void);
+
+#endif
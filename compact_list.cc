@@ -0,0 +1,5 @@
+// Out of line definitions for the shared libraries, see
+// compact_list_impl.h.
+//
+#define COMPACT_LIST_INLINE
+#include "compact_list_impl.h"
@@ -0,0 +1,108 @@
+#ifndef COMPACT_LIST_H_
+#define COMPACT_LIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linked_list.h"
+
+// A singly linked list with the same interface as linked_list, whose
+// nodes live in one growable pool and link to each other by 32-bit
+// index rather than by pointer. A node is 8 bytes, a 32-bit next and
+// the data, against 16 bytes plus the allocator's header for a
+// linked_list::node, and inserting a node costs no allocation unless
+// the pool is full, in which case it doubles.
+//
+// Removed nodes go on a free list inside the pool. Unlike linked_list,
+// they cannot be handed back to the allocator one at a time. Instead,
+// once the pool is less than a quarter full and more than the spare
+// limit of it is free, the live nodes are copied in list order into a
+// pool half the size. With the default limit of 0 that keeps the pool
+// within four times the list's size, at an amortized constant cost per
+// remove(). A queue sets the limit to SIZE_MAX, so its pool only grows.
+//
+// The pool starts out as LINKED_LIST_INLINE_NODES nodes inside the
+// list object, and moves to the heap the first time it grows past
+// them.
+//
+// Holds at most COMPACT_LIST_MAX_NODES elements, inserts beyond that
+// fail.
+//
+#define COMPACT_LIST_NIL       UINT32_MAX
+#define COMPACT_LIST_MAX_NODES ((size_t)UINT32_MAX)
+
+class compact_list{
+  public:
+    compact_list();
+    virtual ~compact_list();
+
+    void * operator new(size_t size);
+    void operator delete(void * ptr);
+
+    // Same as linked_list. Returns TRUE on success, FALSE otherwise.
+    //
+    bool insert(size_t index, unsigned int data);
+    bool insert_front(unsigned int data);
+    bool insert_end(unsigned int data);
+    size_t find(unsigned int data) const;
+    bool remove(size_t index);
+    size_t size() const;
+
+    // Same as linked_list, except that spare nodes are pool slots.
+    // shrink_to_fit() and lowering the limit compact the pool.
+    //
+    bool reserve(size_t capacity);
+    void shrink_to_fit();
+    void set_spare_limit(size_t limit);
+    size_t capacity() const;
+
+    struct node {
+      uint32_t next;
+      unsigned int data;
+    };
+
+    unsigned int& operator[](size_t idx);
+    const unsigned int& operator[](size_t idx) const;
+
+    // The pool and the list object itself are allocated through
+    // these.
+    //
+    static void register_malloc(void * (*malloc)(size_t));
+    static void register_free(void (*free)(void*));
+    static void * (*malloc_fptr)(size_t);
+    static void (*free_fptr)(void*);
+
+  private:
+    node * pool;
+    size_t pool_capacity;
+
+    // Indices into pool, COMPACT_LIST_NIL when there is none.
+    //
+    uint32_t head;
+    uint32_t tail;
+
+    size_t ll_size;
+
+    // Free slots: the ones on the free list, linked through next,
+    // plus the never used ones from unused onwards.
+    //
+    uint32_t free_head;
+    size_t unused;
+    size_t spare_limit;
+
+    // The pool until it outgrows it.
+    //
+    node inline_pool[LINKED_LIST_INLINE_NODES];
+
+    uint32_t acquire_node(unsigned int data);
+    void release_node(uint32_t released);
+    bool resize_pool(size_t new_capacity);
+    uint32_t node_at(size_t idx) const;
+};
+
+#ifdef QUEUE_HEADER_ONLY
+#include "compact_list_impl.h"
+#endif
+
+#endif
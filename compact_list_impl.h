@@ -0,0 +1,295 @@
+#ifndef COMPACT_LIST_IMPL_H_
+#define COMPACT_LIST_IMPL_H_
+
+// The definitions of the compact_list members, built out of line by
+// compact_list.cc and inlined by QUEUE_HEADER_ONLY builds, as for
+// linked_list_impl.h.
+//
+
+#include "compact_list.h"
+
+#ifndef COMPACT_LIST_INLINE
+#define COMPACT_LIST_INLINE inline
+#endif
+
+COMPACT_LIST_INLINE void * (*compact_list::malloc_fptr)(size_t) = nullptr;
+COMPACT_LIST_INLINE void (*compact_list::free_fptr)(void*)      = nullptr;
+
+COMPACT_LIST_INLINE void
+compact_list::register_malloc(void *(*malloc)(size_t)) {
+    compact_list::malloc_fptr = malloc;
+}
+
+COMPACT_LIST_INLINE void
+compact_list::register_free(void (*free)(void*)) {
+    compact_list::free_fptr = free;
+}
+
+COMPACT_LIST_INLINE compact_list::compact_list()
+    : pool(inline_pool), pool_capacity(LINKED_LIST_INLINE_NODES), head(COMPACT_LIST_NIL),
+      tail(COMPACT_LIST_NIL), ll_size(0), free_head(COMPACT_LIST_NIL), unused(0), spare_limit(0) {
+}
+
+COMPACT_LIST_INLINE compact_list::~compact_list() {
+    if (pool != inline_pool) {
+        compact_list::free_fptr(pool);
+    }
+}
+
+COMPACT_LIST_INLINE void *
+compact_list::operator new(size_t size) {
+    return compact_list::malloc_fptr(size);
+}
+
+COMPACT_LIST_INLINE void
+compact_list::operator delete(void * ptr) {
+    compact_list::free_fptr(ptr);
+}
+
+// Moves the list into a pool of new_capacity nodes, at least ll_size,
+// laid out in list order, so head is 0 and the free list is empty.
+// Capacities that fit go to the inline pool, which is never resized
+// in place. The old pool is left alone on allocation failure.
+//
+COMPACT_LIST_INLINE bool
+compact_list::resize_pool(size_t new_capacity) {
+    node * new_pool = inline_pool;
+    if (new_capacity <= LINKED_LIST_INLINE_NODES) {
+        if (pool == inline_pool) {
+            return true;
+        }
+        new_capacity = LINKED_LIST_INLINE_NODES;
+    } else {
+        new_pool = static_cast<node*>(compact_list::malloc_fptr(new_capacity * sizeof(node)));
+        if (new_pool == nullptr) {
+            return false;
+        }
+    }
+
+    uint32_t current = head;
+    for (size_t i = 0; i < ll_size; i++) {
+        new_pool[i].data = pool[current].data;
+        new_pool[i].next = static_cast<uint32_t>(i + 1);
+        current          = pool[current].next;
+    }
+    if (ll_size != 0) {
+        new_pool[ll_size - 1].next = COMPACT_LIST_NIL;
+        head = 0;
+        tail = static_cast<uint32_t>(ll_size - 1);
+    }
+
+    if (pool != inline_pool) {
+        compact_list::free_fptr(pool);
+    }
+    pool          = new_pool;
+    pool_capacity = new_capacity;
+    free_head     = COMPACT_LIST_NIL;
+    unused        = ll_size;
+    return true;
+}
+
+// Takes a slot off the free list, or a never used one, doubling the
+// pool if there is neither. Indices into the pool stay valid across
+// everything but a resize, so callers acquire before they look up
+// the nodes they link to.
+//
+COMPACT_LIST_INLINE uint32_t
+compact_list::acquire_node(unsigned int data) {
+    uint32_t index;
+    if (free_head != COMPACT_LIST_NIL) {
+        index     = free_head;
+        free_head = pool[index].next;
+    } else {
+        if (unused == pool_capacity) {
+            if (pool_capacity == COMPACT_LIST_MAX_NODES) {
+                return COMPACT_LIST_NIL;
+            }
+            size_t new_capacity = pool_capacity < 8 ? 16 : pool_capacity * 2;
+            if (new_capacity > COMPACT_LIST_MAX_NODES) {
+                new_capacity = COMPACT_LIST_MAX_NODES;
+            }
+            if (!resize_pool(new_capacity)) {
+                return COMPACT_LIST_NIL;
+            }
+        }
+        index = static_cast<uint32_t>(unused++);
+    }
+    pool[index].next = COMPACT_LIST_NIL;
+    pool[index].data = data;
+    return index;
+}
+
+// Expects ll_size to already count the node as removed.
+//
+COMPACT_LIST_INLINE void
+compact_list::release_node(uint32_t released) {
+    pool[released].next = free_head;
+    free_head           = released;
+
+    size_t spare = pool_capacity - ll_size;
+    if (spare > spare_limit && ll_size < pool_capacity / 4) {
+        size_t new_capacity = pool_capacity / 2;
+        if (new_capacity < ll_size + spare_limit) {
+            new_capacity = ll_size + spare_limit;
+        }
+        resize_pool(new_capacity);
+    }
+}
+
+COMPACT_LIST_INLINE bool
+compact_list::reserve(size_t capacity) {
+    if (capacity <= pool_capacity) {
+        return true;
+    }
+    if (capacity > COMPACT_LIST_MAX_NODES) {
+        return false;
+    }
+    if (spare_limit < capacity - ll_size) {
+        spare_limit = capacity - ll_size;
+    }
+    return resize_pool(capacity);
+}
+
+COMPACT_LIST_INLINE void
+compact_list::shrink_to_fit() {
+    if (pool_capacity != ll_size) {
+        resize_pool(ll_size);
+    }
+}
+
+COMPACT_LIST_INLINE void
+compact_list::set_spare_limit(size_t limit) {
+    spare_limit = limit;
+    if (pool_capacity - ll_size > spare_limit) {
+        resize_pool(ll_size + spare_limit);
+    }
+}
+
+COMPACT_LIST_INLINE size_t
+compact_list::capacity() const {
+    return pool_capacity;
+}
+
+COMPACT_LIST_INLINE uint32_t
+compact_list::node_at(size_t idx) const {
+    uint32_t current = head;
+    for (size_t i = 0; i < idx; i++) {
+        current = pool[current].next;
+    }
+    return current;
+}
+
+COMPACT_LIST_INLINE bool
+compact_list::insert(size_t index, unsigned int data) {
+    if (index > ll_size) {
+        return false;
+    }
+
+    if (index == 0) {
+        return insert_front(data);
+    }
+
+    if (index == ll_size) {
+        return insert_end(data);
+    }
+
+    uint32_t new_node = acquire_node(data);
+    if (new_node == COMPACT_LIST_NIL) {
+        return false;
+    }
+
+    uint32_t prev       = node_at(index - 1);
+    pool[new_node].next = pool[prev].next;
+    pool[prev].next     = new_node;
+    ++ll_size;
+    return true;
+}
+
+COMPACT_LIST_INLINE bool
+compact_list::insert_front(unsigned int data) {
+    uint32_t new_node = acquire_node(data);
+    if (new_node == COMPACT_LIST_NIL) {
+        return false;
+    }
+
+    pool[new_node].next = head;
+    head                = new_node;
+    if (tail == COMPACT_LIST_NIL) {
+        tail = new_node;
+    }
+    ++ll_size;
+    return true;
+}
+
+COMPACT_LIST_INLINE bool
+compact_list::insert_end(unsigned int data) {
+    uint32_t new_node = acquire_node(data);
+    if (new_node == COMPACT_LIST_NIL) {
+        return false;
+    }
+
+    if (tail == COMPACT_LIST_NIL) {
+        head = new_node;
+    } else {
+        pool[tail].next = new_node;
+    }
+    tail = new_node;
+    ++ll_size;
+    return true;
+}
+
+COMPACT_LIST_INLINE size_t
+compact_list::find(unsigned int data) const {
+    size_t index = 0;
+    for (uint32_t current = head; current != COMPACT_LIST_NIL; current = pool[current].next) {
+        if (pool[current].data == data) {
+            return index;
+        }
+        ++index;
+    }
+    return SIZE_MAX;
+}
+
+COMPACT_LIST_INLINE bool
+compact_list::remove(size_t index) {
+    if (index >= ll_size) {
+        return false;
+    }
+
+    uint32_t removed;
+    if (index == 0) {
+        removed = head;
+        head    = pool[head].next;
+        if (head == COMPACT_LIST_NIL) {
+            tail = COMPACT_LIST_NIL;
+        }
+    } else {
+        uint32_t prev   = node_at(index - 1);
+        removed         = pool[prev].next;
+        pool[prev].next = pool[removed].next;
+        if (removed == tail) {
+            tail = prev;
+        }
+    }
+
+    --ll_size;
+    release_node(removed);
+    return true;
+}
+
+COMPACT_LIST_INLINE size_t
+compact_list::size() const {
+    return ll_size;
+}
+
+COMPACT_LIST_INLINE unsigned int&
+compact_list::operator[](size_t idx) {
+    return pool[node_at(idx)].data;
+}
+
+COMPACT_LIST_INLINE const unsigned int&
+compact_list::operator[](size_t idx) const {
+    return pool[node_at(idx)].data;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPRESSED_GRAPH_HAVE_SSSE3
+#endif
+
+#include "compressed_graph.h"
+#include "timing.h"
+#include "trace.h"
+
+// The SIMD decoder loads 16 bytes for every group of four, which
+// can run up to 15 bytes past the last row.
+//
+#define COMPRESSED_PADDING 16
+
+struct compressed_graph compressed = { NULL, NULL, NULL, 0 };
+
+// Total data bytes of the four neighbors described by a control byte.
+//
+static uint8_t group_lengths[256];
+
+static void init_group_lengths(void) {
+    for (unsigned int control = 0; control < 256; control++) {
+        unsigned int length = 0;
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            length += ((control >> (2 * lane)) & 3) + 1;
+        }
+        group_lengths[control] = length;
+    }
+}
+
+static inline unsigned int encoded_length(unsigned int delta) {
+    if (delta < (1U << 8))  return 1;
+    if (delta < (1U << 16)) return 2;
+    if (delta < (1U << 24)) return 3;
+    return 4;
+}
+
+// Encodes sorted values into out, returns the bytes written.
+//
+static size_t encode_row(const unsigned int * sorted, size_t count, uint8_t * out) {
+    uint8_t * control = out;
+    uint8_t * data    = out + (count + 3) / 4;
+    memset(control, 0, (count + 3) / 4);
+
+    unsigned int previous = 0;
+    for (size_t k = 0; k < count; k++) {
+        unsigned int delta  = sorted[k] - previous;
+        unsigned int length = encoded_length(delta);
+        previous            = sorted[k];
+
+        control[k / 4] |= (length - 1) << (2 * (k % 4));
+        for (unsigned int b = 0; b < length; b++) {
+            *data++ = (delta >> (8 * b)) & 0xff;
+        }
+    }
+    return data - out;
+}
+
+static size_t decode_block_scalar(struct adjacency_cursor * cursor,
+                                  unsigned int * block) {
+    size_t count = cursor->remaining < COMPRESSED_BLOCK_SIZE ? cursor->remaining : COMPRESSED_BLOCK_SIZE;
+    const uint8_t * data  = cursor->data;
+    unsigned int previous = cursor->previous;
+
+    for (size_t k = 0; k < count; k++) {
+        unsigned int length = ((cursor->control[k / 4] >> (2 * (k % 4))) & 3) + 1;
+        unsigned int delta  = 0;
+        for (unsigned int b = 0; b < length; b++) {
+            delta |= (unsigned int)data[b] << (8 * b);
+        }
+        data     += length;
+        previous += delta;
+        block[k]  = previous;
+    }
+
+    cursor->control   += (count + 3) / 4;
+    cursor->data       = data;
+    cursor->remaining -= count;
+    cursor->previous   = previous;
+    return count;
+}
+
+#ifdef COMPRESSED_GRAPH_HAVE_SSSE3
+// pshufb masks that spread the data bytes of one group into four
+// 32-bit lanes, indexed by control byte.
+//
+static uint8_t shuffle_masks[256][16] __attribute__((aligned(16)));
+
+static void init_shuffle_masks(void) {
+    for (unsigned int control = 0; control < 256; control++) {
+        unsigned int source = 0;
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            unsigned int length = ((control >> (2 * lane)) & 3) + 1;
+            for (unsigned int b = 0; b < 4; b++) {
+                shuffle_masks[control][4 * lane + b] = b < length ? source++ : 0x80;
+            }
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_block_ssse3(struct adjacency_cursor * cursor,
+                                 unsigned int * block) {
+    size_t count  = cursor->remaining < COMPRESSED_BLOCK_SIZE ? cursor->remaining : COMPRESSED_BLOCK_SIZE;
+    size_t groups = (count + 3) / 4;
+    const uint8_t * control = cursor->control;
+    const uint8_t * data    = cursor->data;
+    __m128i previous        = _mm_set1_epi32(cursor->previous);
+
+    for (size_t g = 0; g < groups; g++) {
+        uint8_t code   = control[g];
+        __m128i packed = _mm_loadu_si128((const __m128i*)data);
+        __m128i deltas = _mm_shuffle_epi8(packed, _mm_load_si128((const __m128i*)shuffle_masks[code]));
+        data += group_lengths[code];
+
+        // Inclusive prefix sum of the four deltas, plus the last
+        // value of the previous group.
+        //
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+        __m128i values = _mm_add_epi32(deltas, previous);
+        _mm_storeu_si128((__m128i*)&block[4 * g], values);
+        previous = _mm_shuffle_epi32(values, 0xff);
+    }
+
+    // A partial last group only ends its row, so the lanes past
+    // count never feed into anything.
+    //
+    cursor->control   += groups;
+    cursor->data       = data;
+    cursor->remaining -= count;
+    cursor->previous   = block[count - 1];
+    return count;
+}
+#endif
+
+size_t (*decode_block_fptr)(struct adjacency_cursor *, unsigned int *) = decode_block_scalar;
+
+const char * compressed_decoder_name(void) {
+#ifdef COMPRESSED_GRAPH_HAVE_SSSE3
+    if (decode_block_fptr == decode_block_ssse3) {
+        return "ssse3";
+    }
+#endif
+    return "scalar";
+}
+
+bool build_compressed_graph(void) {
+    TRACE_SPAN("build_compressed_graph");
+    init_group_lengths();
+#ifdef COMPRESSED_GRAPH_HAVE_SSSE3
+    init_shuffle_masks();
+    if (__builtin_cpu_supports("ssse3")) {
+        decode_block_fptr = decode_block_ssse3;
+    }
+#endif
+
+    // Worst case is four data bytes per neighbor plus its share of
+    // a control byte. The buffer is shrunk to fit afterwards.
+    //
+    size_t bound       = COMPRESSED_PADDING;
+    size_t widest_row  = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        bound += (rows[v]->size + 3) / 4 + 4 * rows[v]->size;
+        widest_row = std::max(widest_row, rows[v]->size);
+    }
+
+    compressed.offsets   = (size_t*)malloc((row_count + 1) * sizeof(size_t));
+    compressed.counts    = (unsigned int*)calloc(row_count, sizeof(unsigned int));
+    compressed.bytes     = (uint8_t*)malloc(bound);
+    unsigned int * sorted = (unsigned int*)malloc((widest_row + 1) * sizeof(unsigned int));
+    if (compressed.offsets == NULL || compressed.counts == NULL ||
+        compressed.bytes == NULL || sorted == NULL) {
+        free(sorted);
+        free_compressed_graph();
+        return false;
+    }
+
+    size_t used = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        compressed.offsets[v] = used;
+        if (rows[v] == NULL) continue;
+
+        size_t count = rows[v]->size;
+        memcpy(sorted, rows[v]->adjacent_nodes, count * sizeof(unsigned int));
+        std::sort(sorted, sorted + count);
+        used += encode_row(sorted, count, compressed.bytes + used);
+        compressed.counts[v] = count;
+    }
+    compressed.offsets[row_count] = used;
+    free(sorted);
+
+    memset(compressed.bytes + used, 0, COMPRESSED_PADDING);
+    uint8_t * shrunk = (uint8_t*)realloc(compressed.bytes, used + COMPRESSED_PADDING);
+    if (shrunk != NULL) {
+        compressed.bytes = shrunk;
+    }
+    compressed.byte_count = used;
+    return true;
+}
+
+void free_compressed_graph(void) {
+    free(compressed.offsets);
+    free(compressed.counts);
+    free(compressed.bytes);
+    compressed.offsets    = NULL;
+    compressed.counts     = NULL;
+    compressed.bytes      = NULL;
+    compressed.byte_count = 0;
+}
+
+bool compressed_breadth_first_search(struct search_state * state,
+                                     unsigned int i, unsigned int j,
+                                     struct search_result * result) {
+    TRACE_SPAN("bfs (compressed)");
+    queue * q                    = state->q;
+    unsigned int * visited_epoch = state->visited_epoch;
+    unsigned int epoch           = next_search_epoch(state);
+
+    bool found_path = false;
+    bool push_error = false;
+    unsigned int next_node = i;
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    unsigned int block[COMPRESSED_BLOCK_SIZE];
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    while (!found_path) {
+        if (compressed.counts[next_node] == 0 || visited_epoch[next_node] == epoch) {
+            bool not_done = q->pop(&next_node);
+            ++node_count;
+            if (!not_done) break;
+            continue;
+        }
+        visited_epoch[next_node] = epoch;
+        edge_count += compressed.counts[next_node];
+
+        struct adjacency_cursor cursor;
+        open_compressed_row(next_node, &cursor);
+        size_t decoded;
+        while (!push_error && (decoded = decode_block_fptr(&cursor, block)) > 0) {
+            for (size_t k = 0; k < decoded; k++) {
+                // Check if we found the node.
+                //
+                if (j == block[k]) {
+                    found_path = true;
+                }
+                if (!q->push(block[k])) {
+                    push_error = true;
+                    break;
+                }
+            }
+        }
+        if (push_error) {
+            printf("Error pushing into queue.\n");
+            break;
+        }
+
+        // Pop the next row off the queue.
+        //
+        if (!q->pop(&next_node)) {
+            break;
+        }
+        ++node_count;
+    }
+
+    // Empty the queue so that it can be reused by the next search.
+    //
+    unsigned int discarded;
+    while (q->pop(&discarded)) {
+    }
+    GRAB_CLOCK(stop)
+
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
@@ -0,0 +1,72 @@
+#ifndef COMPRESSED_GRAPH_H_
+#define COMPRESSED_GRAPH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// A compressed copy of the adjacency lists in rows.
+//
+// Each row is sorted, delta-encoded and packed with StreamVByte:
+// one control byte per group of four neighbors, two bits per
+// neighbor giving its length in bytes (1 to 4), followed by the
+// packed delta bytes. Row v occupies bytes[offsets[v]] up to
+// bytes[offsets[v + 1]], control bytes first. The buffer is padded
+// so the SIMD decoder can always load 16 bytes past any group.
+//
+struct compressed_graph {
+    size_t * offsets;
+    unsigned int * counts;
+    uint8_t * bytes;
+    size_t byte_count;
+};
+
+extern struct compressed_graph compressed;
+
+// Builds compressed from rows. Returns FALSE on allocation failure.
+//
+bool build_compressed_graph(void);
+void free_compressed_graph(void);
+
+// Neighbors are decoded in blocks of this many.
+//
+#define COMPRESSED_BLOCK_SIZE 64
+
+// Walks one compressed row block by block.
+//
+struct adjacency_cursor {
+    const uint8_t * control;
+    const uint8_t * data;
+    unsigned int remaining;
+    unsigned int previous;
+};
+
+static inline void open_compressed_row(unsigned int v, struct adjacency_cursor * cursor) {
+    unsigned int count = compressed.counts[v];
+    cursor->control    = compressed.bytes + compressed.offsets[v];
+    cursor->data       = cursor->control + (count + 3) / 4;
+    cursor->remaining  = count;
+    cursor->previous   = 0;
+}
+
+// Decodes up to COMPRESSED_BLOCK_SIZE neighbors into block and
+// returns how many, 0 once the row is exhausted. Uses SSSE3 when
+// the CPU has it, a scalar decoder otherwise.
+//
+extern size_t (*decode_block_fptr)(struct adjacency_cursor * cursor,
+                                   unsigned int * block);
+
+// Returns "ssse3" or "scalar".
+//
+const char * compressed_decoder_name(void);
+
+// shared_breadth_first_search() over the compressed rows. Neighbors
+// come out in sorted order, so node counts can differ from the
+// uncompressed search, but whether a path is found does not.
+//
+bool compressed_breadth_first_search(struct search_state * state,
+                                     unsigned int i, unsigned int j,
+                                     struct search_result * result);
+
+#endif
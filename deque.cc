@@ -0,0 +1,5 @@
+// Out of line definitions for the shared libraries, see
+// deque_impl.h.
+//
+#define DEQUE_INLINE
+#include "deque_impl.h"
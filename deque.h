@@ -0,0 +1,86 @@
+#ifndef DEQUE_H_
+#define DEQUE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A double-ended queue of unsigned ints, for 0-1 BFS (zero weight
+// edges go to the front, the rest to the back) and for work-stealing
+// schedulers (the owner works one end, thieves the other, under a
+// lock of their own: the deque itself is not thread safe).
+//
+// The elements live in blocks of DEQUE_BLOCK_ELEMENTS, found through
+// a map of block pointers like std::deque's. Element k from the front
+// is at position begin + k of the blocks laid end to end, so both
+// ends are reached in O(1) without the per-element allocation of
+// linked_list. A block is allocated when an end first reaches it and
+// released when the last element in it is popped. One released block
+// is kept as a spare, so a deque whose end goes back and forth over
+// a block boundary does not allocate on every crossing. When an end
+// reaches the edge of the map, the map is recentered around the
+// blocks in use, or doubled if they fill more than half of it.
+//
+// Allocates through the same kind of hooks as queue.
+//
+#define DEQUE_BLOCK_ELEMENTS 1024
+
+class deque{
+  public:
+    deque();
+    virtual ~deque();
+
+    void * operator new(size_t size);
+    void operator delete(void * ptr);
+
+    // Return TRUE on success, FALSE on allocation failure or, for
+    // the pops, an empty deque, in which case popped_data is not
+    // modified.
+    //
+    bool push_front(unsigned int data);
+    bool push_back(unsigned int data);
+    bool pop_front(unsigned int * popped_data);
+    bool pop_back(unsigned int * popped_data);
+
+    // Do not modify data if the deque is empty.
+    //
+    bool front(unsigned int * data) const;
+    bool back(unsigned int * data) const;
+
+    size_t size() const;
+
+    // Releases every block, the spare included. The map is kept.
+    //
+    void clear();
+
+    // Static members for memory allocation, as for queue.
+    //
+    static void register_malloc(void * (*malloc)(size_t));
+    static void register_free(void (*free)(void*));
+    static void * (*malloc_fptr)(size_t);
+    static void (*free_fptr)(void*);
+
+  private:
+    // map_capacity block pointers, NULL for blocks not in use.
+    //
+    unsigned int ** map;
+    size_t map_capacity;
+
+    // Position of the front element, counted over the blocks of the
+    // map laid end to end.
+    //
+    size_t begin;
+    size_t dq_size;
+
+    unsigned int * spare_block;
+
+    unsigned int * slot(size_t position) const;
+    bool acquire_block(size_t block);
+    void release_block(size_t block);
+    bool recenter_map();
+};
+
+#ifdef QUEUE_HEADER_ONLY
+#include "deque_impl.h"
+#endif
+
+#endif
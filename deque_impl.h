@@ -0,0 +1,238 @@
+#ifndef DEQUE_IMPL_H_
+#define DEQUE_IMPL_H_
+
+// The definitions of the deque members, built out of line into
+// libqueue.so by deque.cc and inlined by QUEUE_HEADER_ONLY builds, as
+// for linked_list_impl.h.
+//
+
+#include <string.h>
+
+#include "deque.h"
+
+#ifndef DEQUE_INLINE
+#define DEQUE_INLINE inline
+#endif
+
+DEQUE_INLINE void * (*deque::malloc_fptr)(size_t) = nullptr;
+DEQUE_INLINE void (*deque::free_fptr)(void*)      = nullptr;
+
+DEQUE_INLINE void
+deque::register_malloc(void *(*malloc)(size_t)) {
+    deque::malloc_fptr = malloc;
+}
+
+DEQUE_INLINE void
+deque::register_free(void (*free)(void*)) {
+    deque::free_fptr = free;
+}
+
+DEQUE_INLINE deque::deque()
+    : map(nullptr), map_capacity(0), begin(0), dq_size(0), spare_block(nullptr) {
+}
+
+DEQUE_INLINE deque::~deque() {
+    clear();
+    if (map != nullptr) {
+        deque::free_fptr(map);
+    }
+}
+
+DEQUE_INLINE void *
+deque::operator new(size_t size) {
+    return deque::malloc_fptr(size);
+}
+
+DEQUE_INLINE void
+deque::operator delete(void * ptr) {
+    deque::free_fptr(ptr);
+}
+
+DEQUE_INLINE unsigned int *
+deque::slot(size_t position) const {
+    return map[position / DEQUE_BLOCK_ELEMENTS] + position % DEQUE_BLOCK_ELEMENTS;
+}
+
+DEQUE_INLINE bool
+deque::acquire_block(size_t block) {
+    if (spare_block != nullptr) {
+        map[block]  = spare_block;
+        spare_block = nullptr;
+        return true;
+    }
+    map[block] = static_cast<unsigned int*>(deque::malloc_fptr(DEQUE_BLOCK_ELEMENTS * sizeof(unsigned int)));
+    return map[block] != nullptr;
+}
+
+DEQUE_INLINE void
+deque::release_block(size_t block) {
+    if (spare_block == nullptr) {
+        spare_block = map[block];
+    } else {
+        deque::free_fptr(map[block]);
+    }
+    map[block] = nullptr;
+}
+
+// Moves the blocks in use to the middle of the map, doubling it first
+// unless they take at most half of it, so that both ends have room
+// for at least one more block. An empty deque starts again in the
+// middle of the middle block. The map is left alone on allocation
+// failure.
+//
+DEQUE_INLINE bool
+deque::recenter_map() {
+    size_t first = begin / DEQUE_BLOCK_ELEMENTS;
+    size_t used  = dq_size == 0 ? 0 : (begin + dq_size - 1) / DEQUE_BLOCK_ELEMENTS - first + 1;
+
+    size_t new_capacity = map_capacity;
+    if ((used + 2) * 2 > map_capacity) {
+        new_capacity = (used + 2) * 2 < 8 ? 8 : (used + 2) * 2;
+    }
+    size_t new_first = (new_capacity - used) / 2;
+
+    if (new_capacity == map_capacity) {
+        memmove(map + new_first, map + first, used * sizeof(unsigned int*));
+        for (size_t block = 0; block < map_capacity; block++) {
+            if (block < new_first || block >= new_first + used) {
+                map[block] = nullptr;
+            }
+        }
+    } else {
+        unsigned int ** new_map = static_cast<unsigned int**>(deque::malloc_fptr(new_capacity * sizeof(unsigned int*)));
+        if (new_map == nullptr) {
+            return false;
+        }
+        for (size_t block = 0; block < new_capacity; block++) {
+            new_map[block] = nullptr;
+        }
+        if (used != 0) {
+            memcpy(new_map + new_first, map + first, used * sizeof(unsigned int*));
+        }
+        if (map != nullptr) {
+            deque::free_fptr(map);
+        }
+        map          = new_map;
+        map_capacity = new_capacity;
+    }
+
+    if (dq_size == 0) {
+        begin = (map_capacity / 2) * DEQUE_BLOCK_ELEMENTS + DEQUE_BLOCK_ELEMENTS / 2;
+    } else {
+        begin = new_first * DEQUE_BLOCK_ELEMENTS + begin % DEQUE_BLOCK_ELEMENTS;
+    }
+    return true;
+}
+
+DEQUE_INLINE bool
+deque::push_back(unsigned int data) {
+    size_t position = begin + dq_size;
+    if (position / DEQUE_BLOCK_ELEMENTS >= map_capacity) {
+        if (!recenter_map()) {
+            return false;
+        }
+        position = begin + dq_size;
+    }
+    if (map[position / DEQUE_BLOCK_ELEMENTS] == nullptr &&
+        !acquire_block(position / DEQUE_BLOCK_ELEMENTS)) {
+        return false;
+    }
+    *slot(position) = data;
+    ++dq_size;
+    return true;
+}
+
+DEQUE_INLINE bool
+deque::push_front(unsigned int data) {
+    if (begin == 0 && !recenter_map()) {
+        return false;
+    }
+    size_t position = begin - 1;
+    if (map[position / DEQUE_BLOCK_ELEMENTS] == nullptr &&
+        !acquire_block(position / DEQUE_BLOCK_ELEMENTS)) {
+        return false;
+    }
+    *slot(position) = data;
+    begin = position;
+    ++dq_size;
+    return true;
+}
+
+// Popping the last element releases its block and moves an empty
+// deque back to the middle of the map, so both ends have room again.
+//
+DEQUE_INLINE bool
+deque::pop_front(unsigned int * popped_data) {
+    if (dq_size == 0) {
+        return false;
+    }
+    *popped_data = *slot(begin);
+    ++begin;
+    --dq_size;
+    if (dq_size == 0) {
+        release_block((begin - 1) / DEQUE_BLOCK_ELEMENTS);
+        begin = (map_capacity / 2) * DEQUE_BLOCK_ELEMENTS + DEQUE_BLOCK_ELEMENTS / 2;
+    } else if (begin % DEQUE_BLOCK_ELEMENTS == 0) {
+        release_block(begin / DEQUE_BLOCK_ELEMENTS - 1);
+    }
+    return true;
+}
+
+DEQUE_INLINE bool
+deque::pop_back(unsigned int * popped_data) {
+    if (dq_size == 0) {
+        return false;
+    }
+    size_t position = begin + dq_size - 1;
+    *popped_data = *slot(position);
+    --dq_size;
+    if (dq_size == 0) {
+        release_block(position / DEQUE_BLOCK_ELEMENTS);
+        begin = (map_capacity / 2) * DEQUE_BLOCK_ELEMENTS + DEQUE_BLOCK_ELEMENTS / 2;
+    } else if (position % DEQUE_BLOCK_ELEMENTS == 0) {
+        release_block(position / DEQUE_BLOCK_ELEMENTS);
+    }
+    return true;
+}
+
+DEQUE_INLINE bool
+deque::front(unsigned int * data) const {
+    if (dq_size == 0) {
+        return false;
+    }
+    *data = *slot(begin);
+    return true;
+}
+
+DEQUE_INLINE bool
+deque::back(unsigned int * data) const {
+    if (dq_size == 0) {
+        return false;
+    }
+    *data = *slot(begin + dq_size - 1);
+    return true;
+}
+
+DEQUE_INLINE size_t
+deque::size() const {
+    return dq_size;
+}
+
+DEQUE_INLINE void
+deque::clear() {
+    if (dq_size != 0) {
+        size_t last = (begin + dq_size - 1) / DEQUE_BLOCK_ELEMENTS;
+        for (size_t block = begin / DEQUE_BLOCK_ELEMENTS; block <= last; block++) {
+            deque::free_fptr(map[block]);
+            map[block] = nullptr;
+        }
+        dq_size = 0;
+        begin   = (map_capacity / 2) * DEQUE_BLOCK_ELEMENTS + DEQUE_BLOCK_ELEMENTS / 2;
+    }
+    if (spare_block != nullptr) {
+        deque::free_fptr(spare_block);
+        spare_block = nullptr;
+    }
+}
+
+#endif
@@ -0,0 +1,609 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynamic_graph.h"
+#include "relabel.h"
+#include "timing.h"
+#include "trace.h"
+
+// Changes to one vertex's row since the last compaction. inserted
+// holds neighbors the base row lacks, deleted base neighbors to
+// skip, every copy of them. Both sorted.
+//
+struct vertex_delta {
+    unsigned int * inserted;
+    size_t inserted_count;
+    size_t inserted_capacity;
+    unsigned int * deleted;
+    size_t deleted_count;
+    size_t deleted_capacity;
+};
+
+struct edge_update {
+    unsigned int from;
+    unsigned int to;
+    bool insert;
+};
+
+// Taken shared by every search and exclusively by every update and
+// by the compaction while it swaps its rows in. Writers go first, so
+// a steady stream of searches cannot hold an update off for long.
+//
+static pthread_rwlock_t view_lock;
+
+// row_count entries, NULL for vertices without changes. touched lists
+// the ones that have a delta, so nothing walks all of deltas.
+//
+static struct vertex_delta ** deltas = NULL;
+static unsigned int * touched        = NULL;
+static size_t touched_count          = 0;
+static size_t touched_capacity       = 0;
+
+static size_t threshold     = 0;
+static size_t delta_entries = 0;
+
+// The compaction in progress. It works from a copy of the deltas it
+// started with, while updates keep changing the live ones and are
+// logged for the replay.
+//
+static struct {
+    pthread_t thread;
+    bool started;
+    bool running;
+    bool failed;
+    size_t count;
+    unsigned int * vertices;
+    struct vertex_delta * snapshot;
+    struct row ** folded;
+} compaction;
+
+static struct edge_update * replay_log = NULL;
+static size_t replay_count             = 0;
+static size_t replay_capacity          = 0;
+static bool logging                    = false;
+
+static struct dynamic_graph_stats stats;
+
+// Position of the first element not less than value, and whether it
+// is value.
+//
+static bool sorted_find(const unsigned int * values, size_t count,
+                        unsigned int value, size_t * position) {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (values[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *position = lo;
+    return lo < count && values[lo] == value;
+}
+
+static bool sorted_insert(unsigned int ** values, size_t * count, size_t * capacity,
+                          size_t position, unsigned int value) {
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity == 0 ? 4 : *capacity * 2;
+        unsigned int * grown  = (unsigned int*)realloc(*values, grown_capacity * sizeof(unsigned int));
+        if (grown == NULL) {
+            return false;
+        }
+        *values   = grown;
+        *capacity = grown_capacity;
+    }
+    memmove(*values + position + 1, *values + position, (*count - position) * sizeof(unsigned int));
+    (*values)[position] = value;
+    ++*count;
+    return true;
+}
+
+static void sorted_remove(unsigned int * values, size_t * count, size_t position) {
+    memmove(values + position, values + position + 1, (*count - position - 1) * sizeof(unsigned int));
+    --*count;
+}
+
+static bool base_has_edge(unsigned int i, unsigned int j) {
+    struct row * row = rows[i];
+    if (row == NULL) {
+        return false;
+    }
+    for (size_t k = 0; k < row->size; k++) {
+        if (row->adjacent_nodes[k] == j) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct vertex_delta * delta_for(unsigned int vertex) {
+    if (deltas[vertex] != NULL) {
+        return deltas[vertex];
+    }
+    if (touched_count == touched_capacity) {
+        size_t grown_capacity = touched_capacity == 0 ? 1024 : touched_capacity * 2;
+        unsigned int * grown  = (unsigned int*)realloc(touched, grown_capacity * sizeof(unsigned int));
+        if (grown == NULL) {
+            return NULL;
+        }
+        touched          = grown;
+        touched_capacity = grown_capacity;
+    }
+    struct vertex_delta * delta = (struct vertex_delta*)calloc(1, sizeof(struct vertex_delta));
+    if (delta == NULL) {
+        return NULL;
+    }
+    touched[touched_count++] = vertex;
+    deltas[vertex]           = delta;
+    return delta;
+}
+
+static void free_deltas(void) {
+    for (size_t k = 0; k < touched_count; k++) {
+        struct vertex_delta * delta = deltas[touched[k]];
+        free(delta->inserted);
+        free(delta->deleted);
+        free(delta);
+        deltas[touched[k]] = NULL;
+    }
+    touched_count = 0;
+    delta_entries = 0;
+}
+
+// Makes i -> j present or absent in the view. The caller holds
+// view_lock exclusively.
+//
+static bool apply_update(unsigned int i, unsigned int j, bool insert) {
+    struct vertex_delta * delta = deltas[i];
+    size_t position;
+    if (insert) {
+        if (delta != NULL && sorted_find(delta->deleted, delta->deleted_count, j, &position)) {
+            sorted_remove(delta->deleted, &delta->deleted_count, position);
+            --delta_entries;
+            ++stats.inserts;
+            return true;
+        }
+        if ((delta != NULL && sorted_find(delta->inserted, delta->inserted_count, j, &position)) ||
+            base_has_edge(i, j)) {
+            ++stats.unchanged;
+            return true;
+        }
+        delta = delta_for(i);
+        if (delta == NULL) {
+            return false;
+        }
+        sorted_find(delta->inserted, delta->inserted_count, j, &position);
+        if (!sorted_insert(&delta->inserted, &delta->inserted_count, &delta->inserted_capacity,
+                           position, j)) {
+            return false;
+        }
+        ++delta_entries;
+        ++stats.inserts;
+        return true;
+    }
+
+    if (delta != NULL && sorted_find(delta->inserted, delta->inserted_count, j, &position)) {
+        sorted_remove(delta->inserted, &delta->inserted_count, position);
+        --delta_entries;
+        ++stats.deletes;
+        return true;
+    }
+    if (!base_has_edge(i, j) ||
+        (delta != NULL && sorted_find(delta->deleted, delta->deleted_count, j, &position))) {
+        ++stats.unchanged;
+        return true;
+    }
+    delta = delta_for(i);
+    if (delta == NULL) {
+        return false;
+    }
+    sorted_find(delta->deleted, delta->deleted_count, j, &position);
+    if (!sorted_insert(&delta->deleted, &delta->deleted_count, &delta->deleted_capacity,
+                       position, j)) {
+        return false;
+    }
+    ++delta_entries;
+    ++stats.deletes;
+    return true;
+}
+
+static bool log_update(unsigned int i, unsigned int j, bool insert) {
+    if (replay_count == replay_capacity) {
+        size_t grown_capacity     = replay_capacity == 0 ? 1024 : replay_capacity * 2;
+        struct edge_update * grown = (struct edge_update*)realloc(replay_log,
+                                                                  grown_capacity * sizeof(struct edge_update));
+        if (grown == NULL) {
+            return false;
+        }
+        replay_log      = grown;
+        replay_capacity = grown_capacity;
+    }
+    replay_log[replay_count].from   = i;
+    replay_log[replay_count].to     = j;
+    replay_log[replay_count].insert = insert;
+    ++replay_count;
+    return true;
+}
+
+// The base row of vertex merged with delta, with the capacity that
+// add_edge() expects. NULL with *empty set if nothing is left, NULL
+// alone on allocation failure.
+//
+static struct row * fold_row(unsigned int vertex, const struct vertex_delta * delta, bool * empty) {
+    struct row * base = rows[vertex];
+    size_t base_size  = base == NULL ? 0 : base->size;
+    size_t size       = delta->inserted_count;
+    size_t position;
+    for (size_t k = 0; k < base_size; k++) {
+        if (!sorted_find(delta->deleted, delta->deleted_count, base->adjacent_nodes[k], &position)) {
+            ++size;
+        }
+    }
+    *empty = size == 0;
+    if (size == 0) {
+        return NULL;
+    }
+
+    size_t capacity     = ((size + 1 + 15) / 16) * 16;
+    struct row * row    = (struct row*)malloc(sizeof(struct row));
+    unsigned int * adj  = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+    if (row == NULL || adj == NULL) {
+        free(row);
+        free(adj);
+        return NULL;
+    }
+
+    size_t used = 0;
+    for (size_t k = 0; k < base_size; k++) {
+        unsigned int neighbor = base->adjacent_nodes[k];
+        if (!sorted_find(delta->deleted, delta->deleted_count, neighbor, &position)) {
+            adj[used++] = neighbor;
+        }
+    }
+    memcpy(adj + used, delta->inserted, delta->inserted_count * sizeof(unsigned int));
+    row->size           = size;
+    row->adjacent_nodes = adj;
+    row->visited        = false;
+    return row;
+}
+
+static void free_row(struct row * row) {
+    if (row != NULL) {
+        free(row->adjacent_nodes);
+        free(row);
+    }
+}
+
+static void free_compaction_snapshot(void) {
+    for (size_t k = 0; k < compaction.count; k++) {
+        free(compaction.snapshot[k].inserted);
+        free(compaction.snapshot[k].deleted);
+    }
+    free(compaction.snapshot);
+    free(compaction.vertices);
+    free(compaction.folded);
+    compaction.snapshot = NULL;
+    compaction.vertices = NULL;
+    compaction.folded   = NULL;
+    compaction.count    = 0;
+}
+
+// Builds the new rows outside of any lock, reading only the base
+// rows, which nothing else changes, and the snapshot. Then swaps
+// them in, starts the deltas over and replays what came in since.
+//
+static void * compaction_thread(void *) {
+    TRACE_SPAN("compact_dynamic_graph");
+    struct timespec start, built, installed;
+    GRAB_CLOCK(start)
+    bool ok = true;
+    for (size_t k = 0; k < compaction.count && ok; k++) {
+        bool empty;
+        compaction.folded[k] = fold_row(compaction.vertices[k], &compaction.snapshot[k], &empty);
+        ok = compaction.folded[k] != NULL || empty;
+    }
+    GRAB_CLOCK(built)
+
+    pthread_rwlock_wrlock(&view_lock);
+    if (ok) {
+        for (size_t k = 0; k < compaction.count; k++) {
+            unsigned int vertex = compaction.vertices[k];
+            free_row(rows[vertex]);
+            rows[vertex]         = compaction.folded[k];
+            compaction.folded[k] = NULL;
+        }
+        free_deltas();
+
+        // The replay finds the view as the logged updates left it,
+        // so it only rebuilds their deltas and counts nothing.
+        //
+        size_t inserts   = stats.inserts;
+        size_t deletes   = stats.deletes;
+        size_t unchanged = stats.unchanged;
+        for (size_t k = 0; k < replay_count && ok; k++) {
+            ok = apply_update(replay_log[k].from, replay_log[k].to, replay_log[k].insert);
+        }
+        stats.inserts   = inserts;
+        stats.deletes   = deletes;
+        stats.unchanged = unchanged;
+        ++stats.compactions;
+        stats.rows_rewritten += compaction.count;
+    } else {
+        for (size_t k = 0; k < compaction.count; k++) {
+            free_row(compaction.folded[k]);
+        }
+    }
+    compaction.failed  = compaction.failed || !ok;
+    logging            = false;
+    replay_count       = 0;
+    free_compaction_snapshot();
+    GRAB_CLOCK(installed)
+    stats.compaction_nanoseconds += compute_timespec_diff(start, built);
+    stats.install_nanoseconds    += compute_timespec_diff(built, installed);
+    compaction.running = false;
+    pthread_rwlock_unlock(&view_lock);
+    return NULL;
+}
+
+// Copies the deltas and hands them to a new compaction thread. The
+// caller holds view_lock exclusively and no compaction is running.
+//
+static bool start_compaction(void) {
+    if (compaction.started) {
+        pthread_join(compaction.thread, NULL);
+        compaction.started = false;
+    }
+
+    compaction.count    = touched_count;
+    compaction.vertices = (unsigned int*)malloc(touched_count * sizeof(unsigned int));
+    compaction.snapshot = (struct vertex_delta*)calloc(touched_count, sizeof(struct vertex_delta));
+    compaction.folded   = (struct row**)calloc(touched_count, sizeof(struct row*));
+    if (compaction.vertices == NULL || compaction.snapshot == NULL || compaction.folded == NULL) {
+        compaction.count = 0;
+        free_compaction_snapshot();
+        return false;
+    }
+
+    for (size_t k = 0; k < touched_count; k++) {
+        const struct vertex_delta * live = deltas[touched[k]];
+        struct vertex_delta * copy       = &compaction.snapshot[k];
+        compaction.vertices[k] = touched[k];
+        copy->inserted = (unsigned int*)malloc((live->inserted_count + 1) * sizeof(unsigned int));
+        copy->deleted  = (unsigned int*)malloc((live->deleted_count + 1) * sizeof(unsigned int));
+        if (copy->inserted == NULL || copy->deleted == NULL) {
+            free_compaction_snapshot();
+            return false;
+        }
+        if (live->inserted_count != 0) {
+            memcpy(copy->inserted, live->inserted, live->inserted_count * sizeof(unsigned int));
+        }
+        if (live->deleted_count != 0) {
+            memcpy(copy->deleted, live->deleted, live->deleted_count * sizeof(unsigned int));
+        }
+        copy->inserted_count = live->inserted_count;
+        copy->deleted_count  = live->deleted_count;
+    }
+
+    logging            = true;
+    replay_count       = 0;
+    compaction.running = true;
+    if (pthread_create(&compaction.thread, NULL, compaction_thread, NULL) != 0) {
+        logging            = false;
+        compaction.running = false;
+        free_compaction_snapshot();
+        return false;
+    }
+    compaction.started = true;
+    return true;
+}
+
+bool init_dynamic_graph(size_t compaction_threshold) {
+    deltas = (struct vertex_delta**)calloc(row_count, sizeof(struct vertex_delta*));
+    if (deltas == NULL) {
+        return false;
+    }
+
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&view_lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+
+    threshold     = compaction_threshold == 0 ? 1 : compaction_threshold;
+    delta_entries = 0;
+    touched_count = 0;
+    memset(&compaction, 0, sizeof(compaction));
+    memset(&stats, 0, sizeof(stats));
+    return true;
+}
+
+bool finish_dynamic_graph(void) {
+    if (compaction.started) {
+        pthread_join(compaction.thread, NULL);
+        compaction.started = false;
+    }
+
+    // Fold the rest in the same way, with nothing left to wait for.
+    //
+    bool ok = !compaction.failed;
+    if (ok && touched_count > 0) {
+        pthread_rwlock_wrlock(&view_lock);
+        ok = start_compaction();
+        pthread_rwlock_unlock(&view_lock);
+        if (ok) {
+            pthread_join(compaction.thread, NULL);
+            compaction.started = false;
+            ok = !compaction.failed;
+        }
+    }
+
+    free_deltas();
+    free(deltas);
+    free(touched);
+    free(replay_log);
+    deltas           = NULL;
+    touched          = NULL;
+    touched_capacity = 0;
+    replay_log       = NULL;
+    replay_capacity  = 0;
+    pthread_rwlock_destroy(&view_lock);
+    return ok;
+}
+
+static bool update_edge(unsigned int i, unsigned int j, bool insert) {
+    pthread_rwlock_wrlock(&view_lock);
+    bool ok = apply_update(i, j, insert);
+    if (ok && logging) {
+        ok = log_update(i, j, insert);
+    }
+    if (ok && delta_entries >= threshold && !compaction.running) {
+        ok = start_compaction();
+    }
+    pthread_rwlock_unlock(&view_lock);
+    return ok;
+}
+
+bool insert_dynamic_edge(unsigned int i, unsigned int j) {
+    return update_edge(i, j, true);
+}
+
+bool delete_dynamic_edge(unsigned int i, unsigned int j) {
+    return update_edge(i, j, false);
+}
+
+bool load_edge_deltas(const char * path) {
+    TRACE_SPAN("load_edge_deltas");
+    FILE * file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Error opening edge deltas %s.\n", path);
+        return false;
+    }
+
+    char line[256];
+    size_t line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        ++line_number;
+        char op;
+        unsigned int i, j;
+        if (line[0] == '%' || line[0] == '#' || sscanf(line, " %c", &op) != 1) {
+            continue;
+        }
+        if (sscanf(line, " %c %u %u", &op, &i, &j) != 3 || (op != '+' && op != '-')) {
+            printf("Edge deltas %s line %ld: expected \"+ i j\" or \"- i j\".\n", path, line_number);
+            ok = false;
+            break;
+        }
+        if (i >= row_count || j >= row_count) {
+            printf("Edge deltas %s line %ld: vertex outside the graph.\n", path, line_number);
+            ok = false;
+            break;
+        }
+        i  = to_internal_id(i);
+        j  = to_internal_id(j);
+        ok = op == '+' ? insert_dynamic_edge(i, j) : delete_dynamic_edge(i, j);
+        if (!ok) {
+            printf("Failed to allocate edge delta.\n");
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+void read_dynamic_graph_stats(struct dynamic_graph_stats * out) {
+    pthread_rwlock_rdlock(&view_lock);
+    *out               = stats;
+    out->delta_entries = delta_entries;
+    pthread_rwlock_unlock(&view_lock);
+}
+
+static inline bool push_neighbor(queue * q, unsigned int data, unsigned int j, bool * found_path) {
+    if (j == data) {
+        *found_path = true;
+    }
+    return q->push(data);
+}
+
+bool dynamic_breadth_first_search(struct search_state * state,
+                                  unsigned int i, unsigned int j,
+                                  struct search_result * result) {
+    TRACE_SPAN("dynamic_bfs");
+    pthread_rwlock_rdlock(&view_lock);
+    queue * q                    = state->q;
+    unsigned int * visited_epoch = state->visited_epoch;
+    unsigned int epoch           = next_search_epoch(state);
+
+    bool found_path = false;
+    bool push_ok    = true;
+    unsigned int next_node = i;
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    while (!found_path) {
+        struct row * row            = rows[next_node];
+        struct vertex_delta * delta = deltas[next_node];
+
+        if ((row == NULL && delta == NULL) || visited_epoch[next_node] == epoch) {
+            bool not_done = q->pop(&next_node);
+            ++node_count;
+            if (!not_done) break;
+            continue;
+        }
+        visited_epoch[next_node] = epoch;
+
+        // Rows without deletions take the same loop as the static
+        // search.
+        //
+        if (row != NULL && (delta == NULL || delta->deleted_count == 0)) {
+            edge_count += row->size;
+            for (size_t node = 0; node < row->size && push_ok; node++) {
+                push_ok = push_neighbor(q, row->adjacent_nodes[node], j, &found_path);
+            }
+        } else if (row != NULL) {
+            for (size_t node = 0; node < row->size && push_ok; node++) {
+                unsigned int data = row->adjacent_nodes[node];
+                size_t position;
+                if (sorted_find(delta->deleted, delta->deleted_count, data, &position)) continue;
+                ++edge_count;
+                push_ok = push_neighbor(q, data, j, &found_path);
+            }
+        }
+        if (delta != NULL) {
+            edge_count += delta->inserted_count;
+            for (size_t node = 0; node < delta->inserted_count && push_ok; node++) {
+                push_ok = push_neighbor(q, delta->inserted[node], j, &found_path);
+            }
+        }
+        if (!push_ok) {
+            printf("Error pushing into queue.\n");
+            break;
+        }
+
+        // Pop the next row off the queue.
+        //
+        if (!q->pop(&next_node)) {
+            break;
+        }
+        ++node_count;
+    }
+
+    // Empty the queue so that it can be reused by the next search.
+    //
+    unsigned int discarded;
+    while (q->pop(&discarded)) {
+    }
+    GRAB_CLOCK(stop)
+    pthread_rwlock_unlock(&view_lock);
+
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
@@ -0,0 +1,82 @@
+#ifndef DYNAMIC_GRAPH_H_
+#define DYNAMIC_GRAPH_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+
+// Edge insertions and deletions on top of the loaded graph, without
+// rebuilding it.
+//
+// The rows stay the read-only base. Changes go into a delta per
+// vertex: the neighbors inserted since the last compaction and the
+// base neighbors deleted since then, both kept sorted. Searches see
+// the merged view, the base row minus the deleted neighbors plus the
+// inserted ones. Inserting an edge that is already there or deleting
+// one that is not changes nothing, so the view is the set of edges
+// that the updates so far leave in place.
+//
+// Once the deltas hold compaction_threshold entries, a background
+// thread folds them into new rows for the vertices that have one.
+// Searches and updates carry on meanwhile; updates made after the
+// compaction started are logged and replayed onto the new rows when
+// they are swapped in, which is the only time the thread blocks the
+// others.
+//
+// Rows must have been built by add_edge() or relabel_graph(), not
+// moved by place_graph(), since the compaction frees the rows it
+// replaces.
+//
+struct dynamic_graph_stats {
+    size_t inserts;
+    size_t deletes;
+    // Updates that found the view already as asked.
+    //
+    size_t unchanged;
+    size_t delta_entries;
+    size_t compactions;
+    size_t rows_rewritten;
+    // Building the new rows in the background, and swapping them in
+    // with everyone else held off.
+    //
+    long compaction_nanoseconds;
+    long install_nanoseconds;
+};
+
+// Returns FALSE on allocation failure.
+//
+bool init_dynamic_graph(size_t compaction_threshold);
+
+// Waits for a running compaction, folds whatever is left into the
+// rows, and frees the deltas. The rows are then a plain graph again.
+//
+bool finish_dynamic_graph(void);
+
+// Make edge i -> j present or absent in the view, and start a
+// compaction if the deltas have grown past the threshold. Safe to
+// call while searches run, from one thread at a time. Return FALSE
+// on allocation failure.
+//
+bool insert_dynamic_edge(unsigned int i, unsigned int j);
+bool delete_dynamic_edge(unsigned int i, unsigned int j);
+
+// Applies an edge-delta file, one update per line:
+//
+//     + i j    insert edge i -> j
+//     - i j    delete edge i -> j
+//
+// with ids as in the matrix, translated into relabeled rows if
+// needed. Lines starting with '%' or '#' are comments. Returns FALSE
+// on a parsing or allocation failure or an id outside the graph.
+//
+bool load_edge_deltas(const char * path);
+
+void read_dynamic_graph_stats(struct dynamic_graph_stats * stats);
+
+// shared_breadth_first_search() over the merged view.
+//
+bool dynamic_breadth_first_search(struct search_state * state,
+                                  unsigned int i, unsigned int j,
+                                  struct search_result * result);
+
+#endif
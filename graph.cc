@@ -0,0 +1,258 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph.h"
+#include "memory_placement.h"
+#include "timing.h"
+#include "trace.h"
+
+struct row ** rows = NULL;
+size_t row_count   = 0;
+
+// The three arrays place_graph() moved the graph into, NULL until
+// then.
+//
+static struct row ** placed_row_array = NULL;
+static struct row * placed_rows       = NULL;
+static unsigned int * placed_edges    = NULL;
+static size_t placed_row_count        = 0;
+static size_t placed_edge_count       = 0;
+
+size_t search_queue_reserve     = 0;
+size_t search_queue_cache_limit = SIZE_MAX;
+size_t search_queue_memory_budget         = 0;
+const char * search_queue_spill_directory = NULL;
+
+bool (*search_fptr)(struct search_state *, unsigned int, unsigned int,
+                    struct search_result *) = shared_breadth_first_search;
+
+bool allocate_graph(size_t node_count) {
+    rows = (struct row**)malloc(sizeof(struct row*) * node_count);
+    if (rows == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < node_count; i++) {
+        rows[i] = NULL;
+    }
+    row_count = node_count;
+    return true;
+}
+
+void add_edge(unsigned int i, unsigned int j) {
+    // Check whether row i exists, if not allocate.
+    //
+    if (rows[i] == NULL) {
+        rows[i] = (struct row*)malloc(sizeof(struct row));
+
+        if (rows[i] == NULL) {
+            printf("Failed to allocate edge, exiting.\n");
+            exit(1);
+        }
+
+        rows[i]->size              = 1;
+        rows[i]->adjacent_nodes    = static_cast<unsigned int*>(malloc(16 * sizeof(unsigned int)));
+        rows[i]->visited           = false;
+        if (rows[i]->adjacent_nodes == NULL) {
+            printf("Unable to malloc adjacent_nodes.\n");
+            exit(1);
+        }
+        rows[i]->adjacent_nodes[0] = j;
+    } else {
+        // Check whether to perform realloc.
+        // Every 16 nodes we allocate another 16.
+        //
+        size_t size = rows[i]->size;
+        if (size % 16 == 15) {
+             rows[i]->adjacent_nodes = static_cast<unsigned int*>(realloc(rows[i]->adjacent_nodes, (size + 1 + 16) * sizeof(unsigned int)));
+
+             if (rows[i]->adjacent_nodes == NULL) {
+                 printf("Failed to realloc adjacent nodes.\n");
+                 exit(1);
+             }
+        }
+
+        rows[i]->adjacent_nodes[size] = j;
+        ++rows[i]->size;
+    }
+}
+
+void free_graph(void) {
+    TRACE_SPAN("free_graph");
+    if (placed_row_array != NULL) {
+        placed_free(placed_row_array, row_count * sizeof(struct row*));
+        placed_free(placed_rows, placed_row_count * sizeof(struct row));
+        placed_free(placed_edges, placed_edge_count * sizeof(unsigned int));
+        placed_row_array = NULL;
+        placed_rows      = NULL;
+        placed_edges     = NULL;
+        rows             = NULL;
+        row_count        = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < row_count; i++) {
+        if (rows[i] == NULL) continue;
+        free(rows[i]->adjacent_nodes);
+        free(rows[i]);
+    }
+
+    free(rows);
+    rows      = NULL;
+    row_count = 0;
+}
+
+bool place_graph(void) {
+    TRACE_SPAN("place_graph");
+    size_t row_total  = 0;
+    size_t edge_total = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        ++row_total;
+        edge_total += rows[v]->size;
+    }
+
+    struct row ** row_array = (struct row**)placed_alloc(row_count * sizeof(struct row*));
+    struct row * packed     = (struct row*)placed_alloc(row_total * sizeof(struct row));
+    unsigned int * edges    = (unsigned int*)placed_alloc(edge_total * sizeof(unsigned int));
+    if (row_array == NULL || packed == NULL || edges == NULL) {
+        placed_free(row_array, row_count * sizeof(struct row*));
+        placed_free(packed, row_total * sizeof(struct row));
+        placed_free(edges, edge_total * sizeof(unsigned int));
+        return false;
+    }
+
+    // Rows and their neighbors stay in id order, so a row is followed
+    // by the next one in memory.
+    //
+    size_t used_rows  = 0;
+    size_t used_edges = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        struct row * row    = &packed[used_rows++];
+        row->size           = rows[v]->size;
+        row->visited        = rows[v]->visited;
+        row->adjacent_nodes = edges + used_edges;
+        memcpy(row->adjacent_nodes, rows[v]->adjacent_nodes, row->size * sizeof(unsigned int));
+        used_edges         += row->size;
+        row_array[v]        = row;
+    }
+
+    size_t count = row_count;
+    free_graph();
+    rows              = row_array;
+    row_count         = count;
+    placed_row_array  = row_array;
+    placed_rows       = packed;
+    placed_edges      = edges;
+    placed_row_count  = row_total;
+    placed_edge_count = edge_total;
+    return true;
+}
+
+bool configure_search_queue(queue * q) {
+    q->set_node_cache_limit(search_queue_cache_limit);
+    if (search_queue_memory_budget != 0 &&
+        !q->set_memory_budget(search_queue_memory_budget, search_queue_spill_directory)) {
+        return false;
+    }
+    return q->reserve(search_queue_reserve);
+}
+
+bool init_search_state(struct search_state * state) {
+    state->q             = new queue();
+    state->visited_epoch = static_cast<unsigned int*>(placed_alloc(row_count * sizeof(unsigned int)));
+    state->epoch         = 0;
+
+    if (state->q == NULL || state->visited_epoch == NULL ||
+        !configure_search_queue(state->q)) {
+        destroy_search_state(state);
+        return false;
+    }
+    return true;
+}
+
+void destroy_search_state(struct search_state * state) {
+    delete state->q;
+    placed_free(state->visited_epoch, row_count * sizeof(unsigned int));
+    state->q             = NULL;
+    state->visited_epoch = NULL;
+}
+
+unsigned int next_search_epoch(struct search_state * state) {
+    ++state->epoch;
+    if (state->epoch == 0) {
+        TRACE_SPAN("reset_visited (epoch wrap)");
+        memset(state->visited_epoch, 0, row_count * sizeof(unsigned int));
+        state->epoch = 1;
+    }
+    return state->epoch;
+}
+
+bool shared_breadth_first_search(struct search_state * state,
+                                 unsigned int i, unsigned int j,
+                                 struct search_result * result) {
+    TRACE_SPAN("bfs");
+    queue * q                    = state->q;
+    unsigned int * visited_epoch = state->visited_epoch;
+    unsigned int epoch           = next_search_epoch(state);
+
+    bool found_path = false;
+    bool push_error = false;
+    unsigned int next_node = i;
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    while (!found_path) {
+        struct row * row = rows[next_node];
+
+        if (row == NULL || visited_epoch[next_node] == epoch) {
+            bool not_done = q->pop(&next_node);
+            ++node_count;
+            if (!not_done) break;
+            continue;
+        }
+        visited_epoch[next_node] = epoch;
+        edge_count += row->size;
+
+        for (size_t node = 0; node < row->size; node++) {
+            unsigned int data = row->adjacent_nodes[node];
+            // Check if we found the node.
+            //
+            if (j == data) {
+                found_path = true;
+            }
+            if (!q->push(data)) {
+                push_error = true;
+                break;
+            }
+        }
+        if (push_error) {
+            printf("Error pushing into queue.\n");
+            break;
+        }
+
+        // Pop the next row off the queue.
+        //
+        if (!q->pop(&next_node)) {
+            break;
+        }
+        ++node_count;
+    }
+
+    // Empty the queue so that it can be reused by the next search.
+    //
+    unsigned int discarded;
+    while (q->pop(&discarded)) {
+    }
+    GRAB_CLOCK(stop)
+
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
@@ -0,0 +1,103 @@
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <stddef.h>
+
+#include "queue.h"
+
+// A hacky adjacency matrix. 
+//
+struct row {
+    size_t size;
+    unsigned int * adjacent_nodes;
+    bool visited;
+};
+
+// One entry per node id. A NULL means that a particular node
+// in the graph has no directed edges to other nodes.
+//
+extern struct row ** rows;
+extern size_t row_count;
+
+// Allocates a zeroed row array for node ids 0 through
+// node_count - 1. Returns FALSE on allocation failure.
+//
+bool allocate_graph(size_t node_count);
+void add_edge(unsigned int i, unsigned int j);
+void free_graph(void);
+
+// Moves the row array, the rows and all of their adjacent_nodes
+// into three arrays from placed_alloc(), so that they follow the
+// memory placement policy, see memory_placement.h. No add_edge()
+// after this. Returns FALSE, leaving the graph as it was, on
+// allocation failure.
+//
+bool place_graph(void);
+
+// Per-searcher state for searches that treat the graph as
+// read-only, so that several of them can run at once.
+//
+// Instead of the row->visited flags, a node counts as visited
+// when its visited_epoch entry equals the current epoch. Bumping
+// the epoch clears every node in O(1), the array only has to be
+// wiped when the counter wraps around.
+//
+struct search_state {
+    queue * q;
+    unsigned int * visited_epoch;
+    unsigned int epoch;
+};
+
+struct search_result {
+    bool found_path;
+    size_t nodes_visited;
+    size_t edges_scanned;
+    long nanoseconds;
+};
+
+// Nodes every search queue reserves up front, and the most popped
+// nodes it keeps for reuse, see queue::reserve(). By default nothing
+// is reserved and the cache is unbounded.
+//
+extern size_t search_queue_reserve;
+extern size_t search_queue_cache_limit;
+
+// Memory budget in bytes of every search queue, 0 for none, and the
+// directory it spills to beyond that (NULL for $TMPDIR or /tmp), see
+// queue::set_memory_budget().
+//
+extern size_t search_queue_memory_budget;
+extern const char * search_queue_spill_directory;
+
+// Applies the settings above to q. Returns FALSE on allocation
+// failure.
+//
+bool configure_search_queue(queue * q);
+
+// Returns FALSE on allocation failure.
+//
+bool init_search_state(struct search_state * state);
+void destroy_search_state(struct search_state * state);
+
+// Starts a new search and returns its epoch. Epoch 0 is never
+// used, so a freshly zeroed array marks every node as unvisited.
+//
+unsigned int next_search_epoch(struct search_state * state);
+
+// Same search as breadth_first_search() in queue_performance.cc,
+// but using only the state passed in. The queue is left empty on
+// return. Returns TRUE if a path from i to j was found.
+//
+bool shared_breadth_first_search(struct search_state * state,
+                                 unsigned int i, unsigned int j,
+                                 struct search_result * result);
+
+// The search run by the scheduler, the server and the layout
+// comparisons. Points at shared_breadth_first_search() unless
+// another engine over the same graph has been selected.
+//
+extern bool (*search_fptr)(struct search_state * state,
+                           unsigned int i, unsigned int j,
+                           struct search_result * result);
+
+#endif
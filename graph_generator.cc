@@ -0,0 +1,425 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mmio.h"
+
+// Writes seeded synthetic directed graphs in Matrix Market format,
+// plus a matching 'nodes' query file, so that queue_performance can
+// be benchmarked without downloading the Wikipedia matrix.
+//
+// Two models are supported:
+//  x rmat: R-MAT / Kronecker. Every edge picks one quadrant of the
+//    adjacency matrix per level with probabilities a, b, c and
+//    1 - a - b - c, which yields the skewed degree distribution of
+//    real web graphs. Vertex ids are scrambled by a bijection so that
+//    the hubs are not all clustered at low ids.
+//  x er: Erdos-Renyi G(n, m), every edge uniformly at random.
+//
+// Ids are written 1-based, like the Wikipedia matrix. The same seed
+// always produces the same files.
+
+enum graph_model {
+    MODEL_RMAT,
+    MODEL_ER
+};
+
+struct options {
+    enum graph_model model;
+    uint64_t vertices;
+    uint64_t edges;
+    double a, b, c;
+    uint64_t seed;
+    size_t queries;
+
+    // Probability of an edge weighing 0, the others weigh 1 through
+    // max_weight. A pattern matrix with no weights at all if neither
+    // is given, which leaves them negative and 0.
+    //
+    double zero_weight_probability;
+    uint64_t max_weight;
+    const char * matrix_path;
+    const char * nodes_path;
+};
+
+// xoshiro256** seeded through splitmix64.
+//
+static uint64_t rng[4];
+
+static uint64_t splitmix64(uint64_t * state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void seed_random(uint64_t seed) {
+    for (size_t k = 0; k < 4; k++) {
+        rng[k] = splitmix64(&seed);
+    }
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t next_random(void) {
+    uint64_t result = rotl(rng[1] * 5, 7) * 9;
+    uint64_t t      = rng[1] << 17;
+    rng[2] ^= rng[0];
+    rng[3] ^= rng[1];
+    rng[1] ^= rng[2];
+    rng[0] ^= rng[3];
+    rng[2] ^= t;
+    rng[3]  = rotl(rng[3], 45);
+    return result;
+}
+
+// Uniform in [0, bound).
+//
+static inline uint64_t random_below(uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)next_random() * bound) >> 64);
+}
+
+static inline double random_unit(void) {
+    return (double)(next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// A bijection on [0, 2^scale), used to scramble R-MAT vertex ids.
+//
+static inline uint64_t scramble(uint64_t x, unsigned int scale, uint64_t key) {
+    uint64_t mask = scale == 64 ? ~0ULL : (1ULL << scale) - 1;
+    for (int round = 0; round < 2; round++) {
+        x = (x * 0x9E3779B97F4A7C15ULL + key) & mask;
+        x ^= x >> ((scale + 1) / 2);
+    }
+    return x & mask;
+}
+
+struct rmat_state {
+    unsigned int scale;
+    uint64_t key;
+    // Cumulative quadrant thresholds.
+    //
+    double ab, abc;
+};
+
+static void rmat_edge(const struct options * options, const struct rmat_state * state,
+                      uint64_t * from, uint64_t * to) {
+    do {
+        uint64_t row = 0, column = 0;
+        for (unsigned int level = 0; level < state->scale; level++) {
+            double r = random_unit();
+            row    <<= 1;
+            column <<= 1;
+            if (r < options->a) {
+            } else if (r < state->ab) {
+                column |= 1;
+            } else if (r < state->abc) {
+                row |= 1;
+            } else {
+                row    |= 1;
+                column |= 1;
+            }
+        }
+        *from = scramble(row, state->scale, state->key);
+        *to   = scramble(column, state->scale, state->key);
+    } while (*from >= options->vertices || *to >= options->vertices);
+}
+
+// Appends "from to\n" to a large output buffer, much faster than
+// fprintf() at billions of lines.
+//
+struct line_writer {
+    FILE * file;
+    char * buffer;
+    size_t used;
+    size_t capacity;
+    bool failed;
+};
+
+static void write_number(struct line_writer * writer, uint64_t value) {
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        writer->buffer[writer->used++] = digits[--count];
+    }
+}
+
+static void write_pair(struct line_writer * writer, uint64_t i, uint64_t j) {
+    if (writer->used + 48 > writer->capacity) {
+        if (fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) {
+            writer->failed = true;
+        }
+        writer->used = 0;
+    }
+    write_number(writer, i);
+    writer->buffer[writer->used++] = ' ';
+    write_number(writer, j);
+    writer->buffer[writer->used++] = '\n';
+}
+
+// Writes "i j w", for integer matrices.
+//
+static void write_weighted_pair(struct line_writer * writer, uint64_t i, uint64_t j,
+                                uint64_t weight) {
+    write_pair(writer, i, j);
+    writer->buffer[writer->used - 1] = ' ';
+    write_number(writer, weight);
+    writer->buffer[writer->used++] = '\n';
+}
+
+static bool finish_writer(struct line_writer * writer) {
+    if (writer->used > 0 &&
+        fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) {
+        writer->failed = true;
+    }
+    free(writer->buffer);
+    return !writer->failed;
+}
+
+static void print_usage(const char * program) {
+    printf("Usage: %s [--model rmat|er] [--vertices N] [--edges M]\n"
+           "       [--skew A,B,C] [--seed S] [--queries Q]\n"
+           "       [--zero-weights P] [--max-weight W]\n"
+           "       [--matrix PATH] [--nodes PATH]\n", program);
+    printf("  --model      rmat (default) or er\n");
+    printf("  --vertices   vertex count, default 2^20\n");
+    printf("  --edges      edge count, default 16 per vertex\n");
+    printf("  --skew       R-MAT quadrant probabilities a,b,c (d = 1 - a - b - c),\n");
+    printf("               default 0.57,0.19,0.19\n");
+    printf("  --seed       random seed, default 1\n");
+    printf("  --queries    query pairs written to the nodes file, default 100\n");
+    printf("  --zero-weights write an integer matrix of edge weights, each edge\n");
+    printf("               weighing 0 with probability P, for queue_performance --zero-one\n");
+    printf("  --max-weight   write an integer matrix of edge weights, the edges not\n");
+    printf("               weighing 0 weigh 1 through W uniformly, for --weighted\n");
+    printf("  --matrix     output matrix, default synthetic/graph.mtx\n");
+    printf("  --nodes      output query file, default synthetic/nodes\n");
+}
+
+static bool parse_options(int argc, char ** argv, struct options * options) {
+    options->model       = MODEL_RMAT;
+    options->vertices    = 1ULL << 20;
+    options->edges       = 0;
+    options->a           = 0.57;
+    options->b           = 0.19;
+    options->c           = 0.19;
+    options->seed        = 1;
+    options->queries     = 100;
+    options->zero_weight_probability = -1.0;
+    options->max_weight  = 0;
+    options->matrix_path = "synthetic/graph.mtx";
+    options->nodes_path  = "synthetic/nodes";
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (arg + 1 >= argc) {
+            return false;
+        }
+        const char * value = argv[arg + 1];
+        if (strcmp(argv[arg], "--model") == 0) {
+            if (strcmp(value, "rmat") == 0 || strcmp(value, "kronecker") == 0) {
+                options->model = MODEL_RMAT;
+            } else if (strcmp(value, "er") == 0) {
+                options->model = MODEL_ER;
+            } else {
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--vertices") == 0) {
+            options->vertices = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[arg], "--edges") == 0) {
+            options->edges = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[arg], "--skew") == 0) {
+            if (sscanf(value, "%lf,%lf,%lf", &options->a, &options->b, &options->c) != 3) {
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--seed") == 0) {
+            options->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[arg], "--queries") == 0) {
+            options->queries = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[arg], "--zero-weights") == 0) {
+            options->zero_weight_probability = strtod(value, NULL);
+            if (options->zero_weight_probability < 0 || options->zero_weight_probability > 1.0) {
+                printf("--zero-weights must be between 0 and 1.\n");
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--max-weight") == 0) {
+            options->max_weight = strtoull(value, NULL, 10);
+            if (options->max_weight == 0 || options->max_weight > INT_MAX) {
+                printf("--max-weight must be between 1 and %d.\n", INT_MAX);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--matrix") == 0) {
+            options->matrix_path = value;
+        } else if (strcmp(argv[arg], "--nodes") == 0) {
+            options->nodes_path = value;
+        } else {
+            return false;
+        }
+        ++arg;
+    }
+
+    if (options->edges == 0) {
+        options->edges = options->vertices * 16;
+    }
+    if (options->max_weight != 0 && options->zero_weight_probability < 0) {
+        options->zero_weight_probability = 0.0;
+    } else if (options->max_weight == 0 && options->zero_weight_probability >= 0) {
+        options->max_weight = 1;
+    }
+
+    // Matrix Market sizes are ints, and node ids unsigned ints.
+    //
+    if (options->vertices == 0 || options->vertices > INT_MAX ||
+        options->edges > INT_MAX) {
+        printf("Vertex and edge counts must be between 1 and %d.\n", INT_MAX);
+        return false;
+    }
+    if (options->a < 0 || options->b < 0 || options->c < 0 ||
+        options->a + options->b + options->c > 1.0) {
+        printf("R-MAT probabilities must be non-negative and sum to at most 1.\n");
+        return false;
+    }
+    return true;
+}
+
+// Creates the parent directory of path if needed.
+//
+static void make_parent_directory(const char * path) {
+    const char * slash = strrchr(path, '/');
+    if (slash == NULL || slash == path) return;
+
+    char directory[4096];
+    size_t length = slash - path;
+    if (length >= sizeof(directory)) return;
+    memcpy(directory, path, length);
+    directory[length] = '\0';
+    mkdir(directory, 0755);
+}
+
+int main(int argc, char ** argv) {
+    struct options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    make_parent_directory(options.matrix_path);
+    make_parent_directory(options.nodes_path);
+    FILE * matrix = fopen(options.matrix_path, "w");
+    FILE * nodes  = fopen(options.nodes_path, "w");
+    if (matrix == NULL || nodes == NULL) {
+        printf("Unable to open %s or %s for writing.\n", options.matrix_path, options.nodes_path);
+        return 1;
+    }
+
+    MM_typecode matrix_code;
+    mm_initialize_typecode(&matrix_code);
+    mm_set_matrix(&matrix_code);
+    mm_set_coordinate(&matrix_code);
+    if (options.zero_weight_probability < 0) {
+        mm_set_pattern(&matrix_code);
+    } else {
+        mm_set_integer(&matrix_code);
+    }
+    mm_set_general(&matrix_code);
+
+    if (mm_write_banner(matrix, matrix_code) != 0 ||
+        mm_write_mtx_crd_size(matrix, (int)options.vertices, (int)options.vertices,
+                              (int)options.edges) != 0) {
+        printf("Failed to write Matrix Market header.\n");
+        return 1;
+    }
+
+    struct rmat_state rmat;
+    rmat.scale = 0;
+    while ((1ULL << rmat.scale) < options.vertices) ++rmat.scale;
+    rmat.ab  = options.a + options.b;
+    rmat.abc = options.a + options.b + options.c;
+
+    seed_random(options.seed);
+    rmat.key = next_random() | 1;
+
+    // Queries are drawn from the generated edges, a source and a
+    // target of two independent edges, so that searches start at a
+    // vertex that has neighbors. Reservoir sampling keeps this one
+    // pass with no memory beyond the samples.
+    //
+    uint64_t * sources = (uint64_t*)malloc((options.queries + 1) * sizeof(uint64_t));
+    uint64_t * targets = (uint64_t*)malloc((options.queries + 1) * sizeof(uint64_t));
+
+    struct line_writer writer;
+    writer.file     = matrix;
+    writer.capacity = 1 << 22;
+    writer.buffer   = (char*)malloc(writer.capacity);
+    writer.used     = 0;
+    writer.failed   = false;
+    if (sources == NULL || targets == NULL || writer.buffer == NULL) {
+        printf("Failed to allocate generator buffers.\n");
+        return 1;
+    }
+
+    printf("Generating %s graph: %lu vertices, %lu edges, seed %lu\n",
+           options.model == MODEL_RMAT ? "R-MAT" : "Erdos-Renyi",
+           options.vertices, options.edges, options.seed);
+
+    uint64_t report_every = options.edges / 10 == 0 ? 1 : options.edges / 10;
+    for (uint64_t e = 0; e < options.edges; e++) {
+        uint64_t from, to;
+        if (options.model == MODEL_RMAT) {
+            rmat_edge(&options, &rmat, &from, &to);
+        } else {
+            from = random_below(options.vertices);
+            to   = random_below(options.vertices);
+        }
+        if (options.zero_weight_probability < 0) {
+            write_pair(&writer, from + 1, to + 1);
+        } else {
+            uint64_t weight = 0;
+            if (random_unit() >= options.zero_weight_probability) {
+                weight = 1 + random_below(options.max_weight);
+            }
+            write_weighted_pair(&writer, from + 1, to + 1, weight);
+        }
+
+        if (e < options.queries) {
+            sources[e] = from + 1;
+            targets[e] = to + 1;
+        } else if (options.queries > 0) {
+            uint64_t slot = random_below(e + 1);
+            if (slot < options.queries) sources[slot] = from + 1;
+            slot = random_below(e + 1);
+            if (slot < options.queries) targets[slot] = to + 1;
+        }
+
+        if ((e + 1) % report_every == 0) {
+            printf("  %lu%%\n", (e + 1) * 100 / options.edges);
+            fflush(stdout);
+        }
+    }
+
+    if (!finish_writer(&writer) || fclose(matrix) != 0) {
+        printf("Failed writing %s.\n", options.matrix_path);
+        return 1;
+    }
+
+    // Pair sources with targets of other edges.
+    //
+    size_t query_count = options.queries < options.edges ? options.queries : options.edges;
+    for (size_t q = 0; q < query_count; q++) {
+        fprintf(nodes, "%lu %lu\n", sources[q], targets[(q + 1) % query_count]);
+    }
+    fclose(nodes);
+
+    printf("Wrote %s and %ld queries to %s\n", options.matrix_path, query_count, options.nodes_path);
+    free(sources);
+    free(targets);
+    return 0;
+}
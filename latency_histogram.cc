@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "latency_histogram.h"
+
+// Values below LATENCY_SUB_BUCKETS map to themselves. Larger values
+// are shifted right until only their top LATENCY_SUB_BUCKET_BITS
+// bits remain, which lie in [SUB_BUCKETS / 2, SUB_BUCKETS). Each
+// shift count owns SUB_BUCKETS / 2 slots after the exact range.
+//
+static inline size_t slot_of(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    if (value > LATENCY_HISTOGRAM_MAX) {
+        return LATENCY_HISTOGRAM_SLOTS - 1;
+    }
+    unsigned int top   = 63 - __builtin_clzll(value);
+    unsigned int shift = top - (LATENCY_SUB_BUCKET_BITS - 1);
+    return LATENCY_SUB_BUCKETS + (shift - 1) * (LATENCY_SUB_BUCKETS / 2) +
+           (size_t)((value >> shift) - LATENCY_SUB_BUCKETS / 2);
+}
+
+// Largest value that maps to slot.
+//
+static inline uint64_t slot_upper_bound(size_t slot) {
+    if (slot < LATENCY_SUB_BUCKETS) {
+        return slot;
+    }
+    size_t above       = slot - LATENCY_SUB_BUCKETS;
+    unsigned int shift = above / (LATENCY_SUB_BUCKETS / 2) + 1;
+    uint64_t sub       = above % (LATENCY_SUB_BUCKETS / 2) + LATENCY_SUB_BUCKETS / 2;
+    return ((sub + 1) << shift) - 1;
+}
+
+void init_latency_histogram(struct latency_histogram * histogram) {
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    histogram->total = 0;
+    histogram->min   = UINT64_MAX;
+    histogram->max   = 0;
+    histogram->sum   = 0.0;
+}
+
+void record_latency(struct latency_histogram * histogram, long nanoseconds) {
+    uint64_t value = nanoseconds < 0 ? 0 : (uint64_t)nanoseconds;
+    ++histogram->counts[slot_of(value)];
+    ++histogram->total;
+    histogram->sum += (double)value;
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+void merge_latency_histogram(struct latency_histogram * into,
+                             const struct latency_histogram * from) {
+    for (size_t slot = 0; slot < LATENCY_HISTOGRAM_SLOTS; slot++) {
+        into->counts[slot] += from->counts[slot];
+    }
+    into->total += from->total;
+    into->sum   += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t latency_at_percentile(const struct latency_histogram * histogram,
+                               double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    // Rank of the value wanted, 1-based, at least the first.
+    //
+    uint64_t rank = (uint64_t)((percentile / 100.0) * (double)histogram->total + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > histogram->total) rank = histogram->total;
+
+    uint64_t seen = 0;
+    for (size_t slot = 0; slot < LATENCY_HISTOGRAM_SLOTS; slot++) {
+        seen += histogram->counts[slot];
+        if (seen >= rank) {
+            uint64_t value = slot_upper_bound(slot);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+double mean_latency(const struct latency_histogram * histogram) {
+    return histogram->total == 0 ? 0.0 : histogram->sum / (double)histogram->total;
+}
+
+void write_latency_json(FILE * file, const struct latency_histogram * histogram) {
+    fprintf(file, "\"count\": %lu, \"min_ns\": %lu, \"mean_ns\": %0.1f, "
+                  "\"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, "
+                  "\"p999_ns\": %lu, \"max_ns\": %lu",
+            histogram->total, histogram->total == 0 ? 0 : histogram->min,
+            mean_latency(histogram),
+            latency_at_percentile(histogram, 50.0),
+            latency_at_percentile(histogram, 90.0),
+            latency_at_percentile(histogram, 99.0),
+            latency_at_percentile(histogram, 99.9),
+            histogram->max);
+}
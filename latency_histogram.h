@@ -0,0 +1,55 @@
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// An HDR style histogram of latencies in nanoseconds.
+//
+// Values below 2^LATENCY_SUB_BUCKET_BITS are counted exactly. Above
+// that every power of two range is split into 2^(BITS - 1) linear
+// sub-buckets, so any recorded value is reported to within 1/128,
+// under 1%, from 1 ns up to LATENCY_HISTOGRAM_MAX (about 78 hours).
+// Recording is a couple of shifts and an increment, and the memory
+// use is fixed no matter how many values are recorded.
+//
+#define LATENCY_SUB_BUCKET_BITS 8
+#define LATENCY_SUB_BUCKETS     (1U << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAGNITUDES      41
+#define LATENCY_HISTOGRAM_SLOTS (LATENCY_SUB_BUCKETS + LATENCY_MAGNITUDES * (LATENCY_SUB_BUCKETS / 2))
+#define LATENCY_HISTOGRAM_MAX   ((1ULL << (LATENCY_SUB_BUCKET_BITS + LATENCY_MAGNITUDES)) - 1)
+
+struct latency_histogram {
+    uint64_t counts[LATENCY_HISTOGRAM_SLOTS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+};
+
+void init_latency_histogram(struct latency_histogram * histogram);
+
+// Negative values count as 0, values past LATENCY_HISTOGRAM_MAX
+// land in the last slot but still update max exactly.
+//
+void record_latency(struct latency_histogram * histogram, long nanoseconds);
+
+void merge_latency_histogram(struct latency_histogram * into,
+                             const struct latency_histogram * from);
+
+// The smallest recorded value such that at least percentile percent
+// of the values are less than or equal to it, reported as the top of
+// its slot but never more than max. Returns 0 for an empty histogram.
+//
+uint64_t latency_at_percentile(const struct latency_histogram * histogram,
+                               double percentile);
+
+double mean_latency(const struct latency_histogram * histogram);
+
+// Writes count, min, mean, p50, p90, p99, p99.9 and max as the
+// members of a JSON object, without the braces.
+//
+void write_latency_json(FILE * file, const struct latency_histogram * histogram);
+
+#endif
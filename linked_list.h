@@ -14,6 +14,20 @@
 // 3. The malloc_fptr and free_fptr functions are used to allocate
 //    memory. Make use of these in your new and delete operators.
 
+// Nodes kept inside every list object, used before any are
+// allocated. Most lists and queues are short lived and hold only a
+// handful of elements, which then cost no allocation at all. Build
+// with e.g. -DLINKED_LIST_INLINE_NODES=16 to change it.
+//
+#ifndef LINKED_LIST_INLINE_NODES
+#define LINKED_LIST_INLINE_NODES 4
+#endif
+
+// The most nodes assign() and the bulk constructors put in one block,
+// 16 MiB worth.
+//
+#define LINKED_LIST_BLOCK_NODES (1UL << 20)
+
 // Declaration of the linked_list class.
 // Feel free to add additional members as needed, but do not
 // remove or delete any.
@@ -24,6 +38,13 @@ class linked_list{
     // Constructor. Set head to null.
     //
     linked_list();
+
+    // Bulk constructors: the list holds the count elements of data,
+    // or count copies of value. All of their nodes come from one
+    // allocation, see assign(). The list is empty if that fails.
+    //
+    linked_list(const unsigned int * data, size_t count);
+    linked_list(size_t count, unsigned int value);
     
     // Destructor.
     // Frees all nodes that are present in the linked list.
@@ -57,13 +78,73 @@ class linked_list{
     //
     size_t size() const;
 
+    // Sorts the list in ascending order with a bottom-up merge sort
+    // that only relinks nodes, allocating nothing. Stable.
+    //
+    void sort();
+
+    // Removes all but the first of every run of equal elements, as
+    // std::list::unique() does, and returns how many were removed.
+    // On a sorted list that leaves each value once.
+    //
+    size_t unique();
+
+    // Merges the sorted list other into this sorted list, leaving
+    // other empty. Nodes are moved over rather than copied, except
+    // for other's inline nodes, which are copied into nodes of this
+    // list. Returns FALSE, leaving both lists unchanged, if that
+    // copy fails to allocate.
+    //
+    bool merge(linked_list&& other);
+
+    // Replaces the contents with the count elements of data. The
+    // nodes are allocated together, in blocks of up to
+    // LINKED_LIST_BLOCK_NODES, and linked in address order, so a
+    // traversal reads memory sequentially. A block is freed once the
+    // last of its nodes is, whether by remove() or by destroying the
+    // list. Returns FALSE, leaving the list empty, on allocation
+    // failure.
+    //
+    bool assign(const unsigned int * data, size_t count);
+
+    // Node recycling. Removed nodes are kept on a spare list, up to
+    // the spare limit, and reused by later inserts instead of going
+    // back through free_fptr and malloc_fptr. The limit is 0 unless
+    // set, so by default remove() frees immediately.
+    //
+    // The LINKED_LIST_INLINE_NODES inline nodes are never freed, so
+    // they always count as spares when unused, whatever the limit.
+    //
+    // reserve() makes sure that size() + spare nodes is at least
+    // capacity, allocating the difference up front, and raises the
+    // spare limit to fit. Returns FALSE on allocation failure.
+    // shrink_to_fit() frees every allocated spare node. Lowering the
+    // limit frees the allocated spares above it.
+    //
+    bool reserve(size_t capacity);
+    void shrink_to_fit();
+    void set_spare_limit(size_t limit);
+    size_t capacity() const;
+
     // Inner classes node and iterator.
     //
+    // block_index is 0 for a node allocated on its own, and the
+    // 1-based position of the node in its block otherwise. It takes
+    // the padding after data, so a node is still 16 bytes.
+    //
     struct node {
       void * operator new(size_t);
       void operator delete(void*);
       node * next;
       unsigned int data;
+      unsigned int block_index;
+    };
+
+    // Precedes the nodes of a block. live counts the nodes that have
+    // not been freed yet.
+    //
+    struct node_block {
+      size_t live;
     };
 
     // Operator overloads for access to an individual
@@ -91,9 +172,37 @@ class linked_list{
     //
     node * head;
 
+    // The tail of the linked list. Keeps insert_end() constant
+    // time, which is what a queue spends nearly all of its time
+    // doing.
+    //
+    node * tail;
+
     // If you hate this name, feel free to change it.
     //
     size_t ll_size;
+
+    // Recycled nodes, linked through next.
+    //
+    node * spare;
+    size_t spare_count;
+    size_t spare_limit;
+
+    // Handed out first, see LINKED_LIST_INLINE_NODES.
+    //
+    node inline_nodes[LINKED_LIST_INLINE_NODES];
+
+    node * acquire_node(unsigned int data);
+    void release_node(node * released);
+    bool is_inline(const node * candidate) const;
+    void free_spares(size_t limit);
+    void free_node(node * freed);
+    void free_list();
+    bool append_block(const unsigned int * data, unsigned int value, size_t count);
 };
 
+#ifdef QUEUE_HEADER_ONLY
+#include "linked_list_impl.h"
+#endif
+
 #endif
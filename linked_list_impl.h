@@ -0,0 +1,563 @@
+#ifndef LINKED_LIST_IMPL_H_
+#define LINKED_LIST_IMPL_H_
+
+// The definitions of the linked_list members. linked_list.cc builds
+// them out of line into liblinked_list.so and libqueue.so. Building
+// with QUEUE_HEADER_ONLY defined makes linked_list.h include them as
+// inline functions instead, so that the compiler can inline push()
+// and pop() all the way into the caller's loop rather than calling
+// through the PLT, see 'make queue_performance_inlined'.
+//
+
+#include "linked_list.h"
+
+#ifndef LINKED_LIST_INLINE
+#define LINKED_LIST_INLINE inline
+#endif
+
+// Initial declaration of the static member function
+// pointers in the linked_list class.
+//
+LINKED_LIST_INLINE void * (*linked_list::malloc_fptr)(size_t) = nullptr;
+LINKED_LIST_INLINE void (*linked_list::free_fptr)(void*)      = nullptr;
+
+// These static member functions are provided for you. 
+// You still need to implement the new() and delete()
+// operators.
+//
+LINKED_LIST_INLINE void
+linked_list::register_malloc(void *(*malloc)(size_t)) {
+    linked_list::malloc_fptr = malloc;
+}
+
+LINKED_LIST_INLINE void
+linked_list::register_free(void (*free)(void*)) {
+    linked_list::free_fptr = free;
+}
+
+LINKED_LIST_INLINE linked_list::linked_list()
+    : head(nullptr), tail(nullptr), ll_size(0),
+      spare(nullptr), spare_count(0), spare_limit(0) {
+    for (size_t i = 0; i < LINKED_LIST_INLINE_NODES; i++) {
+        inline_nodes[i].next        = spare;
+        inline_nodes[i].block_index = 0;
+        spare                       = &inline_nodes[i];
+        ++spare_count;
+    }
+}
+
+LINKED_LIST_INLINE linked_list::linked_list(const unsigned int * data, size_t count)
+    : linked_list() {
+    assign(data, count);
+}
+
+LINKED_LIST_INLINE linked_list::linked_list(size_t count, unsigned int value)
+    : linked_list() {
+    append_block(nullptr, value, count);
+}
+
+LINKED_LIST_INLINE linked_list::~linked_list() {
+    free_list();
+    shrink_to_fit();
+}
+
+// Hands a node that is not inline back to the allocator, or to its
+// block, which goes back once its last node does.
+//
+LINKED_LIST_INLINE void
+linked_list::free_node(node * freed) {
+    if (freed->block_index == 0) {
+        delete freed;
+        return;
+    }
+    node_block * block = reinterpret_cast<node_block*>(
+        reinterpret_cast<char*>(freed - (freed->block_index - 1)) - sizeof(node_block));
+    if (--block->live == 0) {
+        linked_list::free_fptr(block);
+    }
+}
+
+// Frees every node in the list, leaving it empty. The spares stay.
+//
+LINKED_LIST_INLINE void
+linked_list::free_list() {
+    node * current = head;
+    while (current != nullptr) {
+        node * next = current->next;
+        if (is_inline(current)) {
+            current->next = spare;
+            spare         = current;
+            ++spare_count;
+        } else {
+            free_node(current);
+        }
+        current = next;
+    }
+    head    = nullptr;
+    tail    = nullptr;
+    ll_size = 0;
+}
+
+// Appends count nodes holding data, or value where data is nullptr,
+// allocated in blocks and linked in address order. On failure the
+// nodes appended so far are freed again.
+//
+LINKED_LIST_INLINE bool
+linked_list::append_block(const unsigned int * data, unsigned int value, size_t count) {
+    node * first = nullptr;
+    node * last  = nullptr;
+    size_t done  = 0;
+    while (done < count) {
+        size_t nodes       = count - done < LINKED_LIST_BLOCK_NODES ? count - done : LINKED_LIST_BLOCK_NODES;
+        node_block * block = static_cast<node_block*>(
+            linked_list::malloc_fptr(sizeof(node_block) + nodes * sizeof(node)));
+        if (block == nullptr) {
+            while (first != nullptr) {
+                node * next = first->next;
+                free_node(first);
+                first = next;
+            }
+            return false;
+        }
+        block->live        = nodes;
+        node * nodes_start = reinterpret_cast<node*>(block + 1);
+        for (size_t i = 0; i < nodes; i++) {
+            node * current       = &nodes_start[i];
+            current->data        = data != nullptr ? data[done + i] : value;
+            current->block_index = static_cast<unsigned int>(i + 1);
+            current->next        = i + 1 < nodes ? current + 1 : nullptr;
+        }
+        if (last == nullptr) {
+            first = nodes_start;
+        } else {
+            last->next = nodes_start;
+        }
+        last  = &nodes_start[nodes - 1];
+        done += nodes;
+    }
+
+    if (first == nullptr) {
+        return true;
+    }
+    if (tail == nullptr) {
+        head = first;
+    } else {
+        tail->next = first;
+    }
+    tail     = last;
+    ll_size += count;
+    return true;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::assign(const unsigned int * data, size_t count) {
+    free_list();
+    return append_block(data, 0, count);
+}
+
+LINKED_LIST_INLINE bool
+linked_list::is_inline(const node * candidate) const {
+    return candidate >= inline_nodes && candidate < inline_nodes + LINKED_LIST_INLINE_NODES;
+}
+
+LINKED_LIST_INLINE void *
+linked_list::operator new(size_t size) {
+    return linked_list::malloc_fptr(size);
+}
+
+LINKED_LIST_INLINE void
+linked_list::operator delete(void * ptr) {
+    linked_list::free_fptr(ptr);
+}
+
+LINKED_LIST_INLINE void *
+linked_list::node::operator new(size_t size) {
+    return linked_list::malloc_fptr(size);
+}
+
+LINKED_LIST_INLINE void
+linked_list::node::operator delete(void * ptr) {
+    linked_list::free_fptr(ptr);
+}
+
+// Allocates a node through the registered allocator. Calls
+// malloc_fptr directly rather than node::operator new(), as the
+// compiler assumes that any operator new that is not noexcept never
+// yields NULL, even when called as a function, and drops the check.
+//
+LINKED_LIST_INLINE linked_list::node *
+linked_list_allocate_node(unsigned int data) {
+    linked_list::node * new_node = static_cast<linked_list::node*>(
+        linked_list::malloc_fptr(sizeof(linked_list::node)));
+    if (new_node == nullptr) {
+        return nullptr;
+    }
+    new_node->next        = nullptr;
+    new_node->data        = data;
+    new_node->block_index = 0;
+    return new_node;
+}
+
+// Takes a spare node if there is one, allocates otherwise.
+//
+LINKED_LIST_INLINE linked_list::node *
+linked_list::acquire_node(unsigned int data) {
+    if (spare == nullptr) {
+        return linked_list_allocate_node(data);
+    }
+    node * recycled = spare;
+    spare           = spare->next;
+    --spare_count;
+    recycled->next = nullptr;
+    recycled->data = data;
+    return recycled;
+}
+
+LINKED_LIST_INLINE void
+linked_list::release_node(node * released) {
+    if (spare_count >= spare_limit && !is_inline(released)) {
+        free_node(released);
+        return;
+    }
+    released->next = spare;
+    spare          = released;
+    ++spare_count;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::reserve(size_t capacity) {
+    if (capacity <= ll_size + spare_count) {
+        return true;
+    }
+    if (spare_limit < capacity - ll_size) {
+        spare_limit = capacity - ll_size;
+    }
+    while (ll_size + spare_count < capacity) {
+        node * reserved = linked_list_allocate_node(0);
+        if (reserved == nullptr) {
+            return false;
+        }
+        reserved->next = spare;
+        spare          = reserved;
+        ++spare_count;
+    }
+    return true;
+}
+
+// Frees allocated spares until at most limit spares are left, or
+// only inline ones.
+//
+LINKED_LIST_INLINE void
+linked_list::free_spares(size_t limit) {
+    node ** link = &spare;
+    while (*link != nullptr && spare_count > limit) {
+        node * current = *link;
+        if (is_inline(current)) {
+            link = &current->next;
+            continue;
+        }
+        *link = current->next;
+        free_node(current);
+        --spare_count;
+    }
+}
+
+LINKED_LIST_INLINE void
+linked_list::shrink_to_fit() {
+    free_spares(0);
+}
+
+LINKED_LIST_INLINE void
+linked_list::set_spare_limit(size_t limit) {
+    spare_limit = limit;
+    free_spares(spare_limit);
+}
+
+LINKED_LIST_INLINE size_t
+linked_list::capacity() const {
+    return ll_size + spare_count;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::insert(size_t index, unsigned int data) {
+    if (index > ll_size) {
+        return false;
+    }
+
+    if (index == 0) {
+        return insert_front(data);
+    }
+
+    if (index == ll_size) {
+        return insert_end(data);
+    }
+
+    node * new_node = acquire_node(data);
+    if (new_node == nullptr) {
+        return false;
+    }
+
+    node * prev = head;
+    for (size_t i = 1; i < index; i++) {
+        prev = prev->next;
+    }
+    new_node->next = prev->next;
+    prev->next     = new_node;
+    ++ll_size;
+    return true;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::insert_front(unsigned int data) {
+    node * new_node = acquire_node(data);
+    if (new_node == nullptr) {
+        return false;
+    }
+
+    new_node->next = head;
+    head           = new_node;
+    if (tail == nullptr) {
+        tail = new_node;
+    }
+    ++ll_size;
+    return true;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::insert_end(unsigned int data) {
+    node * new_node = acquire_node(data);
+    if (new_node == nullptr) {
+        return false;
+    }
+
+    if (tail == nullptr) {
+        head = new_node;
+    } else {
+        tail->next = new_node;
+    }
+    tail = new_node;
+    ++ll_size;
+    return true;
+}
+
+LINKED_LIST_INLINE size_t
+linked_list::find(unsigned int data) const {
+    size_t index = 0;
+    for (node * current = head; current != nullptr; current = current->next) {
+        if (current->data == data) {
+            return index;
+        }
+        ++index;
+    }
+    return SIZE_MAX;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::remove(size_t index) {
+    if (index >= ll_size) {
+        return false;
+    }
+
+    node * removed;
+    if (index == 0) {
+        removed = head;
+        head    = head->next;
+        if (head == nullptr) {
+            tail = nullptr;
+        }
+    } else {
+        // Walk to the node before the one being removed, so
+        // the tail can be fixed up without a prev pointer.
+        //
+        node * prev = head;
+        for (size_t i = 1; i < index; i++) {
+            prev = prev->next;
+        }
+        removed    = prev->next;
+        prev->next = removed->next;
+        if (removed == tail) {
+            tail = prev;
+        }
+    }
+
+    release_node(removed);
+    --ll_size;
+    return true;
+}
+
+LINKED_LIST_INLINE size_t
+linked_list::size() const {
+    return ll_size;
+}
+
+// Merges two sorted, nullptr terminated runs and returns the head of
+// the result. Ties go to first, which keeps the sort stable.
+//
+LINKED_LIST_INLINE linked_list::node *
+linked_list_merge_runs(linked_list::node * first, linked_list::node * second) {
+    linked_list::node merged;
+    linked_list::node * last = &merged;
+    while (first != nullptr && second != nullptr) {
+        if (second->data < first->data) {
+            last->next = second;
+            second     = second->next;
+        } else {
+            last->next = first;
+            first      = first->next;
+        }
+        last = last->next;
+    }
+    last->next = first != nullptr ? first : second;
+    return merged.next;
+}
+
+// Bottom-up: nodes are taken off the list one at a time and carried
+// up through runs[], where runs[i] is nullptr or a sorted run of 2^i
+// nodes, like the carry in a binary counter. 64 levels cover any
+// list that fits in memory.
+//
+LINKED_LIST_INLINE void
+linked_list::sort() {
+    if (ll_size < 2) {
+        return;
+    }
+
+    node * runs[64] = {};
+    size_t levels   = 0;
+    node * current  = head;
+    while (current != nullptr) {
+        node * carry = current;
+        current      = current->next;
+        carry->next  = nullptr;
+
+        size_t level = 0;
+        while (level < levels && runs[level] != nullptr) {
+            carry       = linked_list_merge_runs(runs[level], carry);
+            runs[level] = nullptr;
+            ++level;
+        }
+        runs[level] = carry;
+        if (level == levels) {
+            ++levels;
+        }
+    }
+
+    node * sorted = nullptr;
+    for (size_t level = 0; level < levels; level++) {
+        if (runs[level] != nullptr) {
+            sorted = linked_list_merge_runs(runs[level], sorted);
+        }
+    }
+
+    head = sorted;
+    tail = sorted;
+    while (tail->next != nullptr) {
+        tail = tail->next;
+    }
+}
+
+LINKED_LIST_INLINE size_t
+linked_list::unique() {
+    size_t removed = 0;
+    node * current = head;
+    while (current != nullptr && current->next != nullptr) {
+        node * next = current->next;
+        if (next->data == current->data) {
+            current->next = next->next;
+            release_node(next);
+            ++removed;
+        } else {
+            current = next;
+        }
+    }
+    tail     = current;
+    ll_size -= removed;
+    return removed;
+}
+
+LINKED_LIST_INLINE bool
+linked_list::merge(linked_list&& other) {
+    if (&other == this || other.ll_size == 0) {
+        return true;
+    }
+
+    // Swap other's inline nodes for nodes of this list first, so a
+    // failed allocation leaves both lists as they were.
+    //
+    node * replacements = nullptr;
+    for (node * current = other.head; current != nullptr; current = current->next) {
+        if (!other.is_inline(current)) {
+            continue;
+        }
+        node * replacement = acquire_node(current->data);
+        if (replacement == nullptr) {
+            while (replacements != nullptr) {
+                node * next = replacements->next;
+                release_node(replacements);
+                replacements = next;
+            }
+            return false;
+        }
+        replacement->next = replacements;
+        replacements      = replacement;
+    }
+
+    // The replacements are in reverse order of the inline nodes they
+    // stand in for, so reverse them back while splicing them in.
+    //
+    node * reversed = nullptr;
+    while (replacements != nullptr) {
+        node * next        = replacements->next;
+        replacements->next = reversed;
+        reversed           = replacements;
+        replacements       = next;
+    }
+    node ** link      = &other.head;
+    node * other_tail = nullptr;
+    while (*link != nullptr) {
+        node * current = *link;
+        if (other.is_inline(current)) {
+            node * replacement = reversed;
+            reversed           = reversed->next;
+            replacement->next  = current->next;
+            *link              = replacement;
+            other.release_node(current);
+        }
+        other_tail = *link;
+        link       = &(*link)->next;
+    }
+
+    // Ties go to this list, so other's last node ends up last unless
+    // this list's last is bigger.
+    //
+    if (tail == nullptr || !(other_tail->data < tail->data)) {
+        tail = other_tail;
+    }
+    head     = linked_list_merge_runs(head, other.head);
+    ll_size += other.ll_size;
+
+    other.head    = nullptr;
+    other.tail    = nullptr;
+    other.ll_size = 0;
+    return true;
+}
+
+LINKED_LIST_INLINE unsigned int&
+linked_list::operator[](size_t idx) {
+    node * current = head;
+    for (size_t i = 0; i < idx; i++) {
+        current = current->next;
+    }
+    return current->data;
+}
+
+LINKED_LIST_INLINE const unsigned int&
+linked_list::operator[](size_t idx) const {
+    node * current = head;
+    for (size_t i = 0; i < idx; i++) {
+        current = current->next;
+    }
+    return current->data;
+}
+
+#endif
@@ -4,8 +4,12 @@
 #include <signal.h>
 #include <unistd.h>
 
+#include "compact_list.h"
+#include "deque.h"
 #include "linked_list.h"
+#include "monotone_queue.h"
 #include "queue.h"
+#include "spill_store.h"
 
 #define TEST(x) printf("Running test " #x "\n"); fflush(stdout);
 #define SUBTEST(x) printf("    Executing subtest " #x "\n"); fflush(stdout); \
@@ -19,6 +23,8 @@
 
 bool instrumented_malloc_fail_next             = false;
 bool instrumented_malloc_last_alloc_successful = false;
+size_t instrumented_malloc_calls                = 0;
+size_t instrumented_free_calls                  = 0;
 
 void gracefully_exit_on_suspected_infinite_loop(int signal_number) {
     // Use write() to tell the tester that they're probably stuck
@@ -57,10 +63,18 @@ void * instrumented_malloc(size_t size) {
 
     void * ptr = malloc(size);
     instrumented_malloc_last_alloc_successful = (ptr != NULL);
+    ++instrumented_malloc_calls;
 
     return ptr;
 }
 
+// A wrapper around free() that counts calls.
+//
+void instrumented_free(void * ptr) {
+    ++instrumented_free_calls;
+    free(ptr);
+}
+
 void check_empty_list_properties() {
     TEST(check_empty_list_properties)
     SUBTEST(linked_list_create)
@@ -326,6 +340,556 @@ void check_find_functionality(void) {
     PASS(check_find_functionality)
 }
 
+void check_node_recycling(void) {
+    TEST(check_node_recycling)
+
+    // A queue is one allocation, and its first elements live in it.
+    //
+    SUBTEST(inline_nodes)
+    size_t malloc_calls = instrumented_malloc_calls;
+    queue * q = new queue();
+    for (unsigned int i = 0; i < LINKED_LIST_INLINE_NODES; i++) {
+        q->push(i);
+    }
+    FAIL(instrumented_malloc_calls != malloc_calls + 1,
+         "Short queue allocated more than the queue object")
+    for (unsigned int i = 0; i < LINKED_LIST_INLINE_NODES; i++) {
+        unsigned int value = 0;
+        FAIL(!q->pop(&value) || value != i,
+             "queue::pop() popped data is not correct")
+    }
+
+    SUBTEST(queue_reserve)
+    FAIL(!q->reserve(8),
+         "queue::reserve() did not return TRUE")
+    FAIL(q->capacity() < 8,
+         "queue::capacity() is less than reserved")
+    FAIL(q->size() != 0,
+         "queue::reserve() changed the size")
+
+    // Steady state push and pop within the reserved capacity.
+    //
+    SUBTEST(steady_state_without_allocation)
+    malloc_calls        = instrumented_malloc_calls;
+    size_t free_calls   = instrumented_free_calls;
+    for (unsigned int i = 0; i < 1000; i++) {
+        for (unsigned int j = 0; j < 8; j++) {
+            q->push(i + j);
+        }
+        for (unsigned int j = 0; j < 8; j++) {
+            unsigned int value = 0;
+            bool status        = q->pop(&value);
+            FAIL(status != true || value != i + j,
+                 "queue::pop() popped data is not correct")
+        }
+    }
+    FAIL(instrumented_malloc_calls != malloc_calls,
+         "Steady state push() called malloc")
+    FAIL(instrumented_free_calls != free_calls,
+         "Steady state pop() called free")
+
+#ifndef QUEUE_COMPACT_LIST
+    // Growing past the reservation allocates, and the popped nodes
+    // stay cached.
+    //
+    SUBTEST(cache_grows_with_queue)
+    for (unsigned int i = 0; i < 20; i++) {
+        q->push(i);
+    }
+    FAIL(instrumented_malloc_calls != malloc_calls + 12,
+         "push() beyond capacity did not allocate one node each")
+    for (unsigned int i = 0; i < 20; i++) {
+        unsigned int value = 0;
+        q->pop(&value);
+    }
+    FAIL(q->capacity() != 20,
+         "queue::capacity() does not count cached nodes")
+
+    SUBTEST(node_cache_limit)
+    free_calls = instrumented_free_calls;
+    q->set_node_cache_limit(4);
+    FAIL(q->capacity() != 4,
+         "queue::set_node_cache_limit() did not trim the cache")
+    FAIL(instrumented_free_calls != free_calls + 16,
+         "queue::set_node_cache_limit() did not free trimmed nodes")
+
+    // Only the inline nodes are left once the allocated ones are
+    // popped and freed.
+    //
+    SUBTEST(shrink_to_fit)
+    for (unsigned int i = 0; i < 10; i++) {
+        q->push(i);
+    }
+    for (unsigned int i = 0; i < 10; i++) {
+        unsigned int value = 0;
+        q->pop(&value);
+    }
+    q->shrink_to_fit();
+    FAIL(q->capacity() != LINKED_LIST_INLINE_NODES,
+         "queue::shrink_to_fit() kept allocated nodes")
+    FAIL(q->has_next(),
+         "queue::shrink_to_fit() changed the size")
+#endif
+
+    delete q;
+    PASS(check_node_recycling)
+}
+
+// TRUE if ll is in ascending order, and its size and tail agree
+// with its contents. The tail is checked by appending through it.
+//
+static bool sorted_and_consistent(linked_list * ll, size_t expected_size) {
+    if (ll->size() != expected_size) {
+        return false;
+    }
+    for (size_t i = 1; i < expected_size; i++) {
+        if ((*ll)[i - 1] > (*ll)[i]) {
+            return false;
+        }
+    }
+    if (!ll->insert_end(UINT32_MAX) || (*ll)[expected_size] != UINT32_MAX) {
+        return false;
+    }
+    return ll->remove(expected_size);
+}
+
+void check_sort_and_merge(void) {
+    TEST(check_sort_and_merge)
+
+    SUBTEST(sort)
+    linked_list * ll = new linked_list();
+    unsigned int value = 12345;
+    size_t sum         = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        value = value * 1103515245 + 12345;
+        ll->insert_end(value % 100);
+        sum += value % 100;
+    }
+    ll->sort();
+    FAIL(!sorted_and_consistent(ll, 1000),
+         "linked_list::sort() did not sort")
+    size_t sorted_sum = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        sorted_sum += (*ll)[i];
+    }
+    FAIL(sorted_sum != sum,
+         "linked_list::sort() lost or changed elements")
+
+    SUBTEST(unique)
+    size_t removed = ll->unique();
+    FAIL(removed != 1000 - ll->size() || ll->size() > 100,
+         "linked_list::unique() count is wrong")
+    for (size_t i = 1; i < ll->size(); i++) {
+        FAIL((*ll)[i - 1] == (*ll)[i],
+             "linked_list::unique() left a duplicate")
+    }
+    FAIL(!sorted_and_consistent(ll, ll->size()),
+         "linked_list::unique() broke the list")
+
+    // other is short enough to be all inline nodes.
+    //
+    SUBTEST(merge)
+    size_t size       = ll->size();
+    linked_list other;
+    other.insert_end(0);
+    other.insert_end(50);
+    other.insert_end(1000);
+    FAIL(!ll->merge(static_cast<linked_list&&>(other)),
+         "linked_list::merge() failed")
+    FAIL(other.size() != 0 || other.find(50) != SIZE_MAX,
+         "linked_list::merge() did not empty other")
+    FAIL(!sorted_and_consistent(ll, size + 3),
+         "linked_list::merge() result is not sorted")
+    FAIL((*ll)[size + 2] != 1000,
+         "linked_list::merge() tail is wrong")
+    other.insert_end(7);
+    FAIL(other.size() != 1 || other[0] != 7,
+         "other is not usable after linked_list::merge()")
+
+    SUBTEST(merge_allocation_failure)
+    size = ll->size();
+    instrumented_malloc_fail_next = true;
+    FAIL(ll->merge(static_cast<linked_list&&>(other)),
+         "linked_list::merge() succeeded without memory")
+    FAIL(ll->size() != size || other.size() != 1 || other[0] != 7,
+         "linked_list::merge() changed the lists on failure")
+
+    delete ll;
+    PASS(check_sort_and_merge)
+}
+
+void check_bulk_construction(void) {
+    TEST(check_bulk_construction)
+    unsigned int data[100];
+    for (unsigned int i = 0; i < 100; i++) {
+        data[i] = i * 3;
+    }
+
+    // One allocation for the nodes, laid out in order.
+    //
+    SUBTEST(array_constructor)
+    size_t malloc_calls = instrumented_malloc_calls;
+    linked_list * ll    = new linked_list(data, 100);
+    FAIL(instrumented_malloc_calls != malloc_calls + 2,
+         "Bulk constructor did not allocate its nodes in one block")
+    FAIL(ll->size() != 100 || (*ll)[0] != 0 || (*ll)[99] != 297 || ll->find(150) != 50,
+         "Bulk constructor stored the wrong elements")
+    FAIL(!ll->insert_end(1) || (*ll)[100] != 1 || !ll->remove(100),
+         "Bulk constructor left the tail wrong")
+
+    // The block goes back when the last of its nodes does, in
+    // whatever order they are removed.
+    //
+    SUBTEST(remove_one_by_one)
+    size_t free_calls = instrumented_free_calls;
+    while (ll->size() > 1) {
+        ll->remove(ll->size() % 2 == 0 ? 0 : ll->size() - 1);
+    }
+    FAIL(instrumented_free_calls != free_calls,
+         "Block freed while some of its nodes are in use")
+    ll->remove(0);
+    FAIL(instrumented_free_calls != free_calls + 1,
+         "Block not freed once all of its nodes were removed")
+
+    SUBTEST(assign)
+    ll->insert_end(7);
+    FAIL(!ll->assign(data, 10) || ll->size() != 10 || (*ll)[9] != 27,
+         "linked_list::assign() stored the wrong elements")
+    FAIL(!ll->assign(data + 50, 3) || ll->size() != 3 || (*ll)[0] != 150,
+         "linked_list::assign() did not replace the contents")
+
+    SUBTEST(assign_allocation_failure)
+    instrumented_malloc_fail_next = true;
+    FAIL(ll->assign(data, 10) || ll->size() != 0,
+         "linked_list::assign() without memory did not leave the list empty")
+
+    // Every block, and the list itself, is freed.
+    //
+    SUBTEST(destroy_with_blocks)
+    malloc_calls = instrumented_malloc_calls;
+    free_calls   = instrumented_free_calls;
+    ll->assign(data, 100);
+    ll->remove(10);
+    delete ll;
+    FAIL(instrumented_malloc_calls - malloc_calls + 1 != instrumented_free_calls - free_calls,
+         "Destroying a list leaked or double freed blocks")
+
+    SUBTEST(fill_constructor)
+    linked_list filled(5, 9);
+    FAIL(filled.size() != 5 || filled[0] != 9 || filled[4] != 9,
+         "Fill constructor stored the wrong elements")
+
+    PASS(check_bulk_construction)
+}
+
+void check_compact_list_functionality(void) {
+    TEST(check_compact_list_functionality)
+
+    SUBTEST(node_size)
+    FAIL(sizeof(compact_list::node) != 8,
+         "compact_list::node is not 8 bytes")
+
+    // Enough elements to grow the pool several times.
+    //
+    SUBTEST(insert_and_index)
+    compact_list * cl = new compact_list();
+    for (unsigned int i = 0; i < 100; i++) {
+        FAIL(!cl->insert_end(i + 1),
+             "compact_list::insert_end() failed")
+    }
+    FAIL(!cl->insert_front(0) || !cl->insert(50, 1000),
+         "compact_list::insert_front() or insert() failed")
+    FAIL(cl->size() != 102,
+         "compact_list::size() is not 102")
+    FAIL((*cl)[0] != 0 || (*cl)[49] != 49 || (*cl)[50] != 1000 ||
+         (*cl)[51] != 50 || (*cl)[101] != 100,
+         "compact_list::operator[] returned the wrong data")
+    FAIL(cl->find(1000) != 50 || cl->find(100) != 101 || cl->find(101) != SIZE_MAX,
+         "compact_list::find() returned the wrong index")
+
+    // Removing most elements compacts the pool, which must keep
+    // the order.
+    //
+    SUBTEST(remove_and_compact)
+    FAIL(!cl->remove(50),
+         "compact_list::remove() failed")
+    while (cl->size() > 3) {
+        FAIL(!cl->remove(1),
+             "compact_list::remove() failed")
+    }
+    FAIL((*cl)[0] != 0 || (*cl)[1] != 99 || (*cl)[2] != 100,
+         "compact_list lost its order while compacting")
+    FAIL(cl->capacity() >= 32,
+         "compact_list did not shrink its pool")
+    FAIL(!cl->remove(2) || !cl->insert_end(7) || (*cl)[2] != 7,
+         "compact_list tail is wrong after removing the last element")
+    FAIL(cl->remove(3),
+         "compact_list::remove() out of bounds succeeded")
+
+    delete cl;
+    PASS(check_compact_list_functionality)
+}
+
+void check_queue_spilling(void) {
+    TEST(check_queue_spilling)
+    queue * q = new queue();
+
+    SUBTEST(budget_too_small)
+    FAIL(q->set_memory_budget(1024, NULL),
+         "queue::set_memory_budget() accepted a budget without room for a block")
+
+    // Far more than the budget holds, so most of it goes through the
+    // file and comes back in order.
+    //
+    SUBTEST(fifo_through_disk)
+    FAIL(!q->set_memory_budget(256 * 1024, NULL),
+         "queue::set_memory_budget() failed")
+    for (unsigned int i = 0; i < 200000; i++) {
+        FAIL(!q->push(i), "queue::push() failed with a memory budget")
+    }
+    FAIL(q->size() != 200000, "queue::size() does not count spilled elements")
+    unsigned int value = 0;
+    FAIL(!q->next(&value) || value != 0, "queue::next() did not return the oldest element")
+    for (unsigned int i = 0; i < 200000; i++) {
+        FAIL(!q->pop(&value) || value != i, "Spilled queue popped out of order")
+    }
+    FAIL(q->pop(&value) || q->size() != 0, "Spilled queue not empty after popping everything")
+    struct spill_stats stats;
+    FAIL(!q->get_spill_stats(&stats) || stats.blocks_written + stats.blocks_short_circuited == 0,
+         "Queue over its budget did not spill")
+
+    // Pushes and pops mixed, as a BFS does, with the store running
+    // empty and refilling.
+    //
+    SUBTEST(interleaved)
+    unsigned int pushed = 0;
+    unsigned int popped = 0;
+    for (int round = 0; round < 4; round++) {
+        for (int k = 0; k < 30000; k++) {
+            q->push(pushed++);
+            q->push(pushed++);
+            FAIL(!q->pop(&value) || value != popped++, "Interleaved spilled queue popped out of order")
+        }
+        while (q->size() > 1000) {
+            FAIL(!q->pop(&value) || value != popped++, "Draining spilled queue popped out of order")
+        }
+    }
+    while (q->pop(&value)) {
+        FAIL(value != popped++, "Spilled queue tail popped out of order")
+    }
+    FAIL(popped != pushed, "Spilled queue lost elements")
+
+    SUBTEST(budget_off)
+    FAIL(!q->set_memory_budget(0, NULL) || q->get_spill_stats(&stats),
+         "queue::set_memory_budget(0) did not turn spilling off")
+    delete q;
+
+    PASS(check_queue_spilling)
+}
+
+void check_deque_functionality(void) {
+    TEST(check_deque_functionality)
+    deque * dq = new deque();
+    unsigned int value = 7;
+
+    SUBTEST(empty_deque)
+    FAIL(dq->size() != 0 || dq->pop_front(&value) || dq->pop_back(&value) ||
+         dq->front(&value) || dq->back(&value) || value != 7,
+         "Empty deque popped or peeked, or modified the output")
+
+    // Mixed pushes and pops at both ends against a plain array,
+    // far enough to cross blocks and recenter the map in both
+    // directions.
+    //
+    SUBTEST(matches_reference)
+    const size_t reference_capacity = 1 << 20;
+    unsigned int * reference = (unsigned int*)malloc(reference_capacity * sizeof(unsigned int));
+    size_t first = reference_capacity / 2;
+    size_t last  = first;
+    unsigned int state = 12345;
+    for (unsigned int step = 0; step < 200000; step++) {
+        state = state * 1103515245 + 12345;
+        unsigned int op = (state >> 16) % 10;
+        // Grow towards the front for the first half and the back for
+        // the second.
+        //
+        bool towards_front = step < 100000;
+        if ((op < 4 && towards_front) || (op >= 4 && op < 6 && !towards_front)) {
+            FAIL(!dq->push_front(step), "deque::push_front() failed")
+            reference[--first] = step;
+        } else if (op < 6) {
+            FAIL(!dq->push_back(step), "deque::push_back() failed")
+            reference[last++] = step;
+        } else if (op < 8) {
+            bool popped = dq->pop_front(&value);
+            FAIL(popped != (first != last) || (popped && value != reference[first++]),
+                 "deque::pop_front() does not match the reference")
+        } else {
+            bool popped = dq->pop_back(&value);
+            FAIL(popped != (first != last) || (popped && value != reference[--last]),
+                 "deque::pop_back() does not match the reference")
+        }
+        FAIL(dq->size() != last - first, "deque::size() does not match the reference")
+    }
+    FAIL(dq->size() < 2 * DEQUE_BLOCK_ELEMENTS, "Reference walk did not fill several blocks")
+    FAIL(!dq->front(&value) || value != reference[first] ||
+         !dq->back(&value) || value != reference[last - 1],
+         "deque::front() or back() does not match the reference")
+    while (dq->pop_back(&value)) {
+        FAIL(value != reference[--last], "Draining deque popped out of order")
+    }
+    FAIL(first != last, "Deque lost elements")
+    free(reference);
+
+    // The spare block absorbs an end going back and forth over a
+    // block boundary.
+    //
+    SUBTEST(boundary_without_allocation)
+    for (unsigned int i = 0; i < DEQUE_BLOCK_ELEMENTS; i++) {
+        FAIL(!dq->push_back(i), "deque::push_back() failed")
+    }
+    size_t mallocs = instrumented_malloc_calls;
+    for (int round = 0; round < 100; round++) {
+        FAIL(!dq->push_back(1) || !dq->push_back(2) ||
+             !dq->pop_back(&value) || !dq->pop_back(&value),
+             "deque push_back()/pop_back() across a block boundary failed")
+    }
+    FAIL(instrumented_malloc_calls != mallocs,
+         "deque allocated while an end crossed a block boundary")
+
+    SUBTEST(allocation_failure)
+    dq->clear();
+    FAIL(dq->size() != 0, "deque::clear() left elements")
+    for (unsigned int i = 0; i < DEQUE_BLOCK_ELEMENTS / 2; i++) {
+        FAIL(!dq->push_back(i), "deque::push_back() failed")
+    }
+    instrumented_malloc_fail_next = true;
+    FAIL(dq->push_back(1) || dq->size() != DEQUE_BLOCK_ELEMENTS / 2,
+         "deque::push_back() succeeded or changed the size without a block")
+    instrumented_malloc_fail_next = false;
+    FAIL(!dq->pop_front(&value) || value != 0 || !dq->pop_back(&value) ||
+         value != DEQUE_BLOCK_ELEMENTS / 2 - 1,
+         "deque was damaged by a failed allocation")
+
+    delete dq;
+    PASS(check_deque_functionality)
+}
+
+// Pops and pushes like Dijkstra's algorithm, every key pushed at
+// least the last one popped, against a reference set kept in an
+// array. The key steps range from 0 to 2^40 so that every bucket of
+// the radix heap gets used. Returns FALSE on the first mismatch.
+//
+bool walk_monotone_queue(monotone_queue * mq) {
+    const size_t capacity = 256;
+    const int steps       = 60000;
+    uint64_t * keys = (uint64_t*)malloc(steps * sizeof(uint64_t));
+    unsigned int * live = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+    size_t live_count   = 0;
+    unsigned int pushed = 0;
+    uint64_t floor      = 0;
+    uint64_t state      = 987654321;
+    bool matches        = true;
+    for (int step = 0; step < steps && matches; step++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        bool push = live_count == 0 || (live_count < capacity && (state >> 60) < 9);
+        if (push) {
+            uint64_t step_size = (state >> 20) & ((1ULL << ((state >> 8) % 41)) - 1);
+            keys[pushed] = floor + step_size;
+            matches = mq->push(keys[pushed], pushed);
+            live[live_count++] = pushed++;
+        } else if (live_count != 0) {
+            uint64_t key       = 0;
+            unsigned int value = 0;
+            size_t least       = 0;
+            for (size_t k = 1; k < live_count; k++) {
+                if (keys[live[k]] < keys[live[least]]) least = k;
+            }
+            matches = mq->pop(&key, &value) && key == keys[live[least]] && key == keys[value];
+            // Equal keys may come out in any order.
+            //
+            size_t found = live_count;
+            for (size_t k = 0; k < live_count; k++) {
+                if (live[k] == value) found = k;
+            }
+            matches = matches && found != live_count;
+            if (matches) {
+                live[found] = live[--live_count];
+                floor       = key;
+            }
+        }
+        matches = matches && mq->size() == live_count;
+    }
+    free(keys);
+    free(live);
+    return matches;
+}
+
+void check_monotone_queue_functionality(void) {
+    TEST(check_monotone_queue_functionality)
+    monotone_queue * mq = new monotone_queue();
+    uint64_t key       = 7;
+    unsigned int value = 7;
+
+    SUBTEST(empty_monotone_queue)
+    FAIL(mq->size() != 0 || mq->pop(&key, &value) || key != 7 || value != 7 ||
+         mq->is_binary_heap(),
+         "Empty monotone_queue popped, modified the output or is not a radix heap")
+
+    SUBTEST(matches_reference)
+    FAIL(!walk_monotone_queue(mq), "monotone_queue does not match the reference")
+    FAIL(mq->is_binary_heap(), "Monotone keys made monotone_queue fall back to the binary heap")
+
+    SUBTEST(restarts_when_empty)
+    while (mq->pop(&key, &value)) {
+    }
+    FAIL(!mq->push(3, 1) || !mq->pop(&key, &value) || key != 3 || value != 1 ||
+         mq->is_binary_heap(),
+         "An emptied monotone_queue did not accept a smaller key as a radix heap")
+
+    SUBTEST(falls_back_to_binary_heap)
+    FAIL(!mq->push(10, 1) || !mq->push(20, 2) || !mq->pop(&key, &value) || key != 10,
+         "monotone_queue::push() or pop() failed")
+    FAIL(!mq->push(5, 3) || !mq->is_binary_heap(),
+         "A key below the last popped did not switch to the binary heap")
+    FAIL(!mq->pop(&key, &value) || key != 5 || value != 3 ||
+         !mq->pop(&key, &value) || key != 20 || value != 2 || mq->size() != 0,
+         "Binary heap fallback popped out of order")
+    mq->clear();
+    FAIL(!mq->use_binary_heap() || !walk_monotone_queue(mq),
+         "monotone_queue as a binary heap does not match the reference")
+    mq->clear();
+    FAIL(mq->is_binary_heap(), "monotone_queue::clear() did not go back to the radix heap")
+
+    // Redistributing into a bucket that cannot grow moves nothing.
+    // 20 leaves bucket 5 allocated, so that 1023 would fit there
+    // while bucket 1, for 1001, cannot grow.
+    //
+    SUBTEST(allocation_failure)
+    delete mq;
+    mq = new monotone_queue();
+    instrumented_malloc_fail_next = true;
+    FAIL(mq->push(0, 0) || mq->size() != 0,
+         "monotone_queue::push() succeeded or changed the size without a bucket")
+    instrumented_malloc_fail_next = false;
+    FAIL(!mq->push(0, 0) || !mq->push(20, 1) || !mq->pop(&key, &value) || key != 0 ||
+         !mq->pop(&key, &value) || key != 20,
+         "monotone_queue::push() or pop() failed")
+    FAIL(!mq->push(1023, 2) || !mq->push(1001, 3) || !mq->push(1000, 4),
+         "monotone_queue::push() failed")
+    instrumented_malloc_fail_next = true;
+    FAIL(mq->pop(&key, &value) || mq->size() != 3,
+         "monotone_queue::pop() succeeded or lost elements without a bucket")
+    instrumented_malloc_fail_next = false;
+    FAIL(!mq->pop(&key, &value) || key != 1000 || value != 4 ||
+         !mq->pop(&key, &value) || key != 1001 || value != 3 ||
+         !mq->pop(&key, &value) || key != 1023 || value != 2,
+         "monotone_queue popped out of order after a failed allocation")
+
+    delete mq;
+    PASS(check_monotone_queue_functionality)
+}
+
 int main(void) {
     // Set up signal handler for catching infinite loops.
     //
@@ -334,15 +898,26 @@ int main(void) {
     // Set up instrumented malloc and free
     //
     linked_list::register_malloc(instrumented_malloc);
-    linked_list::register_free(free);
+    linked_list::register_free(instrumented_free);
     queue::register_malloc(instrumented_malloc);
-    queue::register_free(free);
+    queue::register_free(instrumented_free);
+    deque::register_malloc(instrumented_malloc);
+    deque::register_free(instrumented_free);
+    monotone_queue::register_malloc(instrumented_malloc);
+    monotone_queue::register_free(instrumented_free);
 
     // Various checks.
     //
     check_empty_list_properties();
     check_insertion_functionality();
     check_find_functionality();
+    check_node_recycling();
+    check_sort_and_merge();
+    check_bulk_construction();
+    check_compact_list_functionality();
+    check_queue_spilling();
+    check_deque_functionality();
+    check_monotone_queue_functionality();
 
     return 0;
 }
@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memory_placement.h"
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+// From <linux/mempolicy.h>, which is not always installed.
+//
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT    0
+#define MPOL_INTERLEAVE 3
+#define MPOL_LOCAL      4
+#endif
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+// Up to 1024 nodes.
+//
+#define NODE_MASK_WORDS 16
+
+static enum huge_page_mode page_mode = HUGE_PAGES_DEFAULT;
+static enum numa_mode placement_numa = NUMA_DEFAULT;
+
+static unsigned long node_mask[NODE_MASK_WORDS];
+static size_t node_count = 0;
+
+// Each fallback is only reported the first time.
+//
+static bool explicit_refused = false;
+static bool advice_refused   = false;
+static bool mbind_refused    = false;
+
+static struct placement_stats stats = { 0, 0, 0, 0, 0 };
+
+// Worker threads place their visited arrays, so the fallback flags
+// and stats are only touched under this lock.
+//
+static pthread_mutex_t placement_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool parse_huge_page_mode(const char * name, enum huge_page_mode * mode) {
+    if (strcmp(name, "default") == 0)       *mode = HUGE_PAGES_DEFAULT;
+    else if (strcmp(name, "off") == 0)      *mode = HUGE_PAGES_OFF;
+    else if (strcmp(name, "thp") == 0)      *mode = HUGE_PAGES_TRANSPARENT;
+    else if (strcmp(name, "explicit") == 0) *mode = HUGE_PAGES_EXPLICIT;
+    else return false;
+    return true;
+}
+
+bool parse_numa_mode(const char * name, enum numa_mode * mode) {
+    if (strcmp(name, "default") == 0)         *mode = NUMA_DEFAULT;
+    else if (strcmp(name, "local") == 0)      *mode = NUMA_LOCAL;
+    else if (strcmp(name, "interleave") == 0) *mode = NUMA_INTERLEAVE;
+    else return false;
+    return true;
+}
+
+const char * huge_page_mode_name(enum huge_page_mode mode) {
+    switch (mode) {
+        case HUGE_PAGES_OFF:         return "off";
+        case HUGE_PAGES_TRANSPARENT: return "thp";
+        case HUGE_PAGES_EXPLICIT:    return "explicit";
+        default:                     return "default";
+    }
+}
+
+const char * numa_mode_name(enum numa_mode mode) {
+    switch (mode) {
+        case NUMA_LOCAL:      return "local";
+        case NUMA_INTERLEAVE: return "interleave";
+        default:              return "default";
+    }
+}
+
+// Reads the online nodes, e.g. "0-1,3", into node_mask.
+//
+static void read_online_nodes(void) {
+    memset(node_mask, 0, sizeof(node_mask));
+    node_count = 0;
+    FILE * online = fopen("/sys/devices/system/node/online", "r");
+    char list[256];
+    if (online == NULL || fgets(list, sizeof(list), online) == NULL) {
+        if (online != NULL) fclose(online);
+        node_mask[0] = 1;
+        node_count   = 1;
+        return;
+    }
+    fclose(online);
+
+    char * cursor = list;
+    while (*cursor != '\0' && *cursor != '\n') {
+        char * end;
+        unsigned long first = strtoul(cursor, &end, 10);
+        if (end == cursor) break;
+        unsigned long last  = first;
+        if (*end == '-') {
+            last = strtoul(end + 1, &end, 10);
+        }
+        for (unsigned long node = first; node <= last && node < NODE_MASK_WORDS * 64; node++) {
+            node_mask[node / 64] |= 1UL << (node % 64);
+            ++node_count;
+        }
+        cursor = *end == ',' ? end + 1 : end;
+    }
+}
+
+static int mempolicy_mode(void) {
+    switch (placement_numa) {
+        case NUMA_LOCAL:      return MPOL_LOCAL;
+        case NUMA_INTERLEAVE: return MPOL_INTERLEAVE;
+        default:              return MPOL_DEFAULT;
+    }
+}
+
+void set_memory_placement(enum huge_page_mode pages, enum numa_mode numa) {
+    page_mode      = pages;
+    placement_numa = numa;
+    read_online_nodes();
+    if (numa == NUMA_DEFAULT) {
+        return;
+    }
+
+    const unsigned long * mask = numa == NUMA_INTERLEAVE ? node_mask : NULL;
+    unsigned long max_node     = numa == NUMA_INTERLEAVE ? NODE_MASK_WORDS * 64 : 0;
+    if (syscall(SYS_set_mempolicy, mempolicy_mode(), mask, max_node) != 0) {
+        printf("set_mempolicy(%s) failed: %s. Using the default NUMA policy.\n",
+               numa_mode_name(numa), strerror(errno));
+        placement_numa = NUMA_DEFAULT;
+        ++stats.fallbacks;
+    }
+}
+
+static void place_region_locked(void * ptr, size_t bytes) {
+    int advice = -1;
+    if (page_mode == HUGE_PAGES_OFF) {
+        advice = MADV_NOHUGEPAGE;
+    } else if (page_mode == HUGE_PAGES_TRANSPARENT || page_mode == HUGE_PAGES_EXPLICIT) {
+        advice = MADV_HUGEPAGE;
+    }
+    if (advice >= 0 && madvise(ptr, bytes, advice) != 0) {
+        if (!advice_refused) {
+            printf("madvise(%s) failed: %s. Transparent huge pages may be disabled.\n",
+                   advice == MADV_HUGEPAGE ? "MADV_HUGEPAGE" : "MADV_NOHUGEPAGE", strerror(errno));
+        }
+        advice_refused = true;
+        ++stats.fallbacks;
+    } else if (advice == MADV_HUGEPAGE) {
+        stats.transparent_bytes += bytes;
+    }
+
+    if (placement_numa != NUMA_DEFAULT) {
+        const unsigned long * mask = placement_numa == NUMA_INTERLEAVE ? node_mask : NULL;
+        unsigned long max_node     = placement_numa == NUMA_INTERLEAVE ? NODE_MASK_WORDS * 64 : 0;
+        if (syscall(SYS_mbind, ptr, bytes, mempolicy_mode(), mask, max_node, 0) != 0) {
+            if (!mbind_refused) {
+                printf("mbind(%s) failed: %s. Leaving the NUMA placement to the kernel.\n",
+                       numa_mode_name(placement_numa), strerror(errno));
+            }
+            mbind_refused = true;
+            ++stats.fallbacks;
+        }
+    }
+}
+
+void place_region(void * ptr, size_t bytes) {
+    pthread_mutex_lock(&placement_lock);
+    place_region_locked(ptr, bytes);
+    pthread_mutex_unlock(&placement_lock);
+}
+
+size_t placement_huge_page_size(void) {
+    if (page_mode == HUGE_PAGES_TRANSPARENT || page_mode == HUGE_PAGES_EXPLICIT) {
+        return HUGE_PAGE_SIZE;
+    }
+    return 0;
+}
+
+static size_t mapped_size(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+static void * placed_alloc_locked(size_t bytes) {
+    size_t length = mapped_size(bytes == 0 ? 1 : bytes);
+    if (page_mode == HUGE_PAGES_EXPLICIT && !explicit_refused) {
+        void * mapped = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapped != MAP_FAILED) {
+            if (placement_numa != NUMA_DEFAULT) {
+                place_region_locked(mapped, length);
+            }
+            ++stats.regions;
+            stats.bytes          += length;
+            stats.explicit_bytes += length;
+            return mapped;
+        }
+        printf("No explicit huge pages available (see /proc/sys/vm/nr_hugepages), "
+               "using transparent ones.\n");
+        explicit_refused = true;
+        ++stats.fallbacks;
+    }
+
+    // Map one huge page more than needed and trim both ends, leaving a
+    // 2 MiB aligned mapping that transparent huge pages can cover
+    // from its first byte.
+    //
+    char * mapped = (char*)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return NULL;
+    }
+    char * aligned = (char*)(((uintptr_t)mapped + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned > mapped) {
+        munmap(mapped, aligned - mapped);
+    }
+    munmap(aligned + length, mapped + HUGE_PAGE_SIZE - aligned);
+
+    place_region_locked(aligned, length);
+    ++stats.regions;
+    stats.bytes += length;
+    return aligned;
+}
+
+void * placed_alloc(size_t bytes) {
+    pthread_mutex_lock(&placement_lock);
+    void * placed = placed_alloc_locked(bytes);
+    pthread_mutex_unlock(&placement_lock);
+    return placed;
+}
+
+void placed_free(void * ptr, size_t bytes) {
+    if (ptr != NULL) {
+        munmap(ptr, mapped_size(bytes == 0 ? 1 : bytes));
+    }
+}
+
+void read_placement_stats(struct placement_stats * out) {
+    pthread_mutex_lock(&placement_lock);
+    *out = stats;
+    pthread_mutex_unlock(&placement_lock);
+}
+
+// AnonHugePages of the whole process in KiB, or -1.
+//
+static long read_anon_huge_pages_kb(void) {
+    FILE * rollup = fopen("/proc/self/smaps_rollup", "r");
+    if (rollup == NULL) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), rollup) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(rollup);
+    return kb;
+}
+
+void print_placement_summary(void) {
+    printf("Memory placement: huge pages %s, NUMA %s over %ld node%s\n",
+           huge_page_mode_name(page_mode), numa_mode_name(placement_numa),
+           node_count, node_count == 1 ? "" : "s");
+    printf("Placed regions: %ld, %0.1f MiB, explicit huge pages: %0.1f MiB, "
+           "advised for THP: %0.1f MiB, fallbacks: %ld\n",
+           stats.regions, (double)stats.bytes / (1024.0 * 1024.0),
+           (double)stats.explicit_bytes / (1024.0 * 1024.0),
+           (double)stats.transparent_bytes / (1024.0 * 1024.0), stats.fallbacks);
+    long huge_kb = read_anon_huge_pages_kb();
+    if (huge_kb >= 0) {
+        printf("Process memory in transparent huge pages: %0.1f MiB\n", (double)huge_kb / 1024.0);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef MEMORY_PLACEMENT_H_
+#define MEMORY_PLACEMENT_H_
+
+#include <stddef.h>
+
+// Page size and NUMA placement of the big, randomly accessed arrays:
+// the adjacency, the visited arrays and, through the allocator
+// backends' regions, the queue nodes of the frontier.
+//
+// Huge pages cover 2 MiB with one dTLB entry instead of 512.
+//  x default:  whatever the kernel does on its own.
+//  x off:      madvise(MADV_NOHUGEPAGE), 4 KiB pages only, the
+//              baseline to compare against.
+//  x thp:      2 MiB aligned mappings with madvise(MADV_HUGEPAGE),
+//              transparent huge pages where the kernel has them.
+//  x explicit: mmap(MAP_HUGETLB) from the pool reserved in
+//              /proc/sys/vm/nr_hugepages, falling back to thp when
+//              the pool is empty.
+//
+// NUMA placement, through the mbind() and set_mempolicy() system
+// calls, so no libnuma is needed.
+//  x default:    the kernel's policy, normally first touch.
+//  x local:      first touch, set explicitly (MPOL_LOCAL).
+//  x interleave: pages spread round robin over every online node,
+//                for memory every thread reads.
+// Anything the kernel refuses falls back to default, once, with a
+// notice.
+//
+enum huge_page_mode {
+    HUGE_PAGES_DEFAULT,
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_TRANSPARENT,
+    HUGE_PAGES_EXPLICIT
+};
+
+enum numa_mode {
+    NUMA_DEFAULT,
+    NUMA_LOCAL,
+    NUMA_INTERLEAVE
+};
+
+// Return FALSE for an unknown name.
+//
+bool parse_huge_page_mode(const char * name, enum huge_page_mode * mode);
+bool parse_numa_mode(const char * name, enum numa_mode * mode);
+const char * huge_page_mode_name(enum huge_page_mode mode);
+const char * numa_mode_name(enum numa_mode mode);
+
+// Applies to every later placed_alloc() and place_region(). A NUMA
+// mode other than default is also made the policy of the whole
+// process, so that everything malloc() hands out later follows it.
+//
+void set_memory_placement(enum huge_page_mode pages, enum numa_mode numa);
+
+// Zeroed memory placed by the current policy, mapped in whole 2 MiB
+// steps. Returns NULL on failure. placed_free() takes the same
+// bytes as the allocation, whatever the policy is by then.
+//
+void * placed_alloc(size_t bytes);
+void placed_free(void * ptr, size_t bytes);
+
+// Applies the current policy to memory mapped elsewhere. Huge pages
+// only cover the parts of it that are aligned whole huge pages.
+//
+void place_region(void * ptr, size_t bytes);
+
+// The size and alignment memory given to place_region() needs for
+// huge pages: 2 MiB under thp and explicit, 0 otherwise.
+//
+size_t placement_huge_page_size(void);
+
+struct placement_stats {
+    size_t regions;
+    size_t bytes;
+    size_t explicit_bytes;
+    size_t transparent_bytes;
+    size_t fallbacks;
+};
+
+void read_placement_stats(struct placement_stats * stats);
+
+// The policy, what placed_alloc() got, and how much of the process
+// the kernel actually backs with transparent huge pages.
+//
+void print_placement_summary(void);
+
+#endif
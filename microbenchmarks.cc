@@ -0,0 +1,751 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "linked_list.h"
+#include "monotone_queue.h"
+#include "queue.h"
+#include "timing.h"
+
+// Microbenchmarks for individual linked_list, queue and
+// monotone_queue operations.
+//
+// Every benchmark builds its lists outside of the timed region, then
+// times a batch of operations and reports nanoseconds per operation.
+// Operations that grow or shrink a list are spread over several
+// lists so that every list stays between size and 1.5 * size while
+// the batch is still long enough to time accurately.
+//
+// Each case is run a few times to warm up caches and the allocator,
+// then repeated; the median and the median absolute deviation (MAD)
+// of those repetitions are reported, as text and optionally JSON.
+
+enum access_pattern {
+    PATTERN_FRONT,
+    PATTERN_MIDDLE,
+    PATTERN_END,
+    PATTERN_RANDOM,
+    PATTERN_MISSING,
+    PATTERN_COUNT
+};
+
+#define PATTERN_BIT(p) (1U << (p))
+#define POSITIONAL_PATTERNS (PATTERN_BIT(PATTERN_FRONT) | PATTERN_BIT(PATTERN_MIDDLE) | \
+                             PATTERN_BIT(PATTERN_END) | PATTERN_BIT(PATTERN_RANDOM))
+
+static const char * pattern_names[PATTERN_COUNT] = {
+    "front", "middle", "end", "random", "missing"
+};
+
+// Roughly how many list nodes a single repetition may touch, which
+// bounds the batch size of operations that are O(n).
+//
+#define LINEAR_WORK_BUDGET 20000000UL
+#define CONSTANT_BATCH     200000UL
+
+// Keeps results alive so the compiler cannot drop the work.
+//
+static volatile size_t sink;
+
+#define RANDOM_SEED 0x9E3779B97F4A7C15ULL
+
+static uint64_t rng_state = RANDOM_SEED;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// The index an operation with the given pattern targets in a list
+// of the given size.
+//
+static size_t pattern_index(enum access_pattern pattern, size_t size) {
+    switch (pattern) {
+        case PATTERN_FRONT:  return 0;
+        case PATTERN_MIDDLE: return size / 2;
+        case PATTERN_END:    return size == 0 ? 0 : size - 1;
+        default:             return size == 0 ? 0 : next_random() % size;
+    }
+}
+
+static linked_list * build_list(size_t size) {
+    linked_list * ll = new linked_list();
+    for (size_t i = 0; i < size; i++) {
+        ll->insert_end(i);
+    }
+    return ll;
+}
+
+static queue * build_queue(size_t size) {
+    queue * q = new queue();
+    for (size_t i = 0; i < size; i++) {
+        q->push(i);
+    }
+    return q;
+}
+
+// How a batch of ops operations on lists of the given size is split:
+// lists * per_list == ops (rounded up).
+//
+struct batch_shape {
+    size_t lists;
+    size_t per_list;
+};
+
+static struct batch_shape shape_batch(size_t size, size_t ops, bool changes_size) {
+    struct batch_shape shape;
+    shape.per_list = ops;
+    if (changes_size) {
+        size_t limit   = size / 2 == 0 ? 1 : size / 2;
+        shape.per_list = ops < limit ? ops : limit;
+    }
+    shape.lists = (ops + shape.per_list - 1) / shape.per_list;
+    return shape;
+}
+
+// Benchmark bodies. Each returns the nanoseconds spent in the timed
+// operations and stores the number of operations performed in *ops.
+//
+typedef long (*benchmark_fn)(size_t size, enum access_pattern pattern, size_t * ops);
+
+static long bench_insert_front(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    linked_list ** lists = (linked_list**)malloc(shape.lists * sizeof(linked_list*));
+    for (size_t l = 0; l < shape.lists; l++) lists[l] = build_list(size);
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        linked_list * ll = lists[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            ll->insert_front(k);
+        }
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < shape.lists; l++) delete lists[l];
+    free(lists);
+    *ops = shape.lists * shape.per_list;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_insert_end(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    linked_list ** lists = (linked_list**)malloc(shape.lists * sizeof(linked_list*));
+    for (size_t l = 0; l < shape.lists; l++) lists[l] = build_list(size);
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        linked_list * ll = lists[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            ll->insert_end(k);
+        }
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < shape.lists; l++) delete lists[l];
+    free(lists);
+    *ops = shape.lists * shape.per_list;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_insert_index(size_t size, enum access_pattern pattern, size_t * ops) {
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    size_t total = shape.lists * shape.per_list;
+    linked_list ** lists = (linked_list**)malloc(shape.lists * sizeof(linked_list*));
+    size_t * indices     = (size_t*)malloc(total * sizeof(size_t));
+    for (size_t l = 0; l < shape.lists; l++) {
+        lists[l] = build_list(size);
+        for (size_t k = 0; k < shape.per_list; k++) {
+            // Inserting at the end means at index size, one past
+            // the last element.
+            //
+            indices[l * shape.per_list + k] = pattern == PATTERN_END ? size + k : pattern_index(pattern, size + k);
+        }
+    }
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        linked_list * ll = lists[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            ll->insert(indices[l * shape.per_list + k], k);
+        }
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < shape.lists; l++) delete lists[l];
+    free(lists);
+    free(indices);
+    *ops = total;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_remove(size_t size, enum access_pattern pattern, size_t * ops) {
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    size_t total = shape.lists * shape.per_list;
+    linked_list ** lists = (linked_list**)malloc(shape.lists * sizeof(linked_list*));
+    size_t * indices     = (size_t*)malloc(total * sizeof(size_t));
+    for (size_t l = 0; l < shape.lists; l++) {
+        // Start at 1.5 * size so that the list shrinks to size.
+        //
+        lists[l] = build_list(size + shape.per_list);
+        for (size_t k = 0; k < shape.per_list; k++) {
+            indices[l * shape.per_list + k] = pattern_index(pattern, size + shape.per_list - k);
+        }
+    }
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        linked_list * ll = lists[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            ll->remove(indices[l * shape.per_list + k]);
+        }
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < shape.lists; l++) delete lists[l];
+    free(lists);
+    free(indices);
+    *ops = total;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_find(size_t size, enum access_pattern pattern, size_t * ops) {
+    linked_list * ll       = build_list(size);
+    unsigned int * targets = (unsigned int*)malloc(*ops * sizeof(unsigned int));
+    for (size_t k = 0; k < *ops; k++) {
+        targets[k] = pattern == PATTERN_MISSING ? (unsigned int)size : (unsigned int)pattern_index(pattern, size);
+    }
+
+    size_t found = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < *ops; k++) {
+        found += ll->find(targets[k]);
+    }
+    GRAB_CLOCK(stop)
+    sink = found;
+
+    delete ll;
+    free(targets);
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_subscript(size_t size, enum access_pattern pattern, size_t * ops) {
+    linked_list * ll = build_list(size);
+    size_t * indices = (size_t*)malloc(*ops * sizeof(size_t));
+    for (size_t k = 0; k < *ops; k++) {
+        indices[k] = pattern_index(pattern, size);
+    }
+
+    size_t sum = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < *ops; k++) {
+        sum += (*ll)[indices[k]];
+    }
+    GRAB_CLOCK(stop)
+    sink = sum;
+
+    delete ll;
+    free(indices);
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_queue_push(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    queue ** queues = (queue**)malloc(shape.lists * sizeof(queue*));
+    for (size_t l = 0; l < shape.lists; l++) queues[l] = build_queue(size);
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        queue * q = queues[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            q->push(k);
+        }
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < shape.lists; l++) delete queues[l];
+    free(queues);
+    *ops = shape.lists * shape.per_list;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_queue_pop(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    struct batch_shape shape = shape_batch(size, *ops, true);
+    queue ** queues = (queue**)malloc(shape.lists * sizeof(queue*));
+    for (size_t l = 0; l < shape.lists; l++) queues[l] = build_queue(size + shape.per_list);
+
+    size_t sum = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < shape.lists; l++) {
+        queue * q = queues[l];
+        for (size_t k = 0; k < shape.per_list; k++) {
+            unsigned int value = 0;
+            q->pop(&value);
+            sum += value;
+        }
+    }
+    GRAB_CLOCK(stop)
+    sink = sum;
+
+    for (size_t l = 0; l < shape.lists; l++) delete queues[l];
+    free(queues);
+    *ops = shape.lists * shape.per_list;
+    return compute_timespec_diff(start, stop);
+}
+
+static long bench_queue_next(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    queue * q = build_queue(size);
+
+    size_t sum = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < *ops; k++) {
+        unsigned int value = 0;
+        q->next(&value);
+        sum += value;
+    }
+    GRAB_CLOCK(stop)
+    sink = sum;
+
+    delete q;
+    return compute_timespec_diff(start, stop);
+}
+
+// A queue created, filled with size elements, drained and deleted,
+// as in a short lived search. One operation is one queue's lifetime.
+//
+static long bench_queue_lifetime(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    size_t sum = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < *ops; k++) {
+        queue * q = new queue();
+        for (size_t i = 0; i < size; i++) {
+            q->push(i);
+        }
+        unsigned int value = 0;
+        while (q->pop(&value)) {
+            sum += value;
+        }
+        delete q;
+    }
+    GRAB_CLOCK(stop)
+    sink = sum;
+    return compute_timespec_diff(start, stop);
+}
+
+// The hold model for priority queues: size elements are queued, and
+// one operation pops the smallest and pushes a new element a random
+// step above it, the key pattern of Dijkstra's algorithm. Reseeding
+// here gives every priority queue the same keys.
+//
+#define HOLD_KEY_RANGE  (1ULL << 20)
+#define HOLD_STEP_RANGE (1ULL << 16)
+
+template <class priority_queue_type>
+static long hold(priority_queue_type * pq, size_t size, size_t ops) {
+    rng_state = RANDOM_SEED;
+    for (size_t k = 0; k < size; k++) {
+        pq->push(next_random() % HOLD_KEY_RANGE, k);
+    }
+    size_t sum = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < ops; k++) {
+        uint64_t key       = 0;
+        unsigned int value = 0;
+        pq->pop(&key, &value);
+        pq->push(key + 1 + next_random() % HOLD_STEP_RANGE, value);
+        sum += value;
+    }
+    GRAB_CLOCK(stop)
+    sink = sum;
+    return compute_timespec_diff(start, stop);
+}
+
+// std::priority_queue behind monotone_queue's interface.
+//
+struct std_priority_queue {
+    std::priority_queue<std::pair<uint64_t, unsigned int>,
+                        std::vector<std::pair<uint64_t, unsigned int> >,
+                        std::greater<std::pair<uint64_t, unsigned int> > > heap;
+
+    void push(uint64_t key, unsigned int value) {
+        heap.push(std::make_pair(key, value));
+    }
+
+    void pop(uint64_t * key, unsigned int * value) {
+        *key   = heap.top().first;
+        *value = heap.top().second;
+        heap.pop();
+    }
+};
+
+static long bench_radix_heap_hold(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    monotone_queue * mq = new monotone_queue();
+    long nanoseconds = hold(mq, size, *ops);
+    delete mq;
+    return nanoseconds;
+}
+
+static long bench_binary_heap_hold(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    monotone_queue * mq = new monotone_queue();
+    mq->use_binary_heap();
+    long nanoseconds = hold(mq, size, *ops);
+    delete mq;
+    return nanoseconds;
+}
+
+static long bench_std_priority_queue_hold(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    struct std_priority_queue pq;
+    return hold(&pq, size, *ops);
+}
+
+// Whole-list operations are timed over enough lists of the given
+// size to touch about this many elements, at least one list, and
+// reported per element.
+//
+#define WHOLE_LIST_ELEMENTS 1048576UL
+
+static size_t whole_list_count(size_t size) {
+    return size >= WHOLE_LIST_ELEMENTS ? 1 : (WHOLE_LIST_ELEMENTS + size - 1) / size;
+}
+
+// Random values below range, sorted if asked.
+//
+static linked_list * build_random_list(size_t size, unsigned int range, bool sorted) {
+    linked_list * ll = new linked_list();
+    for (size_t i = 0; i < size; i++) {
+        ll->insert_end((unsigned int)(next_random() % range));
+    }
+    if (sorted) {
+        ll->sort();
+    }
+    return ll;
+}
+
+static long bench_sort(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    size_t count = whole_list_count(size);
+    linked_list ** lists = (linked_list**)malloc(count * sizeof(linked_list*));
+    for (size_t l = 0; l < count; l++) lists[l] = build_random_list(size, UINT32_MAX, false);
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < count; l++) {
+        lists[l]->sort();
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < count; l++) delete lists[l];
+    free(lists);
+    *ops = count * size;
+    return compute_timespec_diff(start, stop);
+}
+
+// Sorted lists where every value appears about four times.
+//
+static long bench_unique(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    size_t count = whole_list_count(size);
+    unsigned int range = size / 4 == 0 ? 1 : (unsigned int)(size / 4);
+    linked_list ** lists = (linked_list**)malloc(count * sizeof(linked_list*));
+    for (size_t l = 0; l < count; l++) lists[l] = build_random_list(size, range, true);
+
+    size_t removed = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < count; l++) {
+        removed += lists[l]->unique();
+    }
+    GRAB_CLOCK(stop)
+    sink = removed;
+
+    for (size_t l = 0; l < count; l++) delete lists[l];
+    free(lists);
+    *ops = count * size;
+    return compute_timespec_diff(start, stop);
+}
+
+// Merges pairs of sorted lists of size / 2 elements each.
+//
+static long bench_merge(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    size_t count = whole_list_count(size);
+    size_t half  = size / 2 == 0 ? 1 : size / 2;
+    linked_list ** lists = (linked_list**)malloc(2 * count * sizeof(linked_list*));
+    for (size_t l = 0; l < 2 * count; l++) lists[l] = build_random_list(half, UINT32_MAX, true);
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < count; l++) {
+        lists[2 * l]->merge(static_cast<linked_list&&>(*lists[2 * l + 1]));
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < 2 * count; l++) delete lists[l];
+    free(lists);
+    *ops = count * 2 * half;
+    return compute_timespec_diff(start, stop);
+}
+
+// Builds lists of size elements from an array in one call, against
+// insert_end() once per element in linked_list::insert_end.
+//
+static long bench_assign(size_t size, enum access_pattern pattern, size_t * ops) {
+    (void)pattern;
+    size_t count = whole_list_count(size);
+    unsigned int * data = (unsigned int*)malloc(size * sizeof(unsigned int));
+    for (size_t i = 0; i < size; i++) data[i] = (unsigned int)i;
+    linked_list ** lists = (linked_list**)malloc(count * sizeof(linked_list*));
+    for (size_t l = 0; l < count; l++) lists[l] = new linked_list();
+
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t l = 0; l < count; l++) {
+        lists[l]->assign(data, size);
+    }
+    GRAB_CLOCK(stop)
+
+    for (size_t l = 0; l < count; l++) delete lists[l];
+    free(lists);
+    free(data);
+    *ops = count * size;
+    return compute_timespec_diff(start, stop);
+}
+
+struct benchmark {
+    const char * name;
+    benchmark_fn run;
+    unsigned int patterns;
+    // TRUE if one operation costs O(size), which limits the batch.
+    //
+    bool linear;
+};
+
+static const struct benchmark benchmarks[] = {
+    { "linked_list::insert_front", bench_insert_front, PATTERN_BIT(PATTERN_FRONT), false },
+    { "linked_list::insert_end",   bench_insert_end,   PATTERN_BIT(PATTERN_END),   false },
+    { "linked_list::insert",       bench_insert_index, POSITIONAL_PATTERNS,        true },
+    { "linked_list::remove",       bench_remove,       POSITIONAL_PATTERNS,        true },
+    { "linked_list::find",         bench_find,         POSITIONAL_PATTERNS | PATTERN_BIT(PATTERN_MISSING), true },
+    { "linked_list::operator[]",   bench_subscript,    POSITIONAL_PATTERNS,        true },
+    { "linked_list::assign",       bench_assign,       PATTERN_BIT(PATTERN_END),   false },
+    { "linked_list::sort",         bench_sort,         PATTERN_BIT(PATTERN_RANDOM), false },
+    { "linked_list::unique",       bench_unique,       PATTERN_BIT(PATTERN_RANDOM), false },
+    { "linked_list::merge",        bench_merge,        PATTERN_BIT(PATTERN_RANDOM), false },
+    { "queue::push",               bench_queue_push,   PATTERN_BIT(PATTERN_END),   false },
+    { "queue::pop",                bench_queue_pop,    PATTERN_BIT(PATTERN_FRONT), false },
+    { "queue::next",               bench_queue_next,   PATTERN_BIT(PATTERN_FRONT), false },
+    { "queue lifetime",            bench_queue_lifetime, PATTERN_BIT(PATTERN_END), true },
+    { "monotone_queue radix hold", bench_radix_heap_hold, PATTERN_BIT(PATTERN_RANDOM), false },
+    { "monotone_queue heap hold",  bench_binary_heap_hold, PATTERN_BIT(PATTERN_RANDOM), false },
+    { "std::priority_queue hold",  bench_std_priority_queue_hold, PATTERN_BIT(PATTERN_RANDOM), false },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int compare_doubles(const void * a, const void * b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts a copy, so that values stays in repetition order for the
+// JSON samples.
+//
+static double median(const double * values, size_t count) {
+    double * sorted = (double*)malloc(count * sizeof(double));
+    if (sorted == NULL) {
+        printf("Failed to allocate median buffer.\n");
+        exit(1);
+    }
+    memcpy(sorted, values, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    double middle = count % 2 == 1 ? sorted[count / 2]
+                                   : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+    free(sorted);
+    return middle;
+}
+
+// Command line options.
+//
+struct options {
+    size_t warmup;
+    size_t repetitions;
+    size_t sizes[16];
+    size_t size_count;
+    const char * filter;
+    const char * json_path;
+};
+
+static void print_usage(const char * program) {
+    printf("Usage: %s [--warmup N] [--repetitions N] [--sizes A,B,...]\n"
+           "       [--filter SUBSTRING] [--json FILE]\n", program);
+    printf("  --sizes defaults to 16,256,4096,65536,1048576. Give it 10000000 to\n"
+           "  time sort, unique and merge at 10^7 elements.\n");
+}
+
+static bool parse_options(int argc, char ** argv, struct options * options) {
+    static const size_t default_sizes[] = { 16, 256, 4096, 65536, 1048576 };
+
+    options->warmup      = 2;
+    options->repetitions = 11;
+    options->size_count  = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    memcpy(options->sizes, default_sizes, sizeof(default_sizes));
+    options->filter      = NULL;
+    options->json_path   = NULL;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--warmup") == 0 && arg + 1 < argc) {
+            options->warmup = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "--repetitions") == 0 && arg + 1 < argc) {
+            options->repetitions = strtoul(argv[++arg], NULL, 10);
+            if (options->repetitions == 0) return false;
+        } else if (strcmp(argv[arg], "--sizes") == 0 && arg + 1 < argc) {
+            options->size_count = 0;
+            char * cursor = argv[++arg];
+            while (*cursor != '\0' && options->size_count < 16) {
+                char * end;
+                size_t size = strtoul(cursor, &end, 10);
+                if (end == cursor || size == 0) return false;
+                options->sizes[options->size_count++] = size;
+                cursor = *end == ',' ? end + 1 : end;
+            }
+            if (options->size_count == 0) return false;
+        } else if (strcmp(argv[arg], "--filter") == 0 && arg + 1 < argc) {
+            options->filter = argv[++arg];
+        } else if (strcmp(argv[arg], "--json") == 0 && arg + 1 < argc) {
+            options->json_path = argv[++arg];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    struct options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    linked_list::register_malloc(malloc);
+    linked_list::register_free(free);
+    queue::register_malloc(malloc);
+    queue::register_free(free);
+    monotone_queue::register_malloc(malloc);
+    monotone_queue::register_free(free);
+
+    FILE * json = NULL;
+    if (options.json_path != NULL) {
+        json = fopen(options.json_path, "w");
+        if (json == NULL) {
+            printf("Unable to open %s for writing.\n", options.json_path);
+            return 1;
+        }
+        fprintf(json, "{\n  \"compiler\": \"%s\",\n  \"warmup\": %ld,\n  \"repetitions\": %ld,\n  \"results\": [",
+                __VERSION__, options.warmup, options.repetitions);
+    }
+
+    double * samples    = (double*)malloc(options.repetitions * sizeof(double));
+    double * deviations = (double*)malloc(options.repetitions * sizeof(double));
+    if (samples == NULL || deviations == NULL) {
+        printf("Failed to allocate sample arrays.\n");
+        return 1;
+    }
+
+    printf("%-28s %-8s %10s %10s %14s %12s\n",
+           "benchmark", "pattern", "size", "ops", "median [ns/op]", "MAD [ns/op]");
+
+    bool first_result = true;
+    for (size_t b = 0; b < BENCHMARK_COUNT; b++) {
+        const struct benchmark * benchmark = &benchmarks[b];
+        if (options.filter != NULL && strstr(benchmark->name, options.filter) == NULL) {
+            continue;
+        }
+
+        for (size_t p = 0; p < PATTERN_COUNT; p++) {
+            if (!(benchmark->patterns & PATTERN_BIT(p))) continue;
+
+            for (size_t s = 0; s < options.size_count; s++) {
+                size_t size = options.sizes[s];
+                size_t batch = CONSTANT_BATCH;
+                if (benchmark->linear) {
+                    batch = LINEAR_WORK_BUDGET / size;
+                    if (batch < 16) batch = 16;
+                    if (batch > CONSTANT_BATCH) batch = CONSTANT_BATCH;
+                }
+
+                // Every repetition sees the same indices.
+                //
+                size_t ops = batch;
+                for (size_t r = 0; r < options.warmup + options.repetitions; r++) {
+                    rng_state = RANDOM_SEED;
+                    ops = batch;
+                    long nanoseconds = benchmark->run(size, (enum access_pattern)p, &ops);
+                    if (r >= options.warmup) {
+                        samples[r - options.warmup] = (double)nanoseconds / (double)ops;
+                    }
+                }
+
+                double middle = median(samples, options.repetitions);
+                for (size_t r = 0; r < options.repetitions; r++) {
+                    double deviation = samples[r] - middle;
+                    deviations[r] = deviation < 0 ? -deviation : deviation;
+                }
+                double mad = median(deviations, options.repetitions);
+
+                printf("%-28s %-8s %10ld %10ld %14.2f %12.2f\n",
+                       benchmark->name, pattern_names[p], size, ops, middle, mad);
+                fflush(stdout);
+
+                if (json != NULL) {
+                    fprintf(json, "%s\n    {\"benchmark\": \"%s\", \"pattern\": \"%s\", \"size\": %ld, "
+                            "\"ops\": %ld, \"median_ns_per_op\": %0.3f, \"mad_ns_per_op\": %0.3f, \"samples\": [",
+                            first_result ? "" : ",", benchmark->name, pattern_names[p], size, ops, middle, mad);
+                    for (size_t r = 0; r < options.repetitions; r++) {
+                        fprintf(json, "%s%0.3f", r == 0 ? "" : ", ", samples[r]);
+                    }
+                    fprintf(json, "]}");
+                    first_result = false;
+                }
+            }
+        }
+    }
+
+    if (json != NULL) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    free(samples);
+    free(deviations);
+    return 0;
+}
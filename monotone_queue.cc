@@ -0,0 +1,5 @@
+// Out of line definitions for the shared libraries, see
+// monotone_queue_impl.h.
+//
+#define MONOTONE_QUEUE_INLINE
+#include "monotone_queue_impl.h"
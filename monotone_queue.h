@@ -0,0 +1,103 @@
+#ifndef MONOTONE_QUEUE_H_
+#define MONOTONE_QUEUE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A min-priority queue of unsigned int values under 64 bit keys, for
+// Dijkstra's algorithm and other searches whose keys are monotone:
+// no key pushed is smaller than the last key popped.
+//
+// It is a radix heap. Bucket 0 holds the elements whose key equals
+// last, the last key popped, and bucket b > 0 those whose key first
+// differs from last in bit b - 1. The buckets are ordered, so the
+// minimum is in the first non-empty one. Popping from an empty bucket
+// 0 takes the smallest key in that first bucket as the new last and
+// moves its elements down into lower buckets. An element only moves
+// down, at most 64 times, so push and pop are O(1) amortized for
+// bounded key differences and O(log C) for differences up to C,
+// against O(log n) sift steps of a binary heap. The buckets are
+// arrays, scanned in order, with no pointer chasing.
+//
+// An empty queue takes any key, so one queue serves search after
+// search. A push with a key below last into a non-empty queue would
+// break the buckets' order. The queue then moves every element into
+// a binary heap and stays one until clear(), correct for any keys,
+// just no longer as fast.
+// use_binary_heap() switches on purpose, for comparisons.
+//
+// Non-negative doubles compare the same as their IEEE 754 bits read
+// as uint64_t, so real-valued distances can be keyed by their bits.
+//
+// Allocates through the same kind of hooks as queue.
+//
+#define MONOTONE_BUCKETS 65
+
+struct monotone_entry {
+    uint64_t key;
+    unsigned int value;
+};
+
+class monotone_queue{
+  public:
+    monotone_queue();
+    virtual ~monotone_queue();
+
+    void * operator new(size_t size);
+    void operator delete(void * ptr);
+
+    // Returns TRUE on success, FALSE on allocation failure.
+    //
+    bool push(uint64_t key, unsigned int value);
+
+    // Pops an element with the smallest key. Returns FALSE if the
+    // queue is empty or, with size() still non-zero, on allocation
+    // failure, in which case neither output is modified.
+    //
+    bool pop(uint64_t * key, unsigned int * value);
+
+    size_t size() const;
+
+    // Empties the queue and makes it a radix heap again, keeping the
+    // bucket and heap arrays for reuse.
+    //
+    void clear();
+
+    // Moves the elements into the binary heap. Returns FALSE on
+    // allocation failure, leaving the queue as it was.
+    //
+    bool use_binary_heap();
+    bool is_binary_heap() const;
+
+    // Static members for memory allocation, as for queue.
+    //
+    static void register_malloc(void * (*malloc)(size_t));
+    static void register_free(void (*free)(void*));
+    static void * (*malloc_fptr)(size_t);
+    static void (*free_fptr)(void*);
+
+  private:
+    struct monotone_entry * buckets[MONOTONE_BUCKETS];
+    size_t bucket_size[MONOTONE_BUCKETS];
+    size_t bucket_capacity[MONOTONE_BUCKETS];
+    uint64_t last;
+
+    struct monotone_entry * heap;
+    size_t heap_size;
+    size_t heap_capacity;
+    bool binary_heap;
+
+    size_t mq_size;
+
+    bool grow(struct monotone_entry ** entries, size_t * capacity, size_t used, size_t needed);
+    bool refill_bucket_zero();
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+};
+
+#ifdef QUEUE_HEADER_ONLY
+#include "monotone_queue_impl.h"
+#endif
+
+#endif
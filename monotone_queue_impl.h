@@ -0,0 +1,267 @@
+#ifndef MONOTONE_QUEUE_IMPL_H_
+#define MONOTONE_QUEUE_IMPL_H_
+
+// The definitions of the monotone_queue members, built out of line
+// into libqueue.so by monotone_queue.cc and inlined by
+// QUEUE_HEADER_ONLY builds, as for linked_list_impl.h.
+//
+
+#include <string.h>
+
+#include "monotone_queue.h"
+
+#ifndef MONOTONE_QUEUE_INLINE
+#define MONOTONE_QUEUE_INLINE inline
+#endif
+
+MONOTONE_QUEUE_INLINE void * (*monotone_queue::malloc_fptr)(size_t) = nullptr;
+MONOTONE_QUEUE_INLINE void (*monotone_queue::free_fptr)(void*)      = nullptr;
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::register_malloc(void *(*malloc)(size_t)) {
+    monotone_queue::malloc_fptr = malloc;
+}
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::register_free(void (*free)(void*)) {
+    monotone_queue::free_fptr = free;
+}
+
+MONOTONE_QUEUE_INLINE monotone_queue::monotone_queue()
+    : last(0), heap(nullptr), heap_size(0), heap_capacity(0),
+      binary_heap(false), mq_size(0) {
+    for (size_t b = 0; b < MONOTONE_BUCKETS; b++) {
+        buckets[b]         = nullptr;
+        bucket_size[b]     = 0;
+        bucket_capacity[b] = 0;
+    }
+}
+
+MONOTONE_QUEUE_INLINE monotone_queue::~monotone_queue() {
+    for (size_t b = 0; b < MONOTONE_BUCKETS; b++) {
+        if (buckets[b] != nullptr) {
+            monotone_queue::free_fptr(buckets[b]);
+        }
+    }
+    if (heap != nullptr) {
+        monotone_queue::free_fptr(heap);
+    }
+}
+
+MONOTONE_QUEUE_INLINE void *
+monotone_queue::operator new(size_t size) {
+    return monotone_queue::malloc_fptr(size);
+}
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::operator delete(void * ptr) {
+    monotone_queue::free_fptr(ptr);
+}
+
+// Bucket 0 for key == last, otherwise one past the highest bit in
+// which they differ.
+//
+static inline size_t
+monotone_bucket(uint64_t key, uint64_t last) {
+    return key == last ? 0 : 64 - __builtin_clzll(key ^ last);
+}
+
+// Makes room for needed entries, of which the first used are kept,
+// at least doubling the array.
+//
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::grow(struct monotone_entry ** entries, size_t * capacity, size_t used, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity < 8 ? 16 : *capacity * 2;
+    if (new_capacity < needed) {
+        new_capacity = needed;
+    }
+    struct monotone_entry * grown = static_cast<struct monotone_entry*>(
+        monotone_queue::malloc_fptr(new_capacity * sizeof(struct monotone_entry)));
+    if (grown == nullptr) {
+        return false;
+    }
+    if (used != 0) {
+        memcpy(grown, *entries, used * sizeof(struct monotone_entry));
+    }
+    if (*entries != nullptr) {
+        monotone_queue::free_fptr(*entries);
+    }
+    *entries  = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::sift_up(size_t index) {
+    struct monotone_entry entry = heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (heap[parent].key <= entry.key) break;
+        heap[index] = heap[parent];
+        index       = parent;
+    }
+    heap[index] = entry;
+}
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::sift_down(size_t index) {
+    struct monotone_entry entry = heap[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= heap_size) break;
+        if (child + 1 < heap_size && heap[child + 1].key < heap[child].key) {
+            ++child;
+        }
+        if (entry.key <= heap[child].key) break;
+        heap[index] = heap[child];
+        index       = child;
+    }
+    heap[index] = entry;
+}
+
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::use_binary_heap() {
+    if (binary_heap) {
+        return true;
+    }
+    if (!grow(&heap, &heap_capacity, 0, mq_size)) {
+        return false;
+    }
+    heap_size = 0;
+    for (size_t b = 0; b < MONOTONE_BUCKETS; b++) {
+        if (bucket_size[b] != 0) {
+            memcpy(heap + heap_size, buckets[b], bucket_size[b] * sizeof(struct monotone_entry));
+        }
+        heap_size     += bucket_size[b];
+        bucket_size[b] = 0;
+    }
+    for (size_t index = heap_size / 2; index > 0; index--) {
+        sift_down(index - 1);
+    }
+    binary_heap = true;
+    return true;
+}
+
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::is_binary_heap() const {
+    return binary_heap;
+}
+
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::push(uint64_t key, unsigned int value) {
+    if (!binary_heap) {
+        // An empty queue has no order to keep, and can start over
+        // from a smaller key.
+        //
+        if (key < last) {
+            if (mq_size == 0) {
+                last = key;
+            } else if (!use_binary_heap()) {
+                return false;
+            }
+        }
+    }
+    if (binary_heap) {
+        if (!grow(&heap, &heap_capacity, heap_size, heap_size + 1)) {
+            return false;
+        }
+        heap[heap_size].key   = key;
+        heap[heap_size].value = value;
+        sift_up(heap_size++);
+    } else {
+        size_t b = monotone_bucket(key, last);
+        if (!grow(&buckets[b], &bucket_capacity[b], bucket_size[b], bucket_size[b] + 1)) {
+            return false;
+        }
+        buckets[b][bucket_size[b]].key   = key;
+        buckets[b][bucket_size[b]].value = value;
+        ++bucket_size[b];
+    }
+    ++mq_size;
+    return true;
+}
+
+// Takes the smallest key of the first non-empty bucket as last and
+// redistributes that bucket, which puts at least its minimum into
+// bucket 0 and every other element into a lower bucket than before.
+// Every bucket that receives elements is grown first, so that on
+// allocation failure nothing has moved and last is unchanged.
+//
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::refill_bucket_zero() {
+    size_t source = 1;
+    while (bucket_size[source] == 0) {
+        ++source;
+    }
+    struct monotone_entry * entries = buckets[source];
+    size_t count   = bucket_size[source];
+    uint64_t least = entries[0].key;
+    for (size_t k = 1; k < count; k++) {
+        if (entries[k].key < least) least = entries[k].key;
+    }
+
+    size_t incoming[MONOTONE_BUCKETS];
+    memset(incoming, 0, source * sizeof(size_t));
+    for (size_t k = 0; k < count; k++) {
+        ++incoming[monotone_bucket(entries[k].key, least)];
+    }
+    for (size_t b = 0; b < source; b++) {
+        if (incoming[b] != 0 &&
+            !grow(&buckets[b], &bucket_capacity[b], bucket_size[b], bucket_size[b] + incoming[b])) {
+            return false;
+        }
+    }
+
+    last = least;
+    for (size_t k = 0; k < count; k++) {
+        size_t b = monotone_bucket(entries[k].key, last);
+        buckets[b][bucket_size[b]++] = entries[k];
+    }
+    bucket_size[source] = 0;
+    return true;
+}
+
+MONOTONE_QUEUE_INLINE bool
+monotone_queue::pop(uint64_t * key, unsigned int * value) {
+    if (mq_size == 0) {
+        return false;
+    }
+    struct monotone_entry entry;
+    if (binary_heap) {
+        entry   = heap[0];
+        heap[0] = heap[--heap_size];
+        if (heap_size > 1) {
+            sift_down(0);
+        }
+    } else {
+        if (bucket_size[0] == 0 && !refill_bucket_zero()) {
+            return false;
+        }
+        entry = buckets[0][--bucket_size[0]];
+    }
+    --mq_size;
+    *key   = entry.key;
+    *value = entry.value;
+    return true;
+}
+
+MONOTONE_QUEUE_INLINE size_t
+monotone_queue::size() const {
+    return mq_size;
+}
+
+MONOTONE_QUEUE_INLINE void
+monotone_queue::clear() {
+    for (size_t b = 0; b < MONOTONE_BUCKETS; b++) {
+        bucket_size[b] = 0;
+    }
+    heap_size   = 0;
+    binary_heap = false;
+    last        = 0;
+    mq_size     = 0;
+}
+
+#endif
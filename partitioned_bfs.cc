@@ -0,0 +1,556 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "partitioned_bfs.h"
+#include "timing.h"
+
+// Bytes in the ring buffer of every ordered pair of workers.
+//
+#define PARTITION_RING_BYTES (256 * 1024)
+
+// Neighbors batched per destination before they are sent.
+//
+#define PARTITION_BATCH 1024
+
+// Every message starts with its encoded size and its vertex count.
+// A message of no vertices marks the end of the sender's level.
+//
+struct message_header {
+    uint32_t bytes;
+    uint32_t count;
+};
+
+// Worst case message, every delta taking five varint bytes.
+//
+#define PARTITION_MAX_MESSAGE (sizeof(struct message_header) + 5 * PARTITION_BATCH)
+
+// head and tail count every byte ever written and read. Only the
+// sender moves head, only the receiver moves tail, each on its own
+// cache line.
+//
+struct partition_ring {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint8_t data[PARTITION_RING_BYTES];
+};
+
+// Written by its worker only, read by the parent between queries.
+//
+struct alignas(64) worker_slot {
+    bool setup_failed;
+    size_t nodes_visited;
+    size_t edges_scanned;
+    size_t messages;
+    size_t vertices_sent;
+    size_t bytes_sent;
+};
+
+struct partition_control {
+    // The parent and every worker meet at query_barrier before and
+    // after each query, the workers alone at level_barrier after
+    // each level.
+    //
+    pthread_barrier_t query_barrier;
+    pthread_barrier_t level_barrier;
+
+    unsigned int from;
+    unsigned int to;
+    bool quit;
+    size_t process_count;
+    unsigned int bounds[PARTITION_MAX_PROCESSES + 1];
+
+    // Sums over the workers for the level just finished, alternating
+    // between two slots. Worker 0 clears the next level's slot after
+    // the barrier, which it does before it sends anything for that
+    // level, so no worker can add to it earlier.
+    //
+    std::atomic<uint64_t> frontier_total[2];
+    std::atomic<uint64_t> found_total[2];
+
+    // Set by whichever worker sees the target, so the others can stop
+    // expanding early. Whether the search goes on is only decided by
+    // found_total.
+    //
+    std::atomic<bool> found_hint;
+
+    bool found_path;
+    size_t levels;
+
+    struct worker_slot slots[PARTITION_MAX_PROCESSES];
+};
+
+// Lives in the worker process only.
+//
+struct partition_worker {
+    struct partition_control * control;
+    struct partition_ring * rings;
+    size_t id;
+    size_t process_count;
+    unsigned int first;
+    unsigned int last;
+
+    // The rows of first through last - 1, CSR style.
+    //
+    size_t * offsets;
+    unsigned int * neighbors;
+
+    uint64_t * visited;
+    unsigned int * frontier;
+    unsigned int * next_frontier;
+    size_t next_count;
+
+    unsigned int * batches;
+    size_t * batch_counts;
+    uint8_t * encoded;
+    size_t end_markers;
+};
+
+static struct partition_ring * ring_between(struct partition_worker * worker, size_t from, size_t to) {
+    return &worker->rings[from * worker->process_count + to];
+}
+
+static size_t owner_of(const struct partition_control * control, unsigned int v) {
+    size_t low  = 0;
+    size_t high = control->process_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (control->bounds[middle] <= v) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void visit(struct partition_worker * worker, unsigned int v) {
+    unsigned int local = v - worker->first;
+    uint64_t bit       = 1UL << (local % 64);
+    if ((worker->visited[local / 64] & bit) == 0) {
+        worker->visited[local / 64] |= bit;
+        worker->next_frontier[worker->next_count++] = v;
+    }
+}
+
+static void ring_read(const struct partition_ring * ring, uint64_t position, void * to, size_t bytes) {
+    size_t start = position % PARTITION_RING_BYTES;
+    size_t first = std::min(bytes, (size_t)PARTITION_RING_BYTES - start);
+    memcpy(to, ring->data + start, first);
+    memcpy(static_cast<uint8_t*>(to) + first, ring->data, bytes - first);
+}
+
+static void ring_write(struct partition_ring * ring, uint64_t position, const void * from, size_t bytes) {
+    size_t start = position % PARTITION_RING_BYTES;
+    size_t first = std::min(bytes, (size_t)PARTITION_RING_BYTES - start);
+    memcpy(ring->data + start, from, first);
+    memcpy(ring->data, static_cast<const uint8_t*>(from) + first, bytes - first);
+}
+
+// Takes every complete message waiting for this worker, visiting the
+// vertices in it. Returns how many messages there were.
+//
+static size_t drain_messages(struct partition_worker * worker) {
+    size_t taken = 0;
+    for (size_t peer = 0; peer < worker->process_count; peer++) {
+        if (peer == worker->id) continue;
+        struct partition_ring * ring = ring_between(worker, peer, worker->id);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (head - tail >= sizeof(struct message_header)) {
+            struct message_header header;
+            ring_read(ring, tail, &header, sizeof(header));
+            ring_read(ring, tail + sizeof(header), worker->encoded, header.bytes);
+            tail += sizeof(header) + header.bytes;
+            ++taken;
+
+            if (header.count == 0) {
+                ++worker->end_markers;
+                continue;
+            }
+            const uint8_t * in = worker->encoded;
+            unsigned int v     = 0;
+            for (uint32_t k = 0; k < header.count; k++) {
+                unsigned int delta = 0;
+                unsigned int shift = 0;
+                while (*in & 0x80) {
+                    delta |= (unsigned int)(*in++ & 0x7f) << shift;
+                    shift += 7;
+                }
+                delta |= (unsigned int)(*in++) << shift;
+                v     += delta;
+                visit(worker, v);
+            }
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return taken;
+}
+
+// Sends the batch for peer, or the end of level marker if it is
+// empty, draining this worker's own rings while the peer's ring is
+// full so that two workers sending to each other cannot deadlock.
+//
+static void send_batch(struct partition_worker * worker, size_t peer) {
+    unsigned int * batch = worker->batches + peer * PARTITION_BATCH;
+    size_t count         = worker->batch_counts[peer];
+    worker->batch_counts[peer] = 0;
+
+    // Sorted, the deltas are small and mostly take one or two bytes,
+    // and repeats of a vertex are dropped.
+    //
+    std::sort(batch, batch + count);
+    count = std::unique(batch, batch + count) - batch;
+    uint8_t message[PARTITION_MAX_MESSAGE];
+    uint8_t * out    = message + sizeof(struct message_header);
+    unsigned int previous = 0;
+    for (size_t k = 0; k < count; k++) {
+        unsigned int delta = batch[k] - previous;
+        previous           = batch[k];
+        while (delta >= 0x80) {
+            *out++  = (delta & 0x7f) | 0x80;
+            delta >>= 7;
+        }
+        *out++ = delta;
+    }
+    struct message_header header;
+    header.bytes = out - message - sizeof(header);
+    header.count = count;
+    memcpy(message, &header, sizeof(header));
+    size_t bytes = out - message;
+
+    struct partition_ring * ring = ring_between(worker, worker->id, peer);
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    while (PARTITION_RING_BYTES - (head - ring->tail.load(std::memory_order_acquire)) < bytes) {
+        if (drain_messages(worker) == 0) {
+            sched_yield();
+        }
+    }
+    ring_write(ring, head, message, bytes);
+    ring->head.store(head + bytes, std::memory_order_release);
+
+    struct worker_slot * slot = &worker->control->slots[worker->id];
+    ++slot->messages;
+    slot->vertices_sent += count;
+    slot->bytes_sent    += bytes;
+}
+
+static void search(struct partition_worker * worker) {
+    struct partition_control * control = worker->control;
+    struct worker_slot * slot          = &control->slots[worker->id];
+    unsigned int to = control->to;
+    memset(worker->visited, 0, ((worker->last - worker->first) + 63) / 64 * sizeof(uint64_t));
+
+    size_t frontier_count = 0;
+    if (control->from >= worker->first && control->from < worker->last) {
+        worker->next_count = 0;
+        visit(worker, control->from);
+        std::swap(worker->frontier, worker->next_frontier);
+        frontier_count = 1;
+    }
+
+    for (size_t level = 0; ; level++) {
+        worker->next_count  = 0;
+        worker->end_markers = 0;
+        bool found_path     = false;
+        for (size_t k = 0; k < frontier_count; k++) {
+            if (control->found_hint.load(std::memory_order_relaxed)) {
+                break;
+            }
+            unsigned int local = worker->frontier[k] - worker->first;
+            ++slot->nodes_visited;
+            for (size_t e = worker->offsets[local]; e < worker->offsets[local + 1]; e++) {
+                unsigned int data = worker->neighbors[e];
+                if (data == to) {
+                    found_path = true;
+                }
+                size_t owner = owner_of(control, data);
+                if (owner == worker->id) {
+                    visit(worker, data);
+                } else {
+                    worker->batches[owner * PARTITION_BATCH + worker->batch_counts[owner]] = data;
+                    if (++worker->batch_counts[owner] == PARTITION_BATCH) {
+                        send_batch(worker, owner);
+                    }
+                }
+            }
+            slot->edges_scanned += worker->offsets[local + 1] - worker->offsets[local];
+            if (found_path) {
+                control->found_hint.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        for (size_t peer = 0; peer < worker->process_count; peer++) {
+            if (peer == worker->id) continue;
+            if (worker->batch_counts[peer] != 0) {
+                send_batch(worker, peer);
+            }
+            send_batch(worker, peer);
+        }
+        while (worker->end_markers < worker->process_count - 1) {
+            if (drain_messages(worker) == 0) {
+                sched_yield();
+            }
+        }
+
+        control->frontier_total[level % 2].fetch_add(worker->next_count);
+        control->found_total[level % 2].fetch_add(found_path ? 1 : 0);
+        pthread_barrier_wait(&control->level_barrier);
+        bool done = control->found_total[level % 2].load() != 0 ||
+                    control->frontier_total[level % 2].load() == 0;
+        if (worker->id == 0) {
+            control->frontier_total[(level + 1) % 2].store(0);
+            control->found_total[(level + 1) % 2].store(0);
+            if (done) {
+                control->found_path = control->found_total[level % 2].load() != 0;
+                control->levels     = level + 1;
+            }
+        }
+        if (done) {
+            break;
+        }
+        std::swap(worker->frontier, worker->next_frontier);
+        frontier_count = worker->next_count;
+    }
+}
+
+// Copies the worker's rows out of the parent's graph, so that the
+// adjacency it searches is its own memory, first touched by it.
+//
+static bool setup_worker(struct partition_worker * worker) {
+    size_t vertices = worker->last - worker->first;
+    size_t edges    = 0;
+    for (unsigned int v = worker->first; v < worker->last; v++) {
+        edges += rows[v] == NULL ? 0 : rows[v]->size;
+    }
+    worker->offsets       = static_cast<size_t*>(malloc((vertices + 1) * sizeof(size_t)));
+    worker->neighbors     = static_cast<unsigned int*>(malloc((edges + 1) * sizeof(unsigned int)));
+    worker->visited       = static_cast<uint64_t*>(malloc((vertices + 63) / 64 * sizeof(uint64_t) + 1));
+    worker->frontier      = static_cast<unsigned int*>(malloc((vertices + 1) * sizeof(unsigned int)));
+    worker->next_frontier = static_cast<unsigned int*>(malloc((vertices + 1) * sizeof(unsigned int)));
+    worker->batches       = static_cast<unsigned int*>(
+        malloc(worker->process_count * PARTITION_BATCH * sizeof(unsigned int)));
+    worker->batch_counts  = static_cast<size_t*>(calloc(worker->process_count, sizeof(size_t)));
+    worker->encoded       = static_cast<uint8_t*>(malloc(PARTITION_MAX_MESSAGE));
+    if (worker->offsets == NULL || worker->neighbors == NULL || worker->visited == NULL ||
+        worker->frontier == NULL || worker->next_frontier == NULL || worker->batches == NULL ||
+        worker->batch_counts == NULL || worker->encoded == NULL) {
+        return false;
+    }
+
+    size_t used = 0;
+    for (unsigned int v = worker->first; v < worker->last; v++) {
+        worker->offsets[v - worker->first] = used;
+        if (rows[v] != NULL) {
+            memcpy(worker->neighbors + used, rows[v]->adjacent_nodes, rows[v]->size * sizeof(unsigned int));
+            used += rows[v]->size;
+        }
+    }
+    worker->offsets[vertices] = used;
+    return true;
+}
+
+static void pin_to_cpu(size_t id) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online <= 0) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(id % online, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+static void worker_main(struct partition_control * control, struct partition_ring * rings, size_t id) {
+    pin_to_cpu(id);
+    struct partition_worker worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.control       = control;
+    worker.rings         = rings;
+    worker.id            = id;
+    worker.process_count = control->process_count;
+    worker.first         = control->bounds[id];
+    worker.last          = control->bounds[id + 1];
+    control->slots[id].setup_failed = !setup_worker(&worker);
+
+    // Ready, then one round per query until told to quit.
+    //
+    pthread_barrier_wait(&control->query_barrier);
+    while (true) {
+        pthread_barrier_wait(&control->query_barrier);
+        if (control->quit) {
+            break;
+        }
+        search(&worker);
+        pthread_barrier_wait(&control->query_barrier);
+    }
+    _exit(0);
+}
+
+// Splits the vertices into process_count ranges of about the same
+// number of edges.
+//
+static void partition_vertices(struct partition_control * control) {
+    size_t total = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        total += rows[v] == NULL ? 0 : rows[v]->size;
+    }
+    size_t seen = 0;
+    size_t w    = 1;
+    control->bounds[0] = 0;
+    for (size_t v = 0; v < row_count && w < control->process_count; v++) {
+        while (w < control->process_count && seen >= total * w / control->process_count) {
+            control->bounds[w++] = v;
+        }
+        seen += rows[v] == NULL ? 0 : rows[v]->size;
+    }
+    while (w <= control->process_count) {
+        control->bounds[w++] = row_count;
+    }
+}
+
+long run_partitioned_queries(const struct query * queries,
+                             size_t query_count,
+                             size_t process_count,
+                             struct search_result * results,
+                             struct partition_stats * stats) {
+    if (process_count == 0 || process_count > PARTITION_MAX_PROCESSES) {
+        printf("Process count must be 1 through %d.\n", PARTITION_MAX_PROCESSES);
+        return -1;
+    }
+
+    size_t control_bytes = (sizeof(struct partition_control) + 63) / 64 * 64;
+    size_t shared_bytes  = control_bytes + process_count * process_count * sizeof(struct partition_ring);
+    void * shared = mmap(NULL, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("Failed to map %ld bytes of shared memory.\n", shared_bytes);
+        return -1;
+    }
+    struct partition_control * control = new (shared) partition_control();
+    struct partition_ring * rings = reinterpret_cast<struct partition_ring*>(
+        static_cast<uint8_t*>(shared) + control_bytes);
+    for (size_t r = 0; r < process_count * process_count; r++) {
+        new (&rings[r]) partition_ring();
+        rings[r].head.store(0);
+        rings[r].tail.store(0);
+    }
+
+    pthread_barrierattr_t attributes;
+    pthread_barrierattr_init(&attributes);
+    pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&control->query_barrier, &attributes, process_count + 1);
+    pthread_barrier_init(&control->level_barrier, &attributes, process_count);
+    pthread_barrierattr_destroy(&attributes);
+    control->process_count = process_count;
+    control->quit          = false;
+    partition_vertices(control);
+
+    // Nothing buffered may be written twice, by the parent and again
+    // by a worker.
+    //
+    fflush(stdout);
+    pid_t * workers = static_cast<pid_t*>(malloc(process_count * sizeof(pid_t)));
+    size_t forked   = 0;
+    bool ok         = workers != NULL;
+    for (size_t w = 0; w < process_count && ok; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            worker_main(control, rings, w);
+        }
+        ok = pid > 0;
+        if (ok) {
+            workers[forked++] = pid;
+        }
+    }
+
+    long nanoseconds = -1;
+    if (!ok) {
+        // The barriers would never fill up.
+        //
+        printf("Failed to fork worker processes.\n");
+        for (size_t w = 0; w < forked; w++) {
+            kill(workers[w], SIGKILL);
+        }
+    } else {
+        pthread_barrier_wait(&control->query_barrier);
+        for (size_t w = 0; w < process_count; w++) {
+            ok = ok && !control->slots[w].setup_failed;
+        }
+        if (!ok) {
+            printf("Failed to allocate worker partitions.\n");
+        }
+
+        struct timespec run_start, run_stop;
+        GRAB_CLOCK(run_start)
+        stats->levels = 0;
+        for (size_t k = 0; k < query_count && ok; k++) {
+            size_t nodes_before = 0;
+            size_t edges_before = 0;
+            for (size_t w = 0; w < process_count; w++) {
+                nodes_before += control->slots[w].nodes_visited;
+                edges_before += control->slots[w].edges_scanned;
+            }
+            control->from = queries[k].from;
+            control->to   = queries[k].to;
+            control->frontier_total[0].store(0);
+            control->frontier_total[1].store(0);
+            control->found_total[0].store(0);
+            control->found_total[1].store(0);
+            control->found_hint.store(false);
+
+            struct timespec start, stop;
+            GRAB_CLOCK(start)
+            pthread_barrier_wait(&control->query_barrier);
+            pthread_barrier_wait(&control->query_barrier);
+            GRAB_CLOCK(stop)
+
+            results[k].found_path    = control->found_path;
+            results[k].nodes_visited = 0;
+            results[k].edges_scanned = 0;
+            for (size_t w = 0; w < process_count; w++) {
+                results[k].nodes_visited += control->slots[w].nodes_visited;
+                results[k].edges_scanned += control->slots[w].edges_scanned;
+            }
+            results[k].nodes_visited -= nodes_before;
+            results[k].edges_scanned -= edges_before;
+            results[k].nanoseconds    = compute_timespec_diff(start, stop);
+            stats->levels            += control->levels;
+        }
+        GRAB_CLOCK(run_stop)
+        if (ok) {
+            nanoseconds = compute_timespec_diff(run_start, run_stop);
+        }
+
+        control->quit = true;
+        pthread_barrier_wait(&control->query_barrier);
+    }
+    for (size_t w = 0; w < forked; w++) {
+        waitpid(workers[w], NULL, 0);
+    }
+
+    stats->messages      = 0;
+    stats->vertices_sent = 0;
+    stats->bytes_sent    = 0;
+    for (size_t w = 0; w < process_count; w++) {
+        stats->messages      += control->slots[w].messages;
+        stats->vertices_sent += control->slots[w].vertices_sent;
+        stats->bytes_sent    += control->slots[w].bytes_sent;
+    }
+
+    pthread_barrier_destroy(&control->query_barrier);
+    pthread_barrier_destroy(&control->level_barrier);
+    munmap(shared, shared_bytes);
+    free(workers);
+    return nanoseconds;
+}
@@ -0,0 +1,48 @@
+#ifndef PARTITIONED_BFS_H_
+#define PARTITIONED_BFS_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+#include "query_scheduler.h"
+
+// Most worker processes run_partitioned_queries() takes.
+//
+#define PARTITION_MAX_PROCESSES 64
+
+// Message traffic between the workers over a whole run.
+//
+struct partition_stats {
+    size_t levels;
+    size_t messages;
+    size_t vertices_sent;
+    size_t bytes_sent;
+};
+
+// Runs every query with one BFS spread over process_count worker
+// processes, forked from this one once the graph is loaded.
+//
+// The vertex ids are split into process_count ranges with about as
+// many edges each, and each worker copies the rows of its range into
+// adjacency of its own and only ever touches that. The search is
+// level synchronous: a worker expands the part of the frontier it
+// owns and sends every neighbor owned by another worker to it.
+// Neighbors are sent in batches, sorted and delta encoded as
+// varints, through a single-producer single-consumer ring buffer in
+// shared memory for every pair of workers. A level ends once every
+// worker has told every other one that it is done, and a barrier
+// then decides whether another level is needed.
+//
+// Workers are pinned round robin to the online CPUs where the kernel
+// allows it. results[k] receives the outcome of queries[k], with
+// nodes_visited counting the vertices expanded. Returns the wall
+// clock time of the whole run in nanoseconds, or -1 if the workers
+// could not be set up.
+//
+long run_partitioned_queries(const struct query * queries,
+                             size_t query_count,
+                             size_t process_count,
+                             struct search_result * results,
+                             struct partition_stats * stats);
+
+#endif
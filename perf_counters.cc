@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct perf_event_spec {
+    uint32_t type;
+    uint64_t config;
+};
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct perf_event_spec event_specs[PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    // L1D_PEND_MISS.PENDING, and the same event with a counter mask
+    // of 1, counting cycles instead.
+    //
+    { PERF_TYPE_RAW, 0x0148 },
+    { PERF_TYPE_RAW, 0x01000148 },
+};
+
+// File descriptor per counter, -1 if it could not be opened. The
+// group leader is the first counter that opened. Members appear in
+// group reads in the order they were opened, which is counter order.
+//
+static int event_fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+static int leader_fd = -1;
+static int mlp_leader_fd = -1;
+
+// The raw event numbers above only mean L1D_PEND_MISS on Intel.
+//
+static bool cpu_is_intel(void) {
+    FILE * cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL) {
+        return false;
+    }
+    char line[256];
+    bool intel = false;
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        if (strncmp(line, "vendor_id", 9) == 0) {
+            intel = strstr(line, "GenuineIntel") != NULL;
+            break;
+        }
+    }
+    fclose(cpuinfo);
+    return intel;
+}
+
+static int open_event(const struct perf_event_spec * spec, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = spec->type;
+    attr.config         = spec->config;
+    attr.disabled       = group_fd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP |
+                          PERF_FORMAT_TOTAL_TIME_ENABLED |
+                          PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void open_group(size_t first_counter, size_t counter_limit, int * leader) {
+    for (size_t c = first_counter; c < counter_limit; c++) {
+        event_fds[c] = open_event(&event_specs[c], *leader);
+        if (event_fds[c] >= 0 && *leader == -1) {
+            *leader = event_fds[c];
+        }
+    }
+}
+
+static void close_group(size_t first_counter, size_t counter_limit, int * leader) {
+    for (size_t c = first_counter; c < counter_limit; c++) {
+        if (event_fds[c] >= 0) {
+            close(event_fds[c]);
+        }
+        event_fds[c] = -1;
+    }
+    *leader = -1;
+}
+
+// A group with more events than the PMU has counters opens fine
+// but never gets scheduled, which shows up as zero running time.
+//
+static bool group_is_schedulable(int leader) {
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    for (volatile int spin = 0; spin < 100000; spin++) {
+    }
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t data[3 + PERF_COUNTER_COUNT];
+    ssize_t bytes = read(leader, data, sizeof(data));
+    return bytes >= (ssize_t)(3 * sizeof(uint64_t)) && data[2] > 0;
+}
+
+bool setup_perf_events(void) {
+    open_group(0, PERF_FIRST_MLP_COUNTER, &leader_fd);
+    if (leader_fd == -1) {
+        printf("Hardware performance counters unavailable (perf_event_open: %s).\n",
+               strerror(errno));
+        printf("Check /proc/sys/kernel/perf_event_paranoid, or whether the VM exposes a PMU.\n");
+        return false;
+    }
+
+    if (!group_is_schedulable(leader_fd)) {
+        // Fall back to the two counters every PMU has.
+        //
+        close_perf_events();
+        open_group(0, PERF_INSTRUCTIONS + 1, &leader_fd);
+        if (leader_fd == -1 || !group_is_schedulable(leader_fd)) {
+            close_perf_events();
+            printf("Hardware performance counters could not be scheduled.\n");
+            return false;
+        }
+    }
+
+    if (cpu_is_intel()) {
+        open_group(PERF_FIRST_MLP_COUNTER, PERF_COUNTER_COUNT, &mlp_leader_fd);
+        if (mlp_leader_fd != -1 && !group_is_schedulable(mlp_leader_fd)) {
+            close_group(PERF_FIRST_MLP_COUNTER, PERF_COUNTER_COUNT, &mlp_leader_fd);
+        }
+    }
+
+    for (size_t c = 0; c < PERF_FIRST_MLP_COUNTER; c++) {
+        if (event_fds[c] < 0) {
+            printf("Hardware counter %s unavailable.\n",
+                   perf_counter_name((enum perf_counter)c));
+        }
+    }
+    if (mlp_leader_fd == -1) {
+        printf("L1D pending miss counters unavailable, no memory-level parallelism figures.\n");
+    }
+    return true;
+}
+
+bool perf_counters_available(void) {
+    return leader_fd != -1;
+}
+
+void close_perf_events(void) {
+    close_group(0, PERF_FIRST_MLP_COUNTER, &leader_fd);
+    close_group(PERF_FIRST_MLP_COUNTER, PERF_COUNTER_COUNT, &mlp_leader_fd);
+}
+
+void reset_and_start_perf_counters(void) {
+    if (leader_fd == -1) return;
+    ioctl(leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    if (mlp_leader_fd == -1) return;
+    ioctl(mlp_leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(mlp_leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void stop_perf_counters(void) {
+    if (leader_fd == -1) return;
+    ioctl(leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (mlp_leader_fd == -1) return;
+    ioctl(mlp_leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static void read_group(size_t first_counter, size_t counter_limit, int leader,
+                       uint64_t * counters) {
+    if (leader == -1) return;
+
+    // nr, time_enabled, time_running, then one value per member.
+    //
+    uint64_t data[3 + PERF_COUNTER_COUNT];
+    ssize_t bytes = read(leader, data, sizeof(data));
+    if (bytes < (ssize_t)(3 * sizeof(uint64_t))) return;
+
+    uint64_t enabled = data[1];
+    uint64_t running = data[2];
+    size_t member    = 0;
+    for (size_t c = first_counter; c < counter_limit && member < data[0]; c++) {
+        if (event_fds[c] < 0) continue;
+        uint64_t value = data[3 + member++];
+        if (running > 0 && running < enabled) {
+            value = (uint64_t)((double)value * (double)enabled / (double)running);
+        }
+        counters[c] = running > 0 ? value : PERF_COUNTER_UNAVAILABLE;
+    }
+}
+
+void read_perf_data(uint64_t * counters) {
+    for (size_t c = 0; c < PERF_COUNTER_COUNT; c++) {
+        counters[c] = PERF_COUNTER_UNAVAILABLE;
+    }
+    read_group(0, PERF_FIRST_MLP_COUNTER, leader_fd, counters);
+    read_group(PERF_FIRST_MLP_COUNTER, PERF_COUNTER_COUNT, mlp_leader_fd, counters);
+}
+#else
+bool setup_perf_events(void) {
+    printf("Hardware performance counters need Linux perf_event_open().\n");
+    return false;
+}
+
+bool perf_counters_available(void) {
+    return false;
+}
+
+void close_perf_events(void) {
+}
+
+void reset_and_start_perf_counters(void) {
+}
+
+void stop_perf_counters(void) {
+}
+
+void read_perf_data(uint64_t * counters) {
+    for (size_t c = 0; c < PERF_COUNTER_COUNT; c++) {
+        counters[c] = PERF_COUNTER_UNAVAILABLE;
+    }
+}
+#endif
+
+const char * perf_counter_name(enum perf_counter counter) {
+    switch (counter) {
+        case PERF_CYCLES:             return "cycles";
+        case PERF_INSTRUCTIONS:       return "instructions";
+        case PERF_L1D_READ_MISSES:    return "L1D read misses";
+        case PERF_LLC_READ_MISSES:    return "LLC read misses";
+        case PERF_DTLB_READ_MISSES:   return "dTLB read misses";
+        case PERF_BRANCH_MISSES:      return "branch misses";
+        case PERF_L1D_PENDING_MISSES: return "L1D pending misses";
+        case PERF_L1D_PENDING_CYCLES: return "L1D pending miss cycles";
+        default:                      return "unknown";
+    }
+}
+
+void print_perf_summary(const char * prefix, const uint64_t * counters, size_t edges) {
+    uint64_t cycles       = counters[PERF_CYCLES];
+    uint64_t instructions = counters[PERF_INSTRUCTIONS];
+    if (cycles != PERF_COUNTER_UNAVAILABLE && instructions != PERF_COUNTER_UNAVAILABLE) {
+        printf("%scycles: %lu instructions: %lu IPC: %0.3f\n", prefix, cycles, instructions,
+               cycles == 0 ? 0.0 : (double)instructions / (double)cycles);
+    }
+
+    uint64_t pending        = counters[PERF_L1D_PENDING_MISSES];
+    uint64_t pending_cycles = counters[PERF_L1D_PENDING_CYCLES];
+    if (pending != PERF_COUNTER_UNAVAILABLE && pending_cycles != PERF_COUNTER_UNAVAILABLE &&
+        pending_cycles != 0) {
+        printf("%sMLP: %0.2f L1D misses outstanding per miss cycle, %0.3f per cycle, "
+               "%0.1f%% of cycles with a miss outstanding\n", prefix,
+               (double)pending / (double)pending_cycles,
+               cycles == PERF_COUNTER_UNAVAILABLE || cycles == 0 ? 0.0 : (double)pending / (double)cycles,
+               cycles == PERF_COUNTER_UNAVAILABLE || cycles == 0 ? 0.0 : 100.0 * (double)pending_cycles / (double)cycles);
+    }
+
+    if (edges == 0) {
+        return;
+    }
+
+    bool any = false;
+    for (size_t c = 0; c < PERF_FIRST_MLP_COUNTER; c++) {
+        if (c == PERF_INSTRUCTIONS || counters[c] == PERF_COUNTER_UNAVAILABLE) continue;
+        printf("%s%s per edge: %0.4f", any ? ", " : prefix,
+               perf_counter_name((enum perf_counter)c), (double)counters[c] / (double)edges);
+        any = true;
+    }
+    if (any) {
+        printf("\n");
+    }
+}
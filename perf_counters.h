@@ -0,0 +1,64 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware performance counters through Linux perf_event_open(),
+// the portable counterpart of the ARM PMU code. Counts only the
+// calling thread, in user space, so it works with the default
+// perf_event_paranoid setting.
+//
+// The events are opened as one group so that they are scheduled
+// onto the PMU together and their ratios are meaningful. Events
+// the CPU or hypervisor does not offer are left out of the group
+// and read back as PERF_COUNTER_UNAVAILABLE.
+//
+// The L1D pending miss counters are Intel's L1D_PEND_MISS events,
+// opened as a second group so that they cannot push the first one
+// off a small PMU. PENDING adds up the misses outstanding in every
+// cycle and PENDING_CYCLES counts the cycles with at least one, so
+// their ratio is the memory-level parallelism: how many misses
+// overlap while the core waits on memory.
+//
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_READ_MISSES,
+    PERF_LLC_READ_MISSES,
+    PERF_DTLB_READ_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_PENDING_MISSES,
+    PERF_L1D_PENDING_CYCLES,
+    PERF_COUNTER_COUNT
+};
+
+// The counters of the second group.
+//
+#define PERF_FIRST_MLP_COUNTER PERF_L1D_PENDING_MISSES
+
+#define PERF_COUNTER_UNAVAILABLE UINT64_MAX
+
+// Opens the counter group. Returns FALSE, after saying why, if no
+// counters are available, in which case the other calls are no-ops.
+//
+bool setup_perf_events(void);
+bool perf_counters_available(void);
+void close_perf_events(void);
+
+void reset_and_start_perf_counters(void);
+void stop_perf_counters(void);
+
+// Fills counters[PERF_COUNTER_COUNT]. Values are scaled up if the
+// kernel had to multiplex the group with other users of the PMU.
+//
+void read_perf_data(uint64_t * counters);
+
+const char * perf_counter_name(enum perf_counter counter);
+
+// Prints IPC, memory-level parallelism and, when edges is non-zero,
+// misses per edge scanned.
+//
+void print_perf_summary(const char * prefix, const uint64_t * counters, size_t edges);
+
+#endif
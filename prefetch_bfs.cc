@@ -0,0 +1,118 @@
+#include <stdio.h>
+
+#include "prefetch_bfs.h"
+#include "timing.h"
+#include "trace.h"
+
+// Frontier vertices popped from the queue at a time, and the ring
+// they wait in, deep enough for three stages at the maximum
+// distance plus a batch.
+//
+#define PREFETCH_BATCH     16
+#define PREFETCH_RING_SIZE 256
+#define PREFETCH_RING_MASK (PREFETCH_RING_SIZE - 1)
+
+size_t prefetch_distance = 8;
+
+bool prefetch_breadth_first_search(struct search_state * state,
+                                   unsigned int i, unsigned int j,
+                                   struct search_result * result) {
+    TRACE_SPAN("prefetch_bfs");
+    queue * q                    = state->q;
+    unsigned int * visited_epoch = state->visited_epoch;
+    unsigned int epoch           = next_search_epoch(state);
+    size_t distance              = prefetch_distance;
+
+    // Positions in the ring only ever grow, the mask maps them onto
+    // slots. Each stage has its own cursor, the next position it
+    // has not prefetched for, so every vertex goes through every
+    // stage once even when the frontier is too short to keep the
+    // ring full and the stages have to catch up.
+    //
+    unsigned int ring[PREFETCH_RING_SIZE];
+    size_t head        = 0;
+    size_t tail        = 0;
+    size_t slot_cursor = 0;
+    size_t row_cursor  = 0;
+    size_t adj_cursor  = 0;
+    ring[tail++ & PREFETCH_RING_MASK] = i;
+
+    bool found_path = false;
+    size_t edge_count = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    while (!found_path) {
+        if (tail - head <= 3 * distance) {
+            for (size_t b = 0; b < PREFETCH_BATCH && tail - head < PREFETCH_RING_SIZE; b++) {
+                if (!q->pop(&ring[tail & PREFETCH_RING_MASK])) break;
+                ++tail;
+            }
+        }
+        if (head == tail) {
+            break;
+        }
+
+        for (; slot_cursor < tail && slot_cursor < head + 3 * distance; slot_cursor++) {
+            unsigned int ahead = ring[slot_cursor & PREFETCH_RING_MASK];
+            __builtin_prefetch(&rows[ahead]);
+            __builtin_prefetch(&visited_epoch[ahead]);
+        }
+        for (; row_cursor < tail && row_cursor < head + 2 * distance; row_cursor++) {
+            struct row * ahead = rows[ring[row_cursor & PREFETCH_RING_MASK]];
+            if (ahead != NULL) {
+                __builtin_prefetch(ahead);
+            }
+        }
+        for (; adj_cursor < tail && adj_cursor < head + distance; adj_cursor++) {
+            struct row * ahead = rows[ring[adj_cursor & PREFETCH_RING_MASK]];
+            if (ahead != NULL) {
+                // The first two cache lines cover most rows.
+                //
+                __builtin_prefetch(ahead->adjacent_nodes);
+                if (ahead->size > 16) {
+                    __builtin_prefetch(ahead->adjacent_nodes + 16);
+                }
+            }
+        }
+
+        unsigned int next_node = ring[head++ & PREFETCH_RING_MASK];
+        struct row * row       = rows[next_node];
+        if (row == NULL || visited_epoch[next_node] == epoch) {
+            continue;
+        }
+        visited_epoch[next_node] = epoch;
+        edge_count += row->size;
+
+        bool push_error = false;
+        for (size_t node = 0; node < row->size; node++) {
+            unsigned int data = row->adjacent_nodes[node];
+            // Check if we found the node.
+            //
+            if (j == data) {
+                found_path = true;
+            }
+            if (!q->push(data)) {
+                push_error = true;
+                break;
+            }
+        }
+        if (push_error) {
+            printf("Error pushing into queue.\n");
+            break;
+        }
+    }
+
+    // Empty the queue so that it can be reused by the next search.
+    // The vertices still in the ring were already popped.
+    //
+    unsigned int discarded;
+    while (q->pop(&discarded)) {
+    }
+    GRAB_CLOCK(stop)
+
+    result->found_path    = found_path;
+    result->nodes_visited = head - 1;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
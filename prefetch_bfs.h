@@ -0,0 +1,37 @@
+#ifndef PREFETCH_BFS_H_
+#define PREFETCH_BFS_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+
+// A breadth first search that learns the addresses it will need
+// before it needs them.
+//
+// shared_breadth_first_search() only finds out which row to load
+// when it pops the next vertex, so every miss on the row array, the
+// row and its adjacency list is taken one after the other. This
+// engine pops the frontier into a small ring in batches and, for
+// the vertices ahead of the one it expands, prefetches in stages:
+//
+//     3 * distance ahead: the vertex's rows[] slot and visited entry
+//     2 * distance ahead: the row, read from the now cached slot
+//         distance ahead: the adjacency list, read from the row
+//
+// so each stage only dereferences what the previous one brought in,
+// and the misses of several vertices overlap. The ring keeps the
+// frontier's order, so the search expands the same vertices as
+// shared_breadth_first_search().
+//
+#define PREFETCH_MAX_DISTANCE 64
+
+// Vertices ahead of the one being expanded, per stage. 0 pops in
+// batches but prefetches nothing, a baseline for the pipeline.
+//
+extern size_t prefetch_distance;
+
+bool prefetch_breadth_first_search(struct search_state * state,
+                                   unsigned int i, unsigned int j,
+                                   struct search_result * result);
+
+#endif
@@ -0,0 +1,207 @@
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "query_scheduler.h"
+#include "timing.h"
+#include "trace.h"
+
+// A fixed capacity Chase-Lev work-stealing deque of query indices.
+//
+// All tasks are pushed by the owner before any worker starts, so
+// the buffer never has to grow and never wraps. After that the
+// owner pops from the bottom while any other thread may steal from
+// the top.
+//
+class work_stealing_deque {
+  public:
+    work_stealing_deque() : tasks(NULL), top(0), bottom(0) {}
+    ~work_stealing_deque() { free(tasks); }
+
+    bool reserve(size_t capacity) {
+        tasks = static_cast<size_t*>(malloc(capacity * sizeof(size_t)));
+        return tasks != NULL || capacity == 0;
+    }
+
+    // Owner only, and only before the workers are started.
+    //
+    void push(size_t task) {
+        long b = bottom.load(std::memory_order_relaxed);
+        tasks[b] = task;
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only. Returns FALSE when the deque is empty or the
+    // last task was lost to a thief.
+    //
+    bool pop(size_t * task) {
+        long b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *task = tasks[b];
+        if (t == b) {
+            // Last task, race any thieves for it.
+            //
+            bool won = top.compare_exchange_strong(t, t + 1,
+                                                   std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread. Returns FALSE when the deque is empty or another
+    // thread took the task first.
+    //
+    bool steal(size_t * task) {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return false;
+        }
+
+        size_t stolen = tasks[t];
+        if (!top.compare_exchange_strong(t, t + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return false;
+        }
+        *task = stolen;
+        return true;
+    }
+
+  private:
+    size_t * tasks;
+    std::atomic<long> top;
+    std::atomic<long> bottom;
+};
+
+struct worker {
+    size_t id;
+    struct search_state state;
+    work_stealing_deque tasks;
+};
+
+struct scheduler {
+    const struct query * queries;
+    size_t query_count;
+    struct search_result * results;
+    struct worker * workers;
+    size_t worker_count;
+
+    // Number of queries taken by some worker so far. Nothing is
+    // ever pushed once the workers run, so a worker is done once
+    // every query has been claimed.
+    //
+    std::atomic<size_t> claimed;
+};
+
+static bool claim_task(struct scheduler * scheduler,
+                       struct worker * self, size_t * task) {
+    if (self->tasks.pop(task)) {
+        return true;
+    }
+
+    for (size_t k = 1; k < scheduler->worker_count; k++) {
+        struct worker * victim = &scheduler->workers[(self->id + k) % scheduler->worker_count];
+        if (victim->tasks.steal(task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void worker_main(struct scheduler * scheduler, struct worker * self) {
+#if TRACING_ENABLED
+    char name[32];
+    snprintf(name, sizeof(name), "scheduler worker %ld", self->id);
+    TRACE_THREAD_NAME(name);
+    TRACE_SPAN_ARG("scheduler worker", self->id);
+#endif
+    while (scheduler->claimed.load(std::memory_order_relaxed) < scheduler->query_count) {
+        size_t task;
+        if (!claim_task(scheduler, self, &task)) {
+            std::this_thread::yield();
+            continue;
+        }
+        scheduler->claimed.fetch_add(1, std::memory_order_relaxed);
+
+        const struct query * query = &scheduler->queries[task];
+        search_fptr(&self->state, query->from, query->to,
+                                    &scheduler->results[task]);
+    }
+}
+
+long run_queries_concurrently(const struct query * queries,
+                              size_t query_count,
+                              size_t thread_count,
+                              struct search_result * results) {
+    struct scheduler scheduler;
+    scheduler.queries      = queries;
+    scheduler.query_count  = query_count;
+    scheduler.results      = results;
+    scheduler.worker_count = thread_count;
+    scheduler.claimed.store(0);
+    scheduler.workers      = new worker[thread_count];
+
+    // Set up per-worker state and deal out the queries before
+    // starting the clock, as the visited arrays are large.
+    //
+    bool setup_ok = true;
+    size_t initialized = 0;
+    for (size_t w = 0; w < thread_count; w++) {
+        struct worker * worker = &scheduler.workers[w];
+        worker->id = w;
+
+        size_t first = query_count * w / thread_count;
+        size_t last  = query_count * (w + 1) / thread_count;
+        if (!worker->tasks.reserve(last - first) ||
+            !init_search_state(&worker->state)) {
+            setup_ok = false;
+            break;
+        }
+        ++initialized;
+
+        // Pushed in reverse so the owner pops its block in order.
+        //
+        for (size_t task = last; task > first; task--) {
+            worker->tasks.push(task - 1);
+        }
+    }
+
+    long nanoseconds = -1;
+    if (setup_ok) {
+        struct timespec start, stop;
+        GRAB_CLOCK(start)
+        std::thread * threads = new std::thread[thread_count];
+        for (size_t w = 0; w < thread_count; w++) {
+            threads[w] = std::thread(worker_main, &scheduler, &scheduler.workers[w]);
+        }
+        for (size_t w = 0; w < thread_count; w++) {
+            threads[w].join();
+        }
+        GRAB_CLOCK(stop)
+        delete[] threads;
+        nanoseconds = compute_timespec_diff(start, stop);
+    } else {
+        printf("Failed to allocate search state for worker threads.\n");
+    }
+
+    for (size_t w = 0; w < initialized; w++) {
+        destroy_search_state(&scheduler.workers[w].state);
+    }
+    delete[] scheduler.workers;
+
+    return nanoseconds;
+}
@@ -0,0 +1,33 @@
+#ifndef QUERY_SCHEDULER_H_
+#define QUERY_SCHEDULER_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+
+// A single reachability query, read from the 'nodes' file.
+//
+struct query {
+    unsigned int from;
+    unsigned int to;
+};
+
+// Runs every query against the shared graph on thread_count
+// worker threads. The graph is only read, each worker searches
+// with its own search_state.
+//
+// Queries are dealt out in contiguous blocks to one work-stealing
+// deque per worker. A worker pops from the bottom of its own deque
+// and, once that is empty, steals from the top of the others, so
+// a worker that drew a block of long searches gets help.
+//
+// results[k] receives the outcome of queries[k] regardless of
+// which worker ran it. Returns the wall clock time of the whole
+// run in nanoseconds, or -1 if worker state could not be set up.
+//
+long run_queries_concurrently(const struct query * queries,
+                              size_t query_count,
+                              size_t thread_count,
+                              struct search_result * results);
+
+#endif
@@ -0,0 +1,589 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "graph.h"
+#include "query_server.h"
+#include "relabel.h"
+#include "timing.h"
+#include "trace.h"
+
+#define SERVER_READ_BUFFER_SIZE  65536
+#define SERVER_WRITE_BUFFER_SIZE 65536
+#define SERVER_RESPONSE_LENGTH   96
+
+struct response {
+    bool done;
+    char text[SERVER_RESPONSE_LENGTH];
+};
+
+// One client. Responses sit in a ring indexed by request sequence
+// number until every earlier response has been written, so answers
+// leave in request order however the workers finish.
+//
+struct connection {
+    int in_fd;
+    int out_fd;
+
+    std::mutex lock;
+    std::condition_variable drained;
+    struct response * responses;
+    size_t capacity;
+    size_t next_to_write;
+    size_t next_sequence;
+    bool flushing;
+    bool write_failed;
+};
+
+struct job {
+    struct connection * connection;
+    size_t sequence;
+    unsigned int from;
+    unsigned int to;
+    struct timespec received;
+};
+
+struct server {
+    // Pending jobs, a growable ring shared by every connection.
+    //
+    std::mutex lock;
+    std::condition_variable work_available;
+    struct job * jobs;
+    size_t job_capacity;
+    size_t job_head;
+    size_t job_count;
+    bool stopping;
+
+    // Service time of every answered request, for percentiles.
+    //
+    std::mutex stats_lock;
+    long * service_times;
+    size_t service_count;
+    size_t service_capacity;
+    size_t error_count;
+
+    // Connections being served, so shutdown can hang up on them.
+    //
+    std::mutex connections_lock;
+    std::condition_variable connections_done;
+    struct connection ** active;
+    size_t active_count;
+    size_t active_capacity;
+};
+
+static struct server server;
+
+// Self-pipe written by the signal handler to wake up the accept loop.
+//
+static int stop_pipe[2] = { -1, -1 };
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    char byte = 0;
+    ssize_t retval = write(stop_pipe[1], &byte, 1);
+    (void)retval;
+}
+
+static bool write_all(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data   += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Writes out every response that is ready and in order. Whoever
+// finds nobody else flushing does the writing, so workers never
+// block on a slow client behind each other for long. Called with
+// the connection lock held in guard, and returns with it held, so
+// that the reader cannot see the connection drained and destroy it
+// between a response being completed and its flush.
+//
+static void flush_responses(struct connection * connection,
+                            std::unique_lock<std::mutex> & guard) {
+    char buffer[SERVER_WRITE_BUFFER_SIZE];
+    if (connection->flushing) {
+        return;
+    }
+    connection->flushing = true;
+
+    while (true) {
+        size_t length = 0;
+        while (connection->next_to_write < connection->next_sequence &&
+               length + SERVER_RESPONSE_LENGTH <= sizeof(buffer)) {
+            struct response * response = &connection->responses[connection->next_to_write % connection->capacity];
+            if (!response->done) break;
+
+            size_t text_length = strlen(response->text);
+            memcpy(buffer + length, response->text, text_length);
+            length += text_length;
+            response->done = false;
+            ++connection->next_to_write;
+        }
+        if (length == 0) break;
+
+        guard.unlock();
+        bool ok = connection->write_failed || write_all(connection->out_fd, buffer, length);
+        guard.lock();
+        if (!ok) {
+            // The client went away. Keep consuming responses so
+            // that the connection can still drain and close.
+            //
+            connection->write_failed = true;
+        }
+    }
+
+    connection->flushing = false;
+    if (connection->next_to_write == connection->next_sequence) {
+        connection->drained.notify_all();
+    }
+}
+
+// Takes a sequence number for a new request. Called only by the
+// connection's reader, with the connection lock held.
+//
+static bool assign_sequence(struct connection * connection, size_t * sequence) {
+    size_t outstanding = connection->next_sequence - connection->next_to_write;
+    if (outstanding == connection->capacity) {
+        size_t capacity = connection->capacity * 2;
+        struct response * grown = (struct response*)malloc(capacity * sizeof(struct response));
+        if (grown == NULL) {
+            return false;
+        }
+        for (size_t s = connection->next_to_write; s < connection->next_sequence; s++) {
+            grown[s % capacity] = connection->responses[s % connection->capacity];
+        }
+        free(connection->responses);
+        connection->responses = grown;
+        connection->capacity  = capacity;
+    }
+
+    *sequence = connection->next_sequence++;
+    connection->responses[*sequence % connection->capacity].done = false;
+    return true;
+}
+
+static void complete_response(struct connection * connection, size_t sequence,
+                              const char * text) {
+    std::unique_lock<std::mutex> guard(connection->lock);
+    struct response * response = &connection->responses[sequence % connection->capacity];
+    snprintf(response->text, sizeof(response->text), "%s", text);
+    response->done = true;
+    flush_responses(connection, guard);
+}
+
+static void record_service_time(long nanoseconds) {
+    std::lock_guard<std::mutex> guard(server.stats_lock);
+    if (server.service_count == server.service_capacity) {
+        size_t capacity = server.service_capacity == 0 ? 4096 : server.service_capacity * 2;
+        long * grown = (long*)realloc(server.service_times, capacity * sizeof(long));
+        if (grown == NULL) {
+            return;
+        }
+        server.service_times    = grown;
+        server.service_capacity = capacity;
+    }
+    server.service_times[server.service_count++] = nanoseconds;
+}
+
+static bool submit_jobs(const struct job * batch, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        if (server.job_count + count > server.job_capacity) {
+            size_t capacity = server.job_capacity * 2;
+            while (capacity < server.job_count + count) capacity *= 2;
+            struct job * grown = (struct job*)malloc(capacity * sizeof(struct job));
+            if (grown == NULL) {
+                return false;
+            }
+            for (size_t k = 0; k < server.job_count; k++) {
+                grown[k] = server.jobs[(server.job_head + k) % server.job_capacity];
+            }
+            free(server.jobs);
+            server.jobs         = grown;
+            server.job_capacity = capacity;
+            server.job_head     = 0;
+        }
+
+        for (size_t k = 0; k < count; k++) {
+            server.jobs[(server.job_head + server.job_count) % server.job_capacity] = batch[k];
+            ++server.job_count;
+        }
+    }
+
+    if (count == 1) {
+        server.work_available.notify_one();
+    } else {
+        server.work_available.notify_all();
+    }
+    return true;
+}
+
+static void worker_main(void) {
+    TRACE_THREAD_NAME("server worker");
+    TRACE_SPAN("server worker");
+    struct search_state state;
+    if (!init_search_state(&state)) {
+        printf("Failed to allocate search state for server worker.\n");
+        exit(1);
+    }
+
+    while (true) {
+        struct job job;
+        {
+            std::unique_lock<std::mutex> guard(server.lock);
+            server.work_available.wait(guard, [] { return server.job_count > 0 || server.stopping; });
+            if (server.job_count == 0) break;
+
+            job = server.jobs[server.job_head];
+            server.job_head = (server.job_head + 1) % server.job_capacity;
+            --server.job_count;
+        }
+
+        struct search_result result;
+        search_fptr(&state, to_internal_id(job.from),
+                    to_internal_id(job.to), &result);
+
+        struct timespec done;
+        GRAB_CLOCK(done)
+        long service_time = compute_timespec_diff(job.received, done);
+        record_service_time(service_time);
+
+        char text[SERVER_RESPONSE_LENGTH];
+        snprintf(text, sizeof(text), "%u %u %s %ld %ld\n", job.from, job.to,
+                 result.found_path ? "found" : "not_found",
+                 result.nodes_visited, service_time);
+        complete_response(job.connection, job.sequence, text);
+    }
+
+    destroy_search_state(&state);
+}
+
+// Parses one request line. Returns NULL on success, the reason
+// for rejecting it otherwise.
+//
+static const char * parse_request(const char * line, unsigned int * from, unsigned int * to) {
+    char trailing;
+    if (sscanf(line, "%u %u %c", from, to, &trailing) != 2) {
+        return "malformed request";
+    }
+    if (*from >= row_count || *to >= row_count) {
+        return "node out of range";
+    }
+    return NULL;
+}
+
+// Reads requests until the client hangs up, then waits for every
+// answer to be written.
+//
+static void serve_connection(struct connection * connection) {
+    char buffer[SERVER_READ_BUFFER_SIZE + 1];
+    struct job * batch = (struct job*)malloc((SERVER_READ_BUFFER_SIZE / 4 + 1) * sizeof(struct job));
+    size_t pending = 0;
+    bool ok = batch != NULL;
+
+    while (ok) {
+        ssize_t bytes = read(connection->in_fd, buffer + pending, SERVER_READ_BUFFER_SIZE - pending);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) break;
+        pending += bytes;
+
+        // Every complete line in this read becomes part of one batch.
+        //
+        struct timespec received;
+        GRAB_CLOCK(received)
+        size_t batch_count = 0;
+        size_t consumed    = 0;
+        while (true) {
+            char * newline = (char*)memchr(buffer + consumed, '\n', pending - consumed);
+            if (newline == NULL) {
+                // A line that fills the whole buffer can never
+                // complete, so answer it as malformed and drop it.
+                //
+                if (consumed == 0 && pending == SERVER_READ_BUFFER_SIZE) {
+                    newline = buffer + pending - 1;
+                } else {
+                    break;
+                }
+            }
+            *newline = '\0';
+            char * line = buffer + consumed;
+            consumed    = newline - buffer + 1;
+
+            if (line[0] == '\0' || (line[0] == '\r' && line[1] == '\0')) {
+                continue;
+            }
+
+            struct job * job = &batch[batch_count];
+            const char * error = parse_request(line, &job->from, &job->to);
+
+            size_t sequence;
+            {
+                std::lock_guard<std::mutex> guard(connection->lock);
+                ok = assign_sequence(connection, &sequence);
+            }
+            if (!ok) {
+                printf("Failed to grow response ring.\n");
+                break;
+            }
+
+            if (error != NULL) {
+                char text[SERVER_RESPONSE_LENGTH];
+                snprintf(text, sizeof(text), "error %s\n", error);
+                {
+                    std::lock_guard<std::mutex> guard(server.stats_lock);
+                    ++server.error_count;
+                }
+                complete_response(connection, sequence, text);
+                continue;
+            }
+
+            job->connection = connection;
+            job->sequence   = sequence;
+            job->received   = received;
+            ++batch_count;
+        }
+
+        if (ok && !submit_jobs(batch, batch_count)) {
+            printf("Failed to grow job queue.\n");
+            ok = false;
+        }
+
+        memmove(buffer, buffer + consumed, pending - consumed);
+        pending -= consumed;
+    }
+    free(batch);
+
+    std::unique_lock<std::mutex> guard(connection->lock);
+    connection->drained.wait(guard, [connection] {
+        return connection->next_to_write == connection->next_sequence && !connection->flushing;
+    });
+}
+
+static struct connection * create_connection(int in_fd, int out_fd) {
+    struct connection * connection = new struct connection;
+    connection->in_fd         = in_fd;
+    connection->out_fd        = out_fd;
+    connection->capacity      = 1024;
+    connection->responses     = (struct response*)malloc(connection->capacity * sizeof(struct response));
+    connection->next_to_write = 0;
+    connection->next_sequence = 0;
+    connection->flushing      = false;
+    connection->write_failed  = false;
+    if (connection->responses == NULL) {
+        delete connection;
+        return NULL;
+    }
+    return connection;
+}
+
+static void destroy_connection(struct connection * connection) {
+    free(connection->responses);
+    delete connection;
+}
+
+static void add_active_connection(struct connection * connection) {
+    std::lock_guard<std::mutex> guard(server.connections_lock);
+    if (server.active_count == server.active_capacity) {
+        size_t capacity = server.active_capacity == 0 ? 16 : server.active_capacity * 2;
+        struct connection ** grown = (struct connection**)realloc(server.active, capacity * sizeof(struct connection*));
+        if (grown == NULL) {
+            printf("Failed to track connection, exiting.\n");
+            exit(1);
+        }
+        server.active          = grown;
+        server.active_capacity = capacity;
+    }
+    server.active[server.active_count++] = connection;
+}
+
+static void socket_connection_main(struct connection * connection) {
+    serve_connection(connection);
+    close(connection->in_fd);
+
+    std::lock_guard<std::mutex> guard(server.connections_lock);
+    for (size_t k = 0; k < server.active_count; k++) {
+        if (server.active[k] == connection) {
+            server.active[k] = server.active[--server.active_count];
+            break;
+        }
+    }
+    destroy_connection(connection);
+    server.connections_done.notify_all();
+}
+
+static int serve_socket(const char * socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, 64) != 0) {
+        perror("bind");
+        close(listen_fd);
+        return 1;
+    }
+
+    if (pipe(stop_pipe) != 0) {
+        perror("pipe");
+        close(listen_fd);
+        return 1;
+    }
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+
+    printf("Server listening on %s\n", socket_path);
+    fflush(stdout);
+
+    while (true) {
+        struct pollfd fds[2];
+        fds[0].fd     = listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = stop_pipe[0];
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+
+        struct connection * connection = create_connection(client_fd, client_fd);
+        if (connection == NULL) {
+            printf("Failed to allocate connection.\n");
+            close(client_fd);
+            continue;
+        }
+        add_active_connection(connection);
+        std::thread(socket_connection_main, connection).detach();
+    }
+
+    // Hang up on every client. Their readers see end of file, and
+    // each connection closes once its outstanding answers are out.
+    //
+    close(listen_fd);
+    unlink(socket_path);
+    std::unique_lock<std::mutex> guard(server.connections_lock);
+    for (size_t k = 0; k < server.active_count; k++) {
+        shutdown(server.active[k]->in_fd, SHUT_RD);
+    }
+    server.connections_done.wait(guard, [] { return server.active_count == 0; });
+    return 0;
+}
+
+static int compare_longs(const void * a, const void * b) {
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static long percentile(const long * sorted, size_t count, double fraction) {
+    size_t rank = (size_t)(fraction * (double)count + 0.999999);
+    if (rank == 0) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static void print_service_times(void) {
+    std::lock_guard<std::mutex> guard(server.stats_lock);
+    printf("Requests served: %ld errors: %ld\n", server.service_count, server.error_count);
+    if (server.service_count == 0) {
+        return;
+    }
+
+    qsort(server.service_times, server.service_count, sizeof(long), compare_longs);
+    printf("Service time [us] p50: %0.1f p99: %0.1f max: %0.1f\n",
+           (double)percentile(server.service_times, server.service_count, 0.50) / 1000.0,
+           (double)percentile(server.service_times, server.service_count, 0.99) / 1000.0,
+           (double)server.service_times[server.service_count - 1] / 1000.0);
+}
+
+int run_query_server(const char * socket_path, int response_fd,
+                     size_t thread_count) {
+    server.job_capacity = 1024;
+    server.jobs         = (struct job*)malloc(server.job_capacity * sizeof(struct job));
+    if (server.jobs == NULL) {
+        printf("Failed to allocate job queue.\n");
+        return 1;
+    }
+
+    // A client hanging up mid-answer must not kill the server.
+    //
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread * workers = new std::thread[thread_count];
+    for (size_t w = 0; w < thread_count; w++) {
+        workers[w] = std::thread(worker_main);
+    }
+    printf("Server ready with %ld worker threads.\n", thread_count);
+    fflush(stdout);
+
+    int status = 0;
+    if (socket_path == NULL) {
+        struct connection * connection = create_connection(STDIN_FILENO, response_fd);
+        if (connection == NULL) {
+            printf("Failed to allocate connection.\n");
+            status = 1;
+        } else {
+            serve_connection(connection);
+            destroy_connection(connection);
+        }
+    } else {
+        status = serve_socket(socket_path);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        server.stopping = true;
+    }
+    server.work_available.notify_all();
+    for (size_t w = 0; w < thread_count; w++) {
+        workers[w].join();
+    }
+    delete[] workers;
+
+    print_service_times();
+    free(server.jobs);
+    free(server.service_times);
+    free(server.active);
+    return status;
+}
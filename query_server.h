@@ -0,0 +1,31 @@
+#ifndef QUERY_SERVER_H_
+#define QUERY_SERVER_H_
+
+#include <stddef.h>
+
+// Serves reachability queries against the resident graph.
+//
+// Clients send one "i j" request per line and may pipeline as many
+// lines as they like without waiting for answers. Each read() is
+// parsed into a batch and handed to a pool of thread_count workers,
+// each with its own search_state. Responses are streamed back on the
+// same connection in request order, one line per request:
+//
+//   i j found|not_found <nodes visited> <service time [ns]>
+//
+// Malformed or out of range requests get "error <reason>" instead.
+// Service time runs from parsing the request to its response being
+// ready, so it includes any time spent waiting for a worker.
+//
+// With socket_path == NULL requests are read from stdin and answers
+// written to response_fd until stdin closes. Otherwise a Unix domain
+// socket is bound at socket_path and every accepted connection is
+// served concurrently until SIGINT or SIGTERM.
+//
+// p50/p99 service time is printed when the server stops. Returns
+// the process exit status.
+//
+int run_query_server(const char * socket_path, int response_fd,
+                     size_t thread_count);
+
+#endif
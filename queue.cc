@@ -1,7 +1,5 @@
-#include "queue.h"
-
-// Initial declaration of the static member function
-// pointers in the linked_list class.
+// Out of line definitions for the shared libraries, see
+// queue_impl.h.
 //
-void *(*queue::malloc_fptr)(size_t) = nullptr;
-void (*queue::free_fptr)(void *) = nullptr;
+#define QUEUE_INLINE
+#include "queue_impl.h"
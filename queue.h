@@ -1,8 +1,23 @@
 #ifndef QUEUE_H_
 #define QUEUE_H_
 
+#include "compact_list.h"
 #include "linked_list.h"
 
+// The list the queue keeps its elements in. Building with
+// QUEUE_COMPACT_LIST defined ('make COMPACT_QUEUE=1') swaps the
+// pointer-linked linked_list for compact_list, whose 8 byte nodes
+// live in one pool, see compact_list.h.
+//
+struct spill_store;
+struct spill_stats;
+
+#ifdef QUEUE_COMPACT_LIST
+typedef compact_list queue_list;
+#else
+typedef linked_list queue_list;
+#endif
+
 class queue{
   public:
     // Default constructor.
@@ -41,6 +56,36 @@ class queue{
     //
     size_t size() const;
 
+    // Popped nodes are kept and reused by later pushes, so a queue
+    // that has reached its working size stops calling malloc_fptr
+    // and free_fptr. The cache is unbounded unless a limit is set,
+    // in which case popped nodes beyond it are freed. The list's
+    // inline nodes, which live in the queue object itself, are
+    // never freed and count towards capacity().
+    //
+    // reserve() preallocates nodes so that capacity elements fit
+    // without allocating. shrink_to_fit() frees the cached nodes.
+    // Returns FALSE on allocation failure.
+    //
+    bool reserve(size_t capacity);
+    void shrink_to_fit();
+    void set_node_cache_limit(size_t limit);
+    size_t capacity() const;
+
+    // Bounds the memory the elements take to about bytes. Beyond
+    // that the middle of the queue spills to a temporary file in
+    // spill_directory (NULL for $TMPDIR or /tmp), while the oldest
+    // and youngest elements stay in memory, see spill_store.h.
+    // 0 turns spilling off again. Returns FALSE if the budget is
+    // too small, the file or its I/O thread cannot be created, or
+    // elements are still spilled.
+    //
+    bool set_memory_budget(size_t bytes, const char * spill_directory);
+
+    // Returns FALSE if the queue has no memory budget.
+    //
+    bool get_spill_stats(struct spill_stats * stats) const;
+
     // Static members for memory allocation. Very C like.
     //
     static void register_malloc(void * (*malloc)(size_t));
@@ -59,7 +104,20 @@ class queue{
     // inheritance, if you prefer that design decision
     // to this one.
     //
-    linked_list * ll;
+    // Held by value, so that a queue is one allocation, and with
+    // the list's inline nodes no more than that while it is short.
+    //
+    queue_list ll;
+
+    // The spilled middle, NULL without a memory budget.
+    //
+    struct spill_store * spill;
+
+    bool spill_oldest();
 };
 
+#ifdef QUEUE_HEADER_ONLY
+#include "queue_impl.h"
+#endif
+
 #endif
@@ -0,0 +1,171 @@
+#ifndef QUEUE_IMPL_H_
+#define QUEUE_IMPL_H_
+
+// The definitions of the queue members, built out of line into
+// libqueue.so by queue.cc and inlined by QUEUE_HEADER_ONLY builds, as
+// for linked_list_impl.h.
+//
+
+#include "queue.h"
+#include "spill_store.h"
+
+#ifndef QUEUE_INLINE
+#define QUEUE_INLINE inline
+#endif
+
+// Initial declaration of the static member function
+// pointers in the linked_list class.
+//
+QUEUE_INLINE void *(*queue::malloc_fptr)(size_t) = nullptr;
+QUEUE_INLINE void (*queue::free_fptr)(void *) = nullptr;
+
+// The queue owns its linked list, so the list allocates
+// through the same functions as the queue does.
+//
+QUEUE_INLINE void
+queue::register_malloc(void *(*malloc)(size_t)) {
+    queue::malloc_fptr = malloc;
+    linked_list::register_malloc(malloc);
+    compact_list::register_malloc(malloc);
+}
+
+QUEUE_INLINE void
+queue::register_free(void (*free)(void*)) {
+    queue::free_fptr = free;
+    linked_list::register_free(free);
+    compact_list::register_free(free);
+}
+
+QUEUE_INLINE queue::queue() : spill(nullptr) {
+    ll.set_spare_limit(SIZE_MAX);
+}
+
+QUEUE_INLINE queue::~queue() {
+    destroy_spill_store(spill);
+}
+
+QUEUE_INLINE void *
+queue::operator new(size_t size) {
+    return queue::malloc_fptr(size);
+}
+
+QUEUE_INLINE void
+queue::operator delete(void * ptr) {
+    queue::free_fptr(ptr);
+}
+
+// With a memory budget, everything in the spill store is older than
+// anything in the list, so pops drain the store first. A full list
+// spills before the insert, so that a failed push leaves the queue
+// as it was.
+//
+QUEUE_INLINE bool
+queue::push(unsigned int data) {
+    if (spill != nullptr && ll.size() >= spill_store_tail_limit(spill) && !spill_oldest()) {
+        return false;
+    }
+    return ll.insert_end(data);
+}
+
+// Moves a block of the oldest elements of the list into the spill
+// store.
+//
+QUEUE_INLINE bool
+queue::spill_oldest() {
+    size_t capacity;
+    unsigned int * block = spill_store_reserve_block(spill, &capacity);
+    if (block == nullptr) {
+        return false;
+    }
+    size_t count = 0;
+    while (count < capacity && ll.size() != 0) {
+        block[count++] = ll[0];
+        ll.remove(0);
+    }
+    spill_store_commit_block(spill, count);
+    return true;
+}
+
+QUEUE_INLINE bool
+queue::pop(unsigned int * popped_data) {
+    if (spill != nullptr && spill_store_size(spill) != 0) {
+        return spill_store_pop(spill, popped_data);
+    }
+    if (ll.size() == 0) {
+        return false;
+    }
+    *popped_data = ll[0];
+    return ll.remove(0);
+}
+
+QUEUE_INLINE bool
+queue::has_next() const {
+    return size() != 0;
+}
+
+QUEUE_INLINE bool
+queue::next(unsigned int * next_data) const {
+    if (spill != nullptr && spill_store_size(spill) != 0) {
+        return spill_store_next(spill, next_data);
+    }
+    if (ll.size() == 0) {
+        return false;
+    }
+    *next_data = ll[0];
+    return true;
+}
+
+QUEUE_INLINE size_t
+queue::size() const {
+    return ll.size() + (spill == nullptr ? 0 : spill_store_size(spill));
+}
+
+QUEUE_INLINE bool
+queue::reserve(size_t capacity) {
+    return ll.reserve(capacity);
+}
+
+QUEUE_INLINE void
+queue::shrink_to_fit() {
+    ll.shrink_to_fit();
+}
+
+QUEUE_INLINE void
+queue::set_node_cache_limit(size_t limit) {
+    ll.set_spare_limit(limit);
+}
+
+QUEUE_INLINE size_t
+queue::capacity() const {
+    return ll.capacity();
+}
+
+QUEUE_INLINE bool
+queue::set_memory_budget(size_t bytes, const char * spill_directory) {
+    if (spill != nullptr) {
+        if (spill_store_size(spill) != 0) {
+            return false;
+        }
+        destroy_spill_store(spill);
+        spill = nullptr;
+    }
+    if (bytes == 0) {
+        return true;
+    }
+    // Each element counted at twice its node's size, for the
+    // allocator's header or the pool's doubling.
+    //
+    spill = create_spill_store(bytes, 2 * sizeof(queue_list::node), spill_directory);
+    return spill != nullptr;
+}
+
+QUEUE_INLINE bool
+queue::get_spill_stats(struct spill_stats * stats) const {
+    if (spill == nullptr) {
+        return false;
+    }
+    spill_store_stats(spill, stats);
+    return true;
+}
+
+#endif
@@ -1,82 +1,70 @@
+#include <float.h>
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #ifdef COMPILE_ARM_PMU_CODE
 #include "arm_pmu.h"
 #endif
 
+#include "alloc_profiler.h"
+#include "allocators.h"
+#include "compressed_graph.h"
+#include "dynamic_graph.h"
+#include "graph.h"
+#include "memory_placement.h"
 #include "mmio.h"
+#include "partitioned_bfs.h"
+#include "perf_counters.h"
+#include "prefetch_bfs.h"
+#include "query_scheduler.h"
+#include "query_server.h"
+#include "relabel.h"
 #include "queue.h"
+#include "sharded_graph.h"
+#include "shortest_path.h"
+#include "spill_store.h"
+#include "timing.h"
+#include "trace.h"
+#include "workload.h"
+#include "zero_one_bfs.h"
 
-// A hacky adjacency matrix. 
+// Adjacency entries read by the last breadth_first_search(), the
+// denominator for per-edge counter rates.
 //
-struct row {
-    size_t size;
-    unsigned int * adjacent_nodes;
-    bool visited;
-};
-
-struct row ** rows = NULL; 
+size_t edges_scanned = 0;
 
-// Malloc and free implementations and microbenchmarking.
+// BFS time of every search so far, the denominator for the
+// allocator's share over the whole run.
 //
-#define GRAB_CLOCK(x) clock_gettime(CLOCK_MONOTONIC, &x);
-#define MALLOC_MICRO_ITERATIONS 10000
-void * malloc_ptrs[MALLOC_MICRO_ITERATIONS];
-long average_malloc_time = 0L;
-long average_free_time   = 0L;
-size_t malloc_invocations = 0;
-size_t free_invocations = 0;
-
-void malloc_microbenchmark(void) {
-    for (size_t i = 0; i < MALLOC_MICRO_ITERATIONS; i++) {
-        malloc_ptrs[i] = malloc(sizeof(linked_list::node));
-    }
-}
-
-void free_microbenchmark(void) {
-    for (size_t i = 0; i < MALLOC_MICRO_ITERATIONS; i++) {
-        free(malloc_ptrs[i]);
-    }
-}
-
-void * instrumented_malloc(size_t size) {
-    ++malloc_invocations;
-    return malloc(size);
-}
-
-void instrumented_free(void * addr) {
-    ++free_invocations;
-    free(addr);
-}
-
-long compute_timespec_diff(struct timespec start,
-                           struct timespec stop) {
-    long nanoseconds;
-    nanoseconds = (stop.tv_sec - start.tv_sec) * 1000000000L;
-
-    if (start.tv_nsec > stop.tv_nsec) {
-        nanoseconds -= 1000000000L;
-	nanoseconds += (start.tv_nsec - stop.tv_nsec);
-    } else {
-        nanoseconds += (stop.tv_nsec - start.tv_nsec);
-    }
-
-    return nanoseconds;
-}
+long total_search_nanoseconds = 0;
 
 bool breadth_first_search(unsigned int i, unsigned int j) {
+    TRACE_SPAN("bfs");
     queue * q = new queue();
+    if (!configure_search_queue(q)) {
+        printf("Failed to configure the search queue.\n");
+        delete q;
+        return false;
+    }
 
     bool found_path = false;
+    bool push_error = false;
     unsigned int next_node = i;
     size_t node_count = 0;
     struct timespec start, stop;
     GRAB_CLOCK(start)
+
+    // Count the allocations over the same window as the search time:
+    // the pushes and pops and deleting the queue, whose cached nodes
+    // are only freed then, but not setting the queue up.
+    //
+    begin_search_profile();
     while(!found_path) {
         // Push data onto the queue.
 	//
@@ -90,6 +78,7 @@ bool breadth_first_search(unsigned int i, unsigned int j) {
 	} else {
             row->visited = true;
 	}
+	edges_scanned += row->size;
 
 	if (row != NULL) {
 	    for(size_t node = 0; node < row->size; node++) {
@@ -101,11 +90,15 @@ bool breadth_first_search(unsigned int i, unsigned int j) {
 	        }
                 bool sanity = q->push(row->adjacent_nodes[node]);
 		if (!sanity) {
-                    printf("Error pushing into queue.\n");
-		    return 1;
+                    push_error = true;
+		    break;
 		}
 	    }
 	}
+	if (push_error) {
+            printf("Error pushing into queue.\n");
+	    break;
+	}
 
 	// Pop the next row off the queue.
 	//
@@ -115,61 +108,1296 @@ bool breadth_first_search(unsigned int i, unsigned int j) {
 	}
 	++node_count;
     }
+    struct spill_stats spilled;
+    bool spilling = q->get_spill_stats(&spilled);
     delete q;
+    struct alloc_search_stats allocations;
+    end_search_profile(&allocations);
     GRAB_CLOCK(stop)
     long nanoseconds = compute_timespec_diff(start, stop);
+    total_search_nanoseconds += nanoseconds;
     printf("Nodes visited: %ld\n", node_count);
     printf("Time elapsed [s]: %0.3f\n", (float)nanoseconds / 1000000000.0f);
-    printf("malloc calls : %ld free calls: %ld\n", malloc_invocations, free_invocations);
-    printf("Estimated percentage of time spent in malloc() %0.3f\n", 100.0f * (float)(malloc_invocations * average_malloc_time) / (float)nanoseconds);
-    printf("Estimated percentage of time spent in free(): %0.3f\n", 100.0f * (float)(free_invocations * average_free_time) / (float)nanoseconds);
-    return found_path;
+    print_search_profile(&allocations, nanoseconds);
+    if (spilling && spilled.blocks_written + spilled.blocks_short_circuited != 0) {
+        printf("Queue spilled: %ld blocks (%0.1f MiB) written, %ld read back, %ld never written, "
+               "%0.3f s waiting\n",
+               spilled.blocks_written, (double)spilled.bytes_written / (1024.0 * 1024.0),
+               spilled.blocks_read, spilled.blocks_short_circuited,
+               (double)spilled.wait_nanoseconds / 1000000000.0);
+    }
+    return found_path && !push_error;
 }
 
-void add_edge(unsigned int i, unsigned int j) {
-    // Check whether row i exists, if not allocate.
+// Command line options.
+//
+struct options {
+    // When non-zero, the queries are run by the concurrent
+    // scheduler with 1 through max_threads worker threads instead
+    // of one after another.
     //
-    if (rows[i] == NULL) {
-        rows[i] = (struct row*)malloc(sizeof(struct row));
+    size_t max_threads;
 
-        if (rows[i] == NULL) {
-            printf("Failed to allocate edge, exiting.\n");
-	    exit(1);
-	}
+    // When non-zero, every search is split over 1 through
+    // max_processes worker processes, each owning a range of the
+    // vertices, see run_partitioned_queries().
+    //
+    size_t max_processes;
 
-	rows[i]->size              = 1;
-	rows[i]->adjacent_nodes    = static_cast<unsigned int*>(malloc(16 * sizeof(unsigned int)));
-	rows[i]->visited           = false;
-	if (rows[i]->adjacent_nodes == NULL) {
-            printf("Unable to malloc adjacent_nodes.\n");
-	    exit(1);
-	}
-	rows[i]->adjacent_nodes[0] = j;
+    // Keep the graph resident and answer requests from stdin, or
+    // from a Unix domain socket when server_socket is set.
+    //
+    bool server;
+    const char * server_socket;
+
+    // Renumber the vertices for locality after loading.
+    //
+    enum vertex_order relabel;
+
+    // Apply the edge insertions and deletions in edge_deltas through
+    // the dynamic graph, compacting them every compaction_threshold
+    // delta entries.
+    //
+    const char * edge_deltas;
+    size_t compaction_threshold;
+
+    // Search a StreamVByte compressed copy of the adjacency.
+    //
+    bool compress;
+
+    // Run the queries as 0-1 BFS, with the matrix values as edge
+    // weights, see zero_one_bfs.h.
+    //
+    bool zero_one;
+
+    // Run the queries with Dijkstra's algorithm, with the matrix
+    // values as edge lengths, over each priority queue in
+    // shortest_path.h.
+    //
+    bool weighted;
+
+    // Search with the prefetch pipeline, see prefetch_bfs.h, at the
+    // distance in prefetch_distance.
+    //
+    bool prefetch;
+
+    // Move the graph, visited arrays and allocator regions onto huge
+    // pages and NUMA placement, see memory_placement.h.
+    //
+    bool place_memory;
+    enum huge_page_mode huge_pages;
+    enum numa_mode numa;
+
+    // Read perf_event_open() hardware counters around each search.
+    //
+    bool counters;
+
+    // Input files, the Wikipedia matrix by default.
+    //
+    const char * matrix_path;
+    const char * nodes_path;
+
+    // Run the latency workload driver instead of the per-query
+    // loop, on workload_queries seeded random pairs or, with
+    // workload_nodes, on the pairs from the nodes file. A non-zero
+    // workload_distance spreads the random pairs evenly over BFS
+    // distances 1 through workload_distance.
+    //
+    bool workload;
+    bool workload_nodes;
+    size_t workload_queries;
+    uint64_t workload_seed;
+    unsigned int workload_distance;
+    const char * workload_json;
+
+    // Where to write the Chrome trace of a tracing build.
+    //
+    const char * trace_path;
+
+    // Comma separated allocator backends, or "all", to run the
+    // query set with and compare.
+    //
+    const char * allocators;
+
+    // Convert the matrix into a sharded graph at write_shards, or
+    // search the sharded graph at sharded_path instead of loading
+    // the matrix.
+    //
+    const char * write_shards;
+    size_t shard_bytes;
+    const char * sharded_path;
+};
+
+static bool parse_count(const char * text, size_t * count) {
+    char * end;
+    *count = strtoul(text, &end, 10);
+    return *text != '\0' && *end == '\0';
+}
+
+// A byte count with an optional K, M or G suffix.
+//
+static bool parse_bytes(const char * text, size_t * bytes) {
+    char * end;
+    *bytes = strtoul(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+    switch (*end) {
+        case 'K': *bytes <<= 10; ++end; break;
+        case 'M': *bytes <<= 20; ++end; break;
+        case 'G': *bytes <<= 30; ++end; break;
+        default: break;
+    }
+    return *end == '\0';
+}
+
+void print_usage(const char * program) {
+    printf("Usage: %s [--threads N] [--server | --server-socket PATH]\n"
+           "       [--relabel degree|bfs|rcm] [--compress] [--no-counters]\n"
+           "       [--edge-deltas PATH [--compact-threshold N]]\n"
+           "       [--prefetch D] [--zero-one] [--weighted]\n"
+           "       [--huge-pages default|off|thp|explicit] [--numa default|local|interleave]\n"
+           "       [--matrix PATH] [--nodes PATH]\n"
+           "       [--workload N|nodes] [--workload-seed S] [--workload-distance D]\n"
+           "       [--workload-json PATH] [--trace PATH]\n"
+           "       [--allocator all|glibc,arena,pool,tcache]\n"
+           "       [--queue-reserve N] [--node-cache-limit N]\n"
+           "       [--queue-budget BYTES] [--spill-dir DIR]\n"
+           "       [--write-shards PATH [--shard-bytes BYTES]] [--sharded PATH]\n"
+           "       [--processes K]\n", program);
+    printf("  --threads N           Run the queries on 1 through N worker threads\n");
+    printf("                        and report queries per second for each.\n");
+    printf("                        In server mode, the size of the worker pool.\n");
+    printf("  --processes K         Split every search over 1 through K worker\n");
+    printf("                        processes owning a vertex range each and report\n");
+    printf("                        the scaling and the messages sent.\n");
+    printf("  --server              Answer \"i j\" requests from stdin on stdout.\n");
+    printf("  --server-socket PATH  Answer \"i j\" requests on a Unix domain socket.\n");
+    printf("  --relabel ORDER       Renumber vertices by degree, BFS order or Reverse\n");
+    printf("                        Cuthill-McKee and report the change in BFS time.\n");
+    printf("  --edge-deltas PATH    Apply \"+ i j\" and \"- i j\" lines to the loaded\n");
+    printf("                        graph as deltas, compacting them in the background,\n");
+    printf("                        and report the BFS time on the merged view.\n");
+    printf("  --compact-threshold N Delta entries that start a compaction, default 65536.\n");
+    printf("  --compress            Search compressed adjacency lists and report the\n");
+    printf("                        compression ratio and the change in throughput.\n");
+    printf("  --prefetch D          Search with rows prefetched D, 2D and 3D frontier\n");
+    printf("                        vertices ahead (0 to %d) and report the change in\n", PREFETCH_MAX_DISTANCE);
+    printf("                        BFS time and memory-level parallelism.\n");
+    printf("  --zero-one            Find the lightest paths with 0-1 BFS, taking a stored\n");
+    printf("                        0 in the matrix as a 0 edge and anything else as 1.\n");
+    printf("  --weighted            Find the shortest paths with Dijkstra's algorithm,\n");
+    printf("                        taking the matrix values as edge lengths, with a\n");
+    printf("                        radix heap, a binary heap and std::priority_queue.\n");
+    printf("  --huge-pages MODE     Put the graph, visited arrays and allocator regions\n");
+    printf("                        on transparent (thp) or explicit huge pages, or\n");
+    printf("                        none (off), and report the change in BFS time and\n");
+    printf("                        dTLB misses.\n");
+    printf("  --numa MODE           Place them first touch (local) or interleaved\n");
+    printf("                        over all NUMA nodes.\n");
+    printf("  --no-counters         Do not read hardware performance counters.\n");
+    printf("  --matrix PATH         Matrix Market graph to load, for example one\n");
+    printf("                        written by generate_graph.\n");
+    printf("  --nodes PATH          Query pairs to search for.\n");
+    printf("  --workload N|nodes    Time N seeded random queries, or the nodes file,\n");
+    printf("                        and print latency percentiles, throughput and a\n");
+    printf("                        breakdown by BFS distance.\n");
+    printf("  --workload-seed S     Seed of the random queries, default 1.\n");
+    printf("  --workload-distance D Spread the random queries evenly over BFS\n");
+    printf("                        distances 1 through D.\n");
+    printf("  --workload-json PATH  Also write the workload results as JSON.\n");
+    printf("  --trace PATH          Chrome trace output of a 'make TRACING=1' build,\n");
+    printf("                        default trace.json.\n");
+    printf("  --allocator LIST      Run the queries with each listed allocator\n");
+    printf("                        backend, or all of them, and compare time,\n");
+    printf("                        peak RSS and call counts.\n");
+    printf("  --queue-reserve N     Preallocate N nodes in every search queue.\n");
+    printf("  --node-cache-limit N  Keep at most N popped nodes per queue for reuse\n");
+    printf("                        instead of freeing them, default unbounded.\n");
+    printf("  --queue-budget BYTES  Keep at most about BYTES, with an optional K, M\n");
+    printf("                        or G suffix, of every search queue in memory and\n");
+    printf("                        spill the rest to a temporary file.\n");
+    printf("  --spill-dir DIR       Where queues spill to, default $TMPDIR or /tmp.\n");
+    printf("  --write-shards PATH   Stream the matrix into a sharded on-disk graph and\n");
+    printf("                        exit, shards of --shard-bytes, default 64M.\n");
+    printf("  --sharded PATH        Search a sharded graph shard by shard from disk\n");
+    printf("                        instead of loading the matrix into memory.\n");
+}
+
+bool parse_options(int argc, char ** argv, struct options * options) {
+    options->max_threads   = 0;
+    options->max_processes = 0;
+    options->server        = false;
+    options->server_socket = NULL;
+    options->relabel       = ORDER_NONE;
+    options->compress      = false;
+    options->edge_deltas          = NULL;
+    options->compaction_threshold = 65536;
+    options->prefetch      = false;
+    options->zero_one      = false;
+    options->weighted      = false;
+    options->place_memory  = false;
+    options->huge_pages    = HUGE_PAGES_DEFAULT;
+    options->numa          = NUMA_DEFAULT;
+    options->counters      = true;
+    options->matrix_path   = "wikipedia-20070206/wikipedia-20070206.mtx";
+    options->nodes_path    = "nodes";
+    options->workload          = false;
+    options->workload_nodes    = false;
+    options->workload_queries  = 0;
+    options->workload_seed     = 1;
+    options->workload_distance = 0;
+    options->workload_json     = NULL;
+    options->trace_path        = TRACING_ENABLED ? "trace.json" : NULL;
+    options->allocators        = NULL;
+    options->write_shards      = NULL;
+    options->shard_bytes       = 64UL << 20;
+    options->sharded_path      = NULL;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            char * end;
+            options->max_threads = strtoul(argv[++arg], &end, 10);
+            if (*end != '\0' || options->max_threads == 0) {
+                printf("Invalid thread count: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--processes") == 0 && arg + 1 < argc) {
+            if (!parse_count(argv[++arg], &options->max_processes) ||
+                options->max_processes == 0 || options->max_processes > PARTITION_MAX_PROCESSES) {
+                printf("Invalid process count: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--server") == 0) {
+            options->server = true;
+        } else if (strcmp(argv[arg], "--server-socket") == 0 && arg + 1 < argc) {
+            options->server        = true;
+            options->server_socket = argv[++arg];
+        } else if (strcmp(argv[arg], "--no-counters") == 0) {
+            options->counters = false;
+        } else if (strcmp(argv[arg], "--matrix") == 0 && arg + 1 < argc) {
+            options->matrix_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--nodes") == 0 && arg + 1 < argc) {
+            options->nodes_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--workload") == 0 && arg + 1 < argc) {
+            options->workload = true;
+            if (strcmp(argv[++arg], "nodes") == 0) {
+                options->workload_nodes = true;
+            } else {
+                char * end;
+                options->workload_queries = strtoul(argv[arg], &end, 10);
+                if (*end != '\0' || options->workload_queries == 0) {
+                    printf("Invalid workload size: %s\n", argv[arg]);
+                    return false;
+                }
+            }
+        } else if (strcmp(argv[arg], "--workload-seed") == 0 && arg + 1 < argc) {
+            options->workload_seed = strtoull(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "--workload-distance") == 0 && arg + 1 < argc) {
+            options->workload_distance = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "--workload-json") == 0 && arg + 1 < argc) {
+            options->workload_json = argv[++arg];
+        } else if (strcmp(argv[arg], "--queue-reserve") == 0 && arg + 1 < argc) {
+            if (!parse_count(argv[++arg], &search_queue_reserve)) {
+                printf("Invalid queue reserve: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--node-cache-limit") == 0 && arg + 1 < argc) {
+            if (!parse_count(argv[++arg], &search_queue_cache_limit)) {
+                printf("Invalid node cache limit: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--queue-budget") == 0 && arg + 1 < argc) {
+            if (!parse_bytes(argv[++arg], &search_queue_memory_budget)) {
+                printf("Invalid queue budget: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--spill-dir") == 0 && arg + 1 < argc) {
+            search_queue_spill_directory = argv[++arg];
+        } else if (strcmp(argv[arg], "--write-shards") == 0 && arg + 1 < argc) {
+            options->write_shards = argv[++arg];
+        } else if (strcmp(argv[arg], "--shard-bytes") == 0 && arg + 1 < argc) {
+            // Offsets within a shard are 32-bit.
+            //
+            if (!parse_bytes(argv[++arg], &options->shard_bytes) ||
+                options->shard_bytes == 0 || options->shard_bytes > (1UL << 30)) {
+                printf("Invalid shard size: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--sharded") == 0 && arg + 1 < argc) {
+            options->sharded_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--allocator") == 0 && arg + 1 < argc) {
+            options->allocators = argv[++arg];
+        } else if (strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc) {
+            options->trace_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--huge-pages") == 0 && arg + 1 < argc) {
+            options->place_memory = true;
+            if (!parse_huge_page_mode(argv[++arg], &options->huge_pages)) {
+                printf("Unknown huge page mode: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--numa") == 0 && arg + 1 < argc) {
+            options->place_memory = true;
+            if (!parse_numa_mode(argv[++arg], &options->numa)) {
+                printf("Unknown NUMA mode: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--edge-deltas") == 0 && arg + 1 < argc) {
+            options->edge_deltas = argv[++arg];
+        } else if (strcmp(argv[arg], "--compact-threshold") == 0 && arg + 1 < argc) {
+            if (!parse_count(argv[++arg], &options->compaction_threshold) ||
+                options->compaction_threshold == 0) {
+                printf("Invalid compaction threshold: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--prefetch") == 0 && arg + 1 < argc) {
+            options->prefetch = true;
+            if (!parse_count(argv[++arg], &prefetch_distance) ||
+                prefetch_distance > PREFETCH_MAX_DISTANCE) {
+                printf("Invalid prefetch distance: %s\n", argv[arg]);
+                return false;
+            }
+        } else if (strcmp(argv[arg], "--zero-one") == 0) {
+            options->zero_one = true;
+        } else if (strcmp(argv[arg], "--weighted") == 0) {
+            options->weighted = true;
+        } else if (strcmp(argv[arg], "--compress") == 0) {
+            options->compress = true;
+        } else if (strcmp(argv[arg], "--relabel") == 0 && arg + 1 < argc) {
+            if (!parse_vertex_order(argv[++arg], &options->relabel)) {
+                printf("Unknown vertex order: %s\n", argv[arg]);
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (options->prefetch && options->compress) {
+        printf("--prefetch searches the uncompressed rows, it cannot be combined with --compress.\n");
+        return false;
+    }
+    if (options->zero_one && (options->relabel != ORDER_NONE || options->edge_deltas != NULL)) {
+        printf("--zero-one keeps the edge weights in load order, it cannot be combined with "
+               "--relabel or --edge-deltas.\n");
+        return false;
+    }
+    if (options->weighted && (options->relabel != ORDER_NONE || options->edge_deltas != NULL ||
+                              options->zero_one)) {
+        printf("--weighted keeps the edge lengths in load order, it cannot be combined with "
+               "--relabel, --edge-deltas or --zero-one.\n");
+        return false;
+    }
+    return true;
+}
+
+// Reads every "i j" pair in the node list into a malloc()ed
+// array. Returns NULL on a parsing or allocation failure.
+//
+struct query * read_queries(FILE * node_fptr, size_t * query_count) {
+    size_t capacity       = 128;
+    size_t count          = 0;
+    struct query * queries = (struct query*)malloc(capacity * sizeof(struct query));
+    if (queries == NULL) {
+        printf("Failed to allocate query array.\n");
+        return NULL;
+    }
+
+    while (true) {
+        unsigned int node_i = 0;
+        unsigned int node_j = 0;
+        int retval = fscanf(node_fptr, "%u %u\n", &node_i, &node_j);
+        if (retval == -1) {
+            break;
+        }
+        if (retval != 2) {
+            printf("Parsing error.\n");
+            free(queries);
+            return NULL;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            struct query * grown = (struct query*)realloc(queries, capacity * sizeof(struct query));
+            if (grown == NULL) {
+                printf("Failed to grow query array.\n");
+                free(queries);
+                return NULL;
+            }
+            queries = grown;
+        }
+        queries[count].from = node_i;
+        queries[count].to   = node_j;
+        ++count;
+    }
+
+    *query_count = count;
+    return queries;
+}
+
+// Totals for one pass over the query set, used to compare graph
+// layouts.
+//
+struct layout_stats {
+    long nanoseconds;
+    size_t edges_scanned;
+    size_t paths_found;
+    uint64_t counters[PERF_COUNTER_COUNT];
+};
+
+// Runs every query once, ids already translated into rows.
+//
+bool measure_layout(const struct query * queries, size_t query_count,
+                    struct layout_stats * stats) {
+    struct search_state state;
+    if (!init_search_state(&state)) {
+        printf("Failed to allocate search state.\n");
+        return false;
+    }
+
+    stats->nanoseconds   = 0;
+    stats->edges_scanned = 0;
+    stats->paths_found   = 0;
+    reset_and_start_perf_counters();
+    for (size_t k = 0; k < query_count; k++) {
+        struct search_result result;
+        search_fptr(&state, queries[k].from, queries[k].to, &result);
+        stats->nanoseconds   += result.nanoseconds;
+        stats->edges_scanned += result.edges_scanned;
+        stats->paths_found   += result.found_path ? 1 : 0;
+    }
+    stop_perf_counters();
+    read_perf_data(stats->counters);
+
+    destroy_search_state(&state);
+    return true;
+}
+
+void print_layout_stats(const char * label, const struct layout_stats * stats) {
+    printf("%-10s BFS time [s]: %0.3f edges scanned: %ld ns per edge: %0.3f paths found: %ld\n",
+           label, (double)stats->nanoseconds / 1000000000.0, stats->edges_scanned,
+           stats->edges_scanned == 0 ? 0.0 : (double)stats->nanoseconds / (double)stats->edges_scanned,
+           stats->paths_found);
+
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%-10s ", label);
+    print_perf_summary(prefix, stats->counters, stats->edges_scanned);
+}
+
+// Measures the query set on the graph as loaded, relabels it, and
+// measures again. Leaves the queries translated to the new ids.
+//
+bool relabel_and_compare(enum vertex_order order, struct query * queries,
+                         size_t query_count) {
+    struct layout_stats before, after;
+    if (!measure_layout(queries, query_count, &before)) {
+        return false;
+    }
+
+    struct timespec relabel_start, relabel_stop;
+    GRAB_CLOCK(relabel_start)
+    if (!relabel_graph(order)) {
+        printf("Failed to relabel graph.\n");
+        return false;
+    }
+    GRAB_CLOCK(relabel_stop)
+
+    for (size_t k = 0; k < query_count; k++) {
+        queries[k].from = to_internal_id(queries[k].from);
+        queries[k].to   = to_internal_id(queries[k].to);
+    }
+    if (!measure_layout(queries, query_count, &after)) {
+        return false;
+    }
+
+    printf("Relabeled graph by %s order in %0.3f s.\n", vertex_order_name(order),
+           (float)compute_timespec_diff(relabel_start, relabel_stop) / 1000000000.0f);
+    print_layout_stats("original", &before);
+    print_layout_stats(vertex_order_name(order), &after);
+    printf("BFS time change: %+0.1f%%\n",
+           100.0 * ((double)after.nanoseconds - (double)before.nanoseconds) / (double)before.nanoseconds);
+    return true;
+}
+
+// Applies the edge-delta file and folds every delta into the rows,
+// leaving a plain graph. With queries, also measures the query set
+// before, on the merged view right after loading, while compactions
+// may still be running, and after the final compaction.
+//
+bool apply_edge_deltas(const struct options * options, const struct query * queries,
+                       size_t query_count) {
+    struct layout_stats before, merged, compacted;
+    if (queries != NULL && !measure_layout(queries, query_count, &before)) {
+        return false;
+    }
+    if (!init_dynamic_graph(options->compaction_threshold)) {
+        printf("Failed to allocate edge deltas.\n");
+        return false;
+    }
+    search_fptr = dynamic_breadth_first_search;
+
+    struct timespec load_start, load_stop;
+    GRAB_CLOCK(load_start)
+    bool ok = load_edge_deltas(options->edge_deltas);
+    GRAB_CLOCK(load_stop)
+    struct dynamic_graph_stats loaded;
+    read_dynamic_graph_stats(&loaded);
+    ok = ok && (queries == NULL || measure_layout(queries, query_count, &merged));
+
+    struct timespec finish_start, finish_stop;
+    GRAB_CLOCK(finish_start)
+    ok = finish_dynamic_graph() && ok;
+    GRAB_CLOCK(finish_stop)
+    search_fptr = shared_breadth_first_search;
+    if (!ok) {
+        printf("Failed to apply edge deltas.\n");
+        return false;
+    }
+    ok = queries == NULL || measure_layout(queries, query_count, &compacted);
+
+    struct dynamic_graph_stats done;
+    read_dynamic_graph_stats(&done);
+    long load_nanoseconds = compute_timespec_diff(load_start, load_stop);
+    size_t updates        = done.inserts + done.deletes + done.unchanged;
+    printf("Applied %ld edge updates from %s in %0.3f s (%0.0f per second): "
+           "%ld inserted, %ld deleted, %ld unchanged.\n",
+           updates, options->edge_deltas, (double)load_nanoseconds / 1000000000.0,
+           load_nanoseconds == 0 ? 0.0 : (double)updates * 1000000000.0 / (double)load_nanoseconds,
+           done.inserts, done.deletes, done.unchanged);
+    printf("Delta entries after loading: %ld, compactions: %ld (%ld during loading), "
+           "rows rewritten: %ld\n",
+           loaded.delta_entries, done.compactions, loaded.compactions, done.rows_rewritten);
+    printf("Compaction time [s] building: %0.3f swapping in: %0.3f, final fold: %0.3f\n",
+           (double)done.compaction_nanoseconds / 1000000000.0,
+           (double)done.install_nanoseconds / 1000000000.0,
+           (float)compute_timespec_diff(finish_start, finish_stop) / 1000000000.0f);
+    if (queries == NULL || !ok) {
+        return ok;
+    }
+
+    print_layout_stats("base", &before);
+    print_layout_stats("merged", &merged);
+    print_layout_stats("compacted", &compacted);
+    printf("BFS time change merged vs compacted: %+0.1f%%\n",
+           100.0 * ((double)merged.nanoseconds - (double)compacted.nanoseconds) / (double)compacted.nanoseconds);
+    if (merged.paths_found != compacted.paths_found) {
+        printf("Paths found differ between the merged view and the compacted graph.\n");
+        return false;
+    }
+    return true;
+}
+
+bool compress_graph(void) {
+    struct timespec build_start, build_stop;
+    GRAB_CLOCK(build_start)
+    if (!build_compressed_graph()) {
+        printf("Failed to compress graph.\n");
+        return false;
+    }
+    GRAB_CLOCK(build_stop)
+
+    size_t edges           = 0;
+    size_t allocated_bytes = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        edges           += rows[v]->size;
+        allocated_bytes += ((rows[v]->size + 1 + 15) / 16) * 16 * sizeof(unsigned int);
+    }
+
+    printf("Compressed %ld edges in %0.3f s with the %s decoder.\n", edges,
+           (float)compute_timespec_diff(build_start, build_stop) / 1000000000.0f,
+           compressed_decoder_name());
+    printf("Adjacency bytes raw: %ld allocated: %ld compressed: %ld\n",
+           edges * sizeof(unsigned int), allocated_bytes, compressed.byte_count);
+    printf("Compression ratio: %0.2fx (%0.2fx vs allocated), %0.2f bits per edge\n",
+           (double)(edges * sizeof(unsigned int)) / (double)compressed.byte_count,
+           (double)allocated_bytes / (double)compressed.byte_count,
+           8.0 * (double)compressed.byte_count / (double)edges);
+
+    search_fptr = compressed_breadth_first_search;
+    return true;
+}
+
+// Measures the query set on the raw adjacency, switches every later
+// search over to the compressed one, and measures again.
+//
+bool compress_and_compare(const struct query * queries, size_t query_count) {
+    struct layout_stats before, after;
+    if (!measure_layout(queries, query_count, &before) ||
+        !compress_graph() ||
+        !measure_layout(queries, query_count, &after)) {
+        return false;
+    }
+
+    print_layout_stats("raw", &before);
+    print_layout_stats("compressed", &after);
+    printf("BFS throughput [edges/s] raw: %0.0f compressed: %0.0f change: %+0.1f%%\n",
+           (double)before.edges_scanned * 1000000000.0 / (double)before.nanoseconds,
+           (double)after.edges_scanned * 1000000000.0 / (double)after.nanoseconds,
+           100.0 * (((double)after.edges_scanned / (double)after.nanoseconds) /
+                    ((double)before.edges_scanned / (double)before.nanoseconds) - 1.0));
+    return true;
+}
+
+// Measures the query set with the graph as loaded, moves it into
+// memory placed by options, and measures again.
+//
+bool place_and_compare(const struct options * options, const struct query * queries,
+                       size_t query_count) {
+    struct layout_stats before, after;
+    if (!measure_layout(queries, query_count, &before)) {
+        return false;
+    }
+    set_memory_placement(options->huge_pages, options->numa);
+    if (!place_graph()) {
+        printf("Failed to allocate placed graph.\n");
+        return false;
+    }
+    if (!measure_layout(queries, query_count, &after)) {
+        return false;
+    }
+
+    print_placement_summary();
+    print_layout_stats("as loaded", &before);
+    print_layout_stats("placed", &after);
+    printf("BFS time change: %+0.1f%%\n",
+           100.0 * ((double)after.nanoseconds - (double)before.nanoseconds) / (double)before.nanoseconds);
+    uint64_t misses_before = before.counters[PERF_DTLB_READ_MISSES];
+    uint64_t misses_after  = after.counters[PERF_DTLB_READ_MISSES];
+    if (misses_before == PERF_COUNTER_UNAVAILABLE || misses_after == PERF_COUNTER_UNAVAILABLE ||
+        before.edges_scanned == 0 || after.edges_scanned == 0) {
+        printf("dTLB read misses: unavailable.\n");
     } else {
-        // Check whether to perform realloc.
-	// Every 16 nodes we allocate another 16.
-	//
-	size_t size = rows[i]->size;
-	if (size % 16 == 15) {
-             rows[i]->adjacent_nodes = static_cast<unsigned int*>(realloc(rows[i]->adjacent_nodes, (size + 1 + 16) * sizeof(unsigned int)));
-
-	     if (rows[i] == NULL) {
-                 printf("Failed to realloc adjacent nodes.\n");
-		 exit(1);
-	     }
-	}
+        double per_edge_before = (double)misses_before / (double)before.edges_scanned;
+        double per_edge_after  = (double)misses_after / (double)after.edges_scanned;
+        printf("dTLB read misses per edge: %0.4f -> %0.4f (%+0.1f%%)\n", per_edge_before, per_edge_after,
+               per_edge_before == 0.0 ? 0.0 : 100.0 * (per_edge_after / per_edge_before - 1.0));
+    }
+    return true;
+}
+
+// Measures the query set with the current search, then with the
+// prefetch pipeline popping in batches but not prefetching, then
+// prefetching at prefetch_distance, which every later search uses.
+//
+bool prefetch_and_compare(const struct query * queries, size_t query_count) {
+    struct layout_stats plain, batched, pipelined;
+    size_t distance = prefetch_distance;
+    if (!measure_layout(queries, query_count, &plain)) {
+        return false;
+    }
+    search_fptr       = prefetch_breadth_first_search;
+    prefetch_distance = 0;
+    if (!measure_layout(queries, query_count, &batched)) {
+        return false;
+    }
+    prefetch_distance = distance;
+    if (!measure_layout(queries, query_count, &pipelined)) {
+        return false;
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "distance %ld", distance);
+    print_layout_stats("plain", &plain);
+    print_layout_stats("batched", &batched);
+    print_layout_stats(label, &pipelined);
+    printf("BFS time change vs plain: batched %+0.1f%%, prefetched %+0.1f%%\n",
+           100.0 * ((double)batched.nanoseconds - (double)plain.nanoseconds) / (double)plain.nanoseconds,
+           100.0 * ((double)pipelined.nanoseconds - (double)plain.nanoseconds) / (double)plain.nanoseconds);
+
+    uint64_t pending_before = plain.counters[PERF_L1D_PENDING_MISSES];
+    uint64_t cycles_before  = plain.counters[PERF_L1D_PENDING_CYCLES];
+    uint64_t pending_after  = pipelined.counters[PERF_L1D_PENDING_MISSES];
+    uint64_t cycles_after   = pipelined.counters[PERF_L1D_PENDING_CYCLES];
+    if (pending_before == PERF_COUNTER_UNAVAILABLE || cycles_before == PERF_COUNTER_UNAVAILABLE ||
+        pending_after == PERF_COUNTER_UNAVAILABLE || cycles_after == PERF_COUNTER_UNAVAILABLE ||
+        cycles_before == 0 || cycles_after == 0) {
+        printf("Memory-level parallelism: unavailable, try 'perf stat -e "
+               "l1d_pend_miss.pending,l1d_pend_miss.pending_cycles'.\n");
+    } else {
+        double before = (double)pending_before / (double)cycles_before;
+        double after  = (double)pending_after / (double)cycles_after;
+        printf("Memory-level parallelism: %0.2f -> %0.2f misses outstanding per miss cycle (%+0.1f%%)\n",
+               before, after, 100.0 * (after / before - 1.0));
+    }
+
+    if (plain.edges_scanned != pipelined.edges_scanned || plain.paths_found != pipelined.paths_found) {
+        printf("The prefetch pipeline searched differently from the plain search.\n");
+        return false;
+    }
+    return true;
+}
+
+// Runs every query as a 0-1 BFS and prints the weight of the
+// lightest path found.
+//
+bool run_zero_one_queries(const struct query * queries, size_t query_count) {
+    struct zero_one_search search;
+    if (!init_zero_one_search(&search)) {
+        printf("Failed to allocate 0-1 BFS state.\n");
+        return false;
+    }
+
+    size_t zero_edges  = 0;
+    size_t total_edges = 0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        total_edges += rows[v]->size;
+        for (size_t k = 0; k < rows[v]->size; k++) {
+            zero_edges += edge_weights[v][k] == 0 ? 1 : 0;
+        }
+    }
+    printf("0-1 BFS over %ld edges, %ld (%0.1f%%) of weight 0.\n", total_edges, zero_edges,
+           total_edges == 0 ? 0.0 : 100.0 * (double)zero_edges / (double)total_edges);
+
+    long total_nanoseconds = 0;
+    size_t paths_found     = 0;
+    size_t total_distance  = 0;
+    size_t nodes_settled   = 0;
+    size_t edges_scanned   = 0;
+    for (size_t k = 0; k < query_count; k++) {
+        struct search_result result;
+        unsigned int distance = 0;
+        zero_one_breadth_first_search(&search, queries[k].from, queries[k].to, &result, &distance);
+        total_nanoseconds += result.nanoseconds;
+        nodes_settled     += result.nodes_visited;
+        edges_scanned     += result.edges_scanned;
+        if (result.found_path) {
+            ++paths_found;
+            total_distance += distance;
+            printf("(%ld / %ld) %u -> %u: distance %u Nodes settled: %ld Time elapsed [s]: %0.3f\n",
+                   k + 1, query_count, queries[k].from, queries[k].to, distance,
+                   result.nodes_visited, (float)result.nanoseconds / 1000000000.0f);
+        } else {
+            printf("(%ld / %ld) %u -> %u: No path found. Nodes settled: %ld Time elapsed [s]: %0.3f\n",
+                   k + 1, query_count, queries[k].from, queries[k].to,
+                   result.nodes_visited, (float)result.nanoseconds / 1000000000.0f);
+        }
+    }
+
+    printf("Paths found: %ld / %ld mean distance: %0.2f BFS time [s]: %0.3f\n",
+           paths_found, query_count,
+           paths_found == 0 ? 0.0 : (double)total_distance / (double)paths_found,
+           (double)total_nanoseconds / 1000000000.0);
+    printf("Nodes settled: %ld edges scanned: %ld ns per edge: %0.3f largest deque: %ld\n",
+           nodes_settled, edges_scanned,
+           edges_scanned == 0 ? 0.0 : (double)total_nanoseconds / (double)edges_scanned,
+           search.max_frontier);
+    destroy_zero_one_search(&search);
+    return true;
+}
+
+// Runs every query with Dijkstra's algorithm over each kind of
+// priority queue, the std::priority_queue baseline first, checks
+// that they find the same distances and compares their times.
+// Prints the distance of every query on the last run.
+//
+bool run_weighted_queries(const struct query * queries, size_t query_count) {
+    size_t total_edges   = 0;
+    size_t integer_edges = 0;
+    double total_length  = 0.0;
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        total_edges += rows[v]->size;
+        for (size_t k = 0; k < rows[v]->size; k++) {
+            total_length  += edge_lengths[v][k];
+            integer_edges += floor(edge_lengths[v][k]) == edge_lengths[v][k] ? 1 : 0;
+        }
+    }
+    printf("Dijkstra over %ld edges, mean length %0.3f, %s.\n", total_edges,
+           total_edges == 0 ? 0.0 : total_length / (double)total_edges,
+           integer_edges == total_edges ? "all integers" : "real-valued");
+
+    static const enum frontier_kind kinds[FRONTIER_KIND_COUNT] = {
+        FRONTIER_STD_PRIORITY_QUEUE, FRONTIER_BINARY_HEAP, FRONTIER_RADIX_HEAP
+    };
+    double * expected = (double*)malloc((query_count + 1) * sizeof(double));
+    bool * reachable  = (bool*)malloc((query_count + 1) * sizeof(bool));
+    long nanoseconds[FRONTIER_KIND_COUNT];
+    if (expected == NULL || reachable == NULL) {
+        printf("Failed to allocate Dijkstra results.\n");
+        free(expected);
+        free(reachable);
+        return false;
+    }
+
+    bool consistent = true;
+    size_t paths_found    = 0;
+    size_t nodes_settled  = 0;
+    size_t edges_scanned  = 0;
+    double total_distance = 0.0;
+    struct shortest_path_search search;
+    for (size_t r = 0; r < FRONTIER_KIND_COUNT; r++) {
+        if (!init_shortest_path_search(&search, kinds[r])) {
+            printf("Failed to allocate Dijkstra state.\n");
+            free(expected);
+            free(reachable);
+            return false;
+        }
+        bool last_run = r + 1 == FRONTIER_KIND_COUNT;
+        nanoseconds[r] = 0;
+        for (size_t k = 0; k < query_count; k++) {
+            struct search_result result;
+            double distance = 0.0;
+            dijkstra_search(&search, queries[k].from, queries[k].to, &result, &distance);
+            nanoseconds[r] += result.nanoseconds;
+            if (r == 0) {
+                expected[k]  = distance;
+                reachable[k] = result.found_path;
+            } else if (result.found_path != reachable[k] ||
+                       (result.found_path && distance != expected[k])) {
+                // Ties may be settled in another order, which can
+                // round a real-valued sum differently.
+                //
+                double difference = distance - expected[k];
+                if (difference < 0) difference = -difference;
+                if (result.found_path != reachable[k] || difference > 1e-9 * expected[k]) {
+                    printf("%s disagrees with %s on %u -> %u.\n", frontier_kind_name(kinds[r]),
+                           frontier_kind_name(kinds[0]), queries[k].from, queries[k].to);
+                    consistent = false;
+                }
+            }
+            if (!last_run) continue;
+
+            nodes_settled += result.nodes_visited;
+            edges_scanned += result.edges_scanned;
+            if (result.found_path) {
+                ++paths_found;
+                total_distance += distance;
+                printf("(%ld / %ld) %u -> %u: distance %g Nodes settled: %ld Time elapsed [s]: %0.3f\n",
+                       k + 1, query_count, queries[k].from, queries[k].to, distance,
+                       result.nodes_visited, (float)result.nanoseconds / 1000000000.0f);
+            } else {
+                printf("(%ld / %ld) %u -> %u: No path found. Nodes settled: %ld Time elapsed [s]: %0.3f\n",
+                       k + 1, query_count, queries[k].from, queries[k].to,
+                       result.nodes_visited, (float)result.nanoseconds / 1000000000.0f);
+            }
+        }
+        if (last_run) {
+            printf("Paths found: %ld / %ld mean distance: %0.3f\n", paths_found, query_count,
+                   paths_found == 0 ? 0.0 : total_distance / (double)paths_found);
+            printf("Nodes settled: %ld edges scanned: %ld pushes: %ld largest frontier: %ld\n",
+                   nodes_settled, edges_scanned, search.pushes, search.max_frontier);
+        }
+        destroy_shortest_path_search(&search);
+    }
+
+    printf("%-20s %14s %14s %10s\n", "priority queue", "time [s]", "ns per edge", "speedup");
+    for (size_t r = 0; r < FRONTIER_KIND_COUNT; r++) {
+        printf("%-20s %14.3f %14.3f %9.2fx\n", frontier_kind_name(kinds[r]),
+               (double)nanoseconds[r] / 1000000000.0,
+               edges_scanned == 0 ? 0.0 : (double)nanoseconds[r] / (double)edges_scanned,
+               nanoseconds[r] == 0 ? 0.0 : (double)nanoseconds[0] / (double)nanoseconds[r]);
+    }
+    if (consistent) {
+        printf("All priority queues found the same distances.\n");
+    }
+    free(expected);
+    free(reachable);
+    return consistent;
+}
+
+// Runs the queries with 1 through max_threads worker threads.
+// Prints the per-query results of the widest run in input order,
+// followed by the throughput of every run.
+//
+bool run_concurrent_queries(const struct query * queries,
+                            size_t query_count,
+                            size_t max_threads) {
+    struct search_result * results = (struct search_result*)malloc(query_count * sizeof(struct search_result));
+    struct search_result * first   = (struct search_result*)malloc(query_count * sizeof(struct search_result));
+    long * wall_times              = (long*)malloc(max_threads * sizeof(long));
+    if (results == NULL || first == NULL || wall_times == NULL) {
+        printf("Failed to allocate result arrays.\n");
+        free(results);
+        free(first);
+        free(wall_times);
+        return false;
+    }
+
+    bool consistent = true;
+    for (size_t threads = 1; threads <= max_threads; threads++) {
+        wall_times[threads - 1] = run_queries_concurrently(queries, query_count, threads, results);
+        if (wall_times[threads - 1] < 0) {
+            free(results);
+            free(first);
+            free(wall_times);
+            return false;
+        }
+
+        // Every run has to agree with the single threaded one.
+        //
+        if (threads == 1) {
+            memcpy(first, results, query_count * sizeof(struct search_result));
+        } else {
+            for (size_t k = 0; k < query_count; k++) {
+                if (results[k].found_path != first[k].found_path ||
+                    results[k].nodes_visited != first[k].nodes_visited) {
+                    consistent = false;
+                }
+            }
+        }
+    }
+
+    for (size_t k = 0; k < query_count; k++) {
+        printf("(%ld / %ld) %u -> %u: %s Nodes visited: %ld Time elapsed [s]: %0.3f\n",
+               k + 1, query_count, to_external_id(queries[k].from), to_external_id(queries[k].to),
+               results[k].found_path ? "Path found." : "No path found.",
+               results[k].nodes_visited,
+               (float)results[k].nanoseconds / 1000000000.0f);
+    }
+
+    for (size_t threads = 1; threads <= max_threads; threads++) {
+        double seconds = (double)wall_times[threads - 1] / 1000000000.0;
+        printf("Threads: %ld Wall time [s]: %0.3f Queries per second: %0.2f Speedup: %0.2f\n",
+               threads, seconds, (double)query_count / seconds,
+               (double)wall_times[0] / (double)wall_times[threads - 1]);
+    }
+
+    if (!consistent) {
+        printf("Warning: results differ between thread counts.\n");
+    }
+
+    free(results);
+    free(first);
+    free(wall_times);
+    return consistent;
+}
+
+// Runs the queries split over 1 through max_processes worker
+// processes. Prints the per-query results of the widest run,
+// followed by the time and traffic of every run.
+//
+bool run_partitioned_scaling(const struct query * queries, size_t query_count,
+                             size_t max_processes) {
+    struct search_result * results = (struct search_result*)malloc(query_count * sizeof(struct search_result));
+    struct search_result * first   = (struct search_result*)malloc(query_count * sizeof(struct search_result));
+    long * wall_times              = (long*)malloc(max_processes * sizeof(long));
+    struct partition_stats * stats = (struct partition_stats*)malloc(max_processes * sizeof(struct partition_stats));
+    bool ok = results != NULL && first != NULL && wall_times != NULL && stats != NULL;
+    if (!ok) {
+        printf("Failed to allocate result arrays.\n");
+    }
+
+    bool consistent = true;
+    for (size_t processes = 1; processes <= max_processes && ok; processes++) {
+        wall_times[processes - 1] = run_partitioned_queries(queries, query_count, processes,
+                                                            results, &stats[processes - 1]);
+        ok = wall_times[processes - 1] >= 0;
+        if (processes == 1) {
+            memcpy(first, results, query_count * sizeof(struct search_result));
+        }
+        for (size_t k = 0; k < query_count && ok; k++) {
+            consistent = consistent && results[k].found_path == first[k].found_path;
+        }
+    }
+
+    for (size_t k = 0; k < query_count && ok; k++) {
+        printf("(%ld / %ld) %u -> %u: %s Nodes visited: %ld Time elapsed [s]: %0.3f\n",
+               k + 1, query_count, to_external_id(queries[k].from), to_external_id(queries[k].to),
+               results[k].found_path ? "Path found." : "No path found.",
+               results[k].nodes_visited,
+               (float)results[k].nanoseconds / 1000000000.0f);
+    }
+
+    for (size_t processes = 1; processes <= max_processes && ok; processes++) {
+        const struct partition_stats * run = &stats[processes - 1];
+        double seconds = (double)wall_times[processes - 1] / 1000000000.0;
+        printf("Processes: %ld Wall time [s]: %0.3f Queries per second: %0.2f Speedup: %0.2f "
+               "Levels: %ld Messages: %ld Vertices sent: %ld MiB sent: %0.1f Bytes per vertex: %0.2f\n",
+               processes, seconds, (double)query_count / seconds,
+               (double)wall_times[0] / (double)wall_times[processes - 1],
+               run->levels, run->messages, run->vertices_sent,
+               (double)run->bytes_sent / (1024.0 * 1024.0),
+               run->vertices_sent == 0 ? 0.0 : (double)run->bytes_sent / (double)run->vertices_sent);
+    }
+
+    if (!consistent) {
+        printf("Warning: results differ between process counts.\n");
+    }
+
+    free(results);
+    free(first);
+    free(wall_times);
+    free(stats);
+    return ok && consistent;
+}
+
+// Result of running the query set with one allocator backend.
+//
+struct allocator_run {
+    const struct allocator_backend * backend;
+    long search_nanoseconds;
+    long wall_nanoseconds;
+    struct allocator_call_counts calls;
+    long rss_before_kb;
+    long peak_rss_kb;
+    size_t paths_found;
+};
+
+bool run_with_allocator(const struct allocator_backend * backend,
+                        const struct query * queries, size_t query_count,
+                        struct allocator_run * run) {
+    queue::register_malloc(backend->malloc);
+    queue::register_free(backend->free);
+    reset_allocator_calls();
+    run->backend       = backend;
+    run->rss_before_kb = read_rss_kb();
+
+    struct search_state state;
+    if (!init_search_state(&state)) {
+        printf("Failed to allocate search state.\n");
+        return false;
+    }
+    backend->mark();
+
+    run->search_nanoseconds = 0;
+    run->paths_found        = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < query_count; k++) {
+        struct search_result result;
+        search_fptr(&state, queries[k].from, queries[k].to, &result);
+        if (backend->reclaims_per_search) {
+            // Nodes cached by the queue were allocated after mark()
+            // and are about to be handed out again.
+            //
+            state.q->shrink_to_fit();
+        }
+        backend->end_search();
+        run->search_nanoseconds += result.nanoseconds;
+        run->paths_found        += result.found_path ? 1 : 0;
+    }
+    GRAB_CLOCK(stop)
+    run->wall_nanoseconds = compute_timespec_diff(start, stop);
+    run->peak_rss_kb      = read_peak_rss_kb();
+
+    destroy_search_state(&state);
+    run->calls = allocator_calls();
+    backend->release();
+    return true;
+}
+
+// Runs the query set once per backend named in list and prints them
+// side by side. Peak RSS is reset before each backend where the
+// kernel allows it.
+//
+bool compare_allocators(const char * list, const struct query * queries,
+                        size_t query_count) {
+    const struct allocator_backend * chosen[16];
+    size_t chosen_count = 0;
+    if (strcmp(list, "all") == 0) {
+        for (size_t b = 0; b < allocator_backend_count && b < 16; b++) {
+            chosen[chosen_count++] = allocator_backends[b];
+        }
+    } else {
+        char names[256];
+        snprintf(names, sizeof(names), "%s", list);
+        for (char * name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+            const struct allocator_backend * backend = find_allocator_backend(name);
+            if (backend == NULL) {
+                printf("Unknown allocator: %s\n", name);
+                return false;
+            }
+            if (chosen_count < 16) {
+                chosen[chosen_count++] = backend;
+            }
+        }
+    }
+
+    struct allocator_run runs[16];
+    bool peak_is_per_run = true;
+    for (size_t b = 0; b < chosen_count; b++) {
+        peak_is_per_run = reset_peak_rss() && peak_is_per_run;
+        if (!run_with_allocator(chosen[b], queries, query_count, &runs[b])) {
+            return false;
+        }
+    }
 
-	rows[i]->adjacent_nodes[size] = j;
-	++rows[i]->size;
+    printf("%-8s %12s %10s %12s %12s %14s %14s %6s\n", "backend", "BFS time [s]", "wall [s]",
+           "malloc calls", "free calls", "peak RSS [MiB]", "RSS grew [MiB]", "found");
+    bool consistent = true;
+    for (size_t b = 0; b < chosen_count; b++) {
+        const struct allocator_run * run = &runs[b];
+        printf("%-8s %12.3f %10.3f %12lu %12lu %14.1f %14.1f %6lu\n", run->backend->name,
+               (double)run->search_nanoseconds / 1000000000.0,
+               (double)run->wall_nanoseconds / 1000000000.0,
+               run->calls.malloc_calls, run->calls.free_calls,
+               (double)run->peak_rss_kb / 1024.0,
+               (double)(run->peak_rss_kb - run->rss_before_kb) / 1024.0,
+               run->paths_found);
+        if (run->paths_found != runs[0].paths_found) {
+            consistent = false;
+        }
+    }
+    if (!peak_is_per_run) {
+        printf("Peak RSS could not be reset between backends, it is the process high-water mark.\n");
     }
+    if (!consistent) {
+        printf("Warning: backends disagree on the number of paths found.\n");
+    }
+    return consistent;
 }
 
-int main(void) {
+// Builds the workload, from the nodes file or at random, and runs
+// it through the latency driver.
+//
+bool run_workload_driver(const struct options * options, FILE * node_fptr) {
+    size_t count = options->workload_queries;
+    struct workload_query * workload = NULL;
+    if (options->workload_nodes) {
+        struct query * queries = read_queries(node_fptr, &count);
+        if (queries == NULL) {
+            return false;
+        }
+        workload = (struct workload_query*)malloc(count * sizeof(struct workload_query));
+        if (workload == NULL) {
+            printf("Failed to allocate workload.\n");
+            free(queries);
+            return false;
+        }
+        for (size_t k = 0; k < count; k++) {
+            workload[k].from = to_internal_id(queries[k].from);
+            workload[k].to   = to_internal_id(queries[k].to);
+        }
+        free(queries);
+        if (!measure_workload_distances(workload, count)) {
+            free(workload);
+            return false;
+        }
+    } else {
+        workload = generate_workload(&count, options->workload_seed, options->workload_distance);
+        if (workload == NULL) {
+            return false;
+        }
+    }
+
+    bool ok = run_workload(workload, count, options->workload_seed, options->workload_json);
+    free(workload);
+    return ok;
+}
+
+// Runs the queries in the nodes file over the sharded graph at
+// options->sharded_path, reading the adjacency from disk as it goes.
+//
+bool run_sharded_queries(const struct options * options) {
+    FILE * node_fptr = fopen(options->nodes_path, "r");
+    if (node_fptr == NULL) {
+        printf("Error opening node list.\n");
+        return false;
+    }
+    size_t query_count = 0;
+    struct query * queries = read_queries(node_fptr, &query_count);
+    fclose(node_fptr);
+    if (queries == NULL || !open_sharded_graph(options->sharded_path)) {
+        free(queries);
+        return false;
+    }
+    printf("Sharded graph %s: %ld vertices, %ld edges, %ld shards, largest %0.1f MiB\n",
+           options->sharded_path, sharded.vertex_count, sharded.edge_count, sharded.shard_count,
+           (double)sharded.max_shard_bytes / (1024.0 * 1024.0));
+
+    struct sharded_search search;
+    if (!init_sharded_search(&search)) {
+        printf("Failed to allocate sharded search state.\n");
+        close_sharded_graph();
+        free(queries);
+        return false;
+    }
+
+    long total_nanoseconds = 0;
+    size_t paths_found     = 0;
+    for (size_t k = 0; k < query_count; k++) {
+        struct search_result result;
+        sharded_breadth_first_search(&search, queries[k].from, queries[k].to, &result);
+        total_nanoseconds += result.nanoseconds;
+        paths_found       += result.found_path ? 1 : 0;
+        printf("(%ld / %ld) %u -> %u: %s Nodes visited: %ld Time elapsed [s]: %0.3f\n",
+               k + 1, query_count, queries[k].from, queries[k].to,
+               result.found_path ? "Path found." : "No path found.",
+               result.nodes_visited, (float)result.nanoseconds / 1000000000.0f);
+    }
+
+    double seconds = (double)total_nanoseconds / 1000000000.0;
+    printf("Paths found: %ld / %ld BFS time [s]: %0.3f\n", paths_found, query_count, seconds);
+    printf("Levels: %ld Shard reads: %ld (%0.1f per level) Read: %0.1f MiB (%0.1f MiB/s)\n",
+           search.levels, search.shards_read,
+           search.levels == 0 ? 0.0 : (double)search.shards_read / (double)search.levels,
+           (double)search.bytes_read / (1024.0 * 1024.0),
+           seconds == 0.0 ? 0.0 : (double)search.bytes_read / (1024.0 * 1024.0) / seconds);
+
+    destroy_sharded_search(&search);
+    close_sharded_graph();
+    free(queries);
+    return true;
+}
+
+// Frees the graph and everything built from it.
+//
+void teardown(FILE * fptr, FILE * node_fptr) {
+    TRACE_SPAN("teardown");
+    close_perf_events();
+    free_graph();
+    free_compressed_graph();
+    free_relabeling();
+    free_edge_weights();
+    free_edge_lengths();
+    fclose(fptr);
+    if (node_fptr != NULL) {
+        fclose(node_fptr);
+    }
+}
+
+int main(int argc, char ** argv) {
+
+    struct options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+#if TRACING_ENABLED
+    write_chrome_trace_at_exit(options.trace_path);
+#else
+    if (options.trace_path != NULL) {
+        printf("Tracing is compiled out, rebuild with 'make clean; make TRACING=1'.\n");
+    }
+#endif
+
+    // When answering on stdout, everything else the program prints
+    // goes to stderr so that the response stream stays clean.
+    //
+    int response_fd = STDOUT_FILENO;
+    if (options.server && options.server_socket == NULL) {
+        response_fd = dup(STDOUT_FILENO);
+        if (response_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("dup");
+            return 1;
+        }
+    }
 
     // Initialize malloc() and free()
     //
-    queue::register_malloc(instrumented_malloc);
-    queue::register_free(instrumented_free);
+    // The allocation profiler is not thread safe, so the
+    // concurrent scheduler and the server go straight to malloc()
+    // and free().
+    //
+    if (options.max_threads > 0 || options.server) {
+        queue::register_malloc(malloc);
+        queue::register_free(free);
+        deque::register_malloc(malloc);
+        deque::register_free(free);
+        monotone_queue::register_malloc(malloc);
+        monotone_queue::register_free(free);
+    } else {
+        setup_alloc_profiler();
+        queue::register_malloc(profiled_malloc);
+        queue::register_free(profiled_free);
+        deque::register_malloc(profiled_malloc);
+        deque::register_free(profiled_free);
+        monotone_queue::register_malloc(profiled_malloc);
+        monotone_queue::register_free(profiled_free);
+    }
 
 #ifdef COMPILE_ARM_PMU_CODE
     // Register ARM PMUs
@@ -177,39 +1405,34 @@ int main(void) {
     setup_pmu_events();
 #endif
 
-    // Microbenchmark malloc() and free().
-    // These function calls are too short to wrap a high
-    // precision timer around them, so run them 10,000 times
-    // and take the arithmetic mean.
+    // Everywhere else, try perf_event_open(). Without it the
+    // counter calls below do nothing.
     //
-    for(size_t i = 0; i < 4; i++) {
-        // Warm them up a few times.
-	//
-        malloc_microbenchmark();
-	free_microbenchmark();
+    if (options.counters) {
+        setup_perf_events();
     }
 
-    // Measure.
+    // Neither of these loads the matrix into memory.
     //
-    struct timespec malloc_start, malloc_end;
-    struct timespec free_start, free_end;
-
-    GRAB_CLOCK(malloc_start)
-    malloc_microbenchmark();
-    GRAB_CLOCK(malloc_end)
-    GRAB_CLOCK(free_start)
-    free_microbenchmark();
-    GRAB_CLOCK(free_end)
-    average_malloc_time = compute_timespec_diff(malloc_start, malloc_end) / MALLOC_MICRO_ITERATIONS;
-    average_free_time   = compute_timespec_diff(free_start, free_end) / MALLOC_MICRO_ITERATIONS;
-
-    printf("Average time [ns] per malloc() call: %ld\n", average_malloc_time);
-    printf("Average time [ns] per free() call: %ld\n", average_free_time);
+    if (options.write_shards != NULL) {
+        bool ok = write_sharded_graph(options.matrix_path, options.write_shards, options.shard_bytes);
+        close_perf_events();
+        return ok ? 0 : 1;
+    }
+    if (options.sharded_path != NULL) {
+        bool ok = run_sharded_queries(&options);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        close_perf_events();
+        return ok ? 0 : 1;
+    }
 
     // Parse the file.
     //
-    FILE* fptr      = fopen("wikipedia-20070206/wikipedia-20070206.mtx", "r");
-    FILE* node_fptr = fopen("nodes", "r"); 
+    TRACE_BEGIN(open_files);
+    FILE* fptr      = fopen(options.matrix_path, "r");
+    FILE* node_fptr = fopen(options.nodes_path, "r");
+    TRACE_END(open_files);
 
     if (fptr == NULL) {
         printf("Error opening matrix.\n");
@@ -217,11 +1440,13 @@ int main(void) {
         return 1;
     }
 
-    if (node_fptr == NULL) {
+    bool random_workload = options.workload && !options.workload_nodes;
+    if (node_fptr == NULL && !options.server && !random_workload) {
         printf("Error opening node list.\n");
 	return 1;
     }
 
+    TRACE_BEGIN(parse_banner);
     MM_typecode matrix_code;
 
     if (mm_read_banner(fptr, &matrix_code) != 0) {
@@ -243,62 +1468,262 @@ int main(void) {
         return 1;
     }
 
-    printf("Wikipedia matrix size m: %d n: %d nz: %d\n", m, n, nz);
+    // Pattern matrices have only the coordinates, real and integer
+    // ones a value after them.
+    //
+    if (mm_is_complex(matrix_code)) {
+        printf("Complex matrices are not supported.\n");
+        return 1;
+    }
+    bool has_values = !mm_is_pattern(matrix_code);
+
+    TRACE_END(parse_banner);
+    printf("Matrix %s size m: %d n: %d nz: %d\n", options.matrix_path, m, n, nz);
 
     // Start reading in the data.
     //
-    rows = (struct row**)malloc(sizeof(struct row*) * (m + 1));
-    if (rows == NULL) {
+    TRACE_BEGIN(allocate_graph);
+    if (!allocate_graph(m + 1)) {
         printf("Failed to allocate row array.\n");
 	return 1;
     }
+    if (options.zero_one && !allocate_edge_weights(m + 1)) {
+        printf("Failed to allocate edge weights.\n");
+        return 1;
+    }
+    if (options.weighted && !allocate_edge_lengths(m + 1)) {
+        printf("Failed to allocate edge lengths.\n");
+        return 1;
+    }
+    TRACE_END(allocate_graph);
 
     printf("Allocated %ld bytes for row array.\n",
            sizeof(struct row*) * m + 1);
 
-    // Zero out the row array.
-    // A NULL means that a particular node in the graph
-    // has no directed edges to other nodes.
-    //
-    for (int i = 0; i < m + 1; i++) {
-        rows[i] = NULL;
-    }
-
-    // Parse.
+    // Parse. Edges go into the graph as they are read, so the
+    // parse_edges span includes building the adjacency lists, and
+    // the time of each is kept separately.
     //
+    TRACE_BEGIN(parse_edges);
+#if TRACING_ENABLED
+    uint64_t build_ns = 0;
+#endif
     size_t line_count = 0;
     while(!feof(fptr)) {
 	// Grab next directed edge.
 	// A pair (i, j) means that node i links to node j.
 	//
 	unsigned int i, j;
-        int retval = fscanf(fptr, "%d %d", &i, &j);
-	if (!(retval == 2 || retval == -1)) {
+	double value = 1.0;
+        int retval = has_values ? fscanf(fptr, "%d %d %lg", &i, &j, &value)
+                                : fscanf(fptr, "%d %d", &i, &j);
+	if (!(retval == (has_values ? 3 : 2) || retval == -1)) {
             printf("File parsing error with fscanf() return value of: %d.\n", retval);
 	    return 1;
 	}
 
+#if TRACING_ENABLED
+	uint64_t build_start = trace_clock_ns();
+	add_edge(i, j);
+	build_ns += trace_clock_ns() - build_start;
+#else
 	add_edge(i, j);
+#endif
+	if (options.zero_one) {
+	    add_edge_weight(i, value == 0.0 ? 0 : 1);
+	}
+	if (options.weighted) {
+	    // Also turns -0 into 0, whose bits sort first.
+	    //
+	    if (!(value >= 0.0 && value <= DBL_MAX)) {
+	        printf("Edge %u -> %u has length %g, lengths must be finite and non-negative.\n",
+	               i, j, value);
+	        return 1;
+	    }
+	    add_edge_length(i, value == 0.0 ? 0.0 : value);
+	}
 	++line_count;
     }
+    TRACE_END(parse_edges);
+#if TRACING_ENABLED
+    // Shown as one span nested at the start of parse_edges, since
+    // the add_edge() calls were spread all through it.
+    //
+    trace_record("build_graph (add_edge total)", trace_parse_edges_start,
+                 trace_parse_edges_start + build_ns, line_count);
+#endif
     printf("Read %ld lines of matrix data.\n", line_count);
 
+    // The server and the workload driver take the graph as it will
+    // be searched, without the before and after comparisons.
+    //
+    bool prepare_only = options.server || options.workload;
+    if (prepare_only && options.relabel != ORDER_NONE) {
+        if (!relabel_graph(options.relabel)) {
+            printf("Failed to relabel graph.\n");
+            return 1;
+        }
+        printf("Relabeled graph by %s order.\n", vertex_order_name(options.relabel));
+    }
+
+    if (prepare_only && options.edge_deltas != NULL && !apply_edge_deltas(&options, NULL, 0)) {
+        return 1;
+    }
+
+    if (prepare_only && options.compress && !compress_graph()) {
+        return 1;
+    }
+
+    if (prepare_only && options.prefetch) {
+        search_fptr = prefetch_breadth_first_search;
+    }
+
+    if (prepare_only && options.place_memory) {
+        set_memory_placement(options.huge_pages, options.numa);
+        if (!place_graph()) {
+            printf("Failed to allocate placed graph.\n");
+            return 1;
+        }
+        print_placement_summary();
+    }
+
+    if (options.server) {
+        size_t thread_count = options.max_threads;
+        if (thread_count == 0) {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            thread_count = online > 0 ? (size_t)online : 1;
+        }
+        int status = run_query_server(options.server_socket, response_fd, thread_count);
+        teardown(fptr, node_fptr);
+        return status;
+    }
+
+    if (options.workload) {
+        bool ok = run_workload_driver(&options, node_fptr);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        teardown(fptr, node_fptr);
+        return ok ? 0 : 1;
+    }
+
+    size_t query_count = 0;
+    struct query * queries = read_queries(node_fptr, &query_count);
+    if (queries == NULL) {
+        return 1;
+    }
+
+    // From here on, queries hold ids into the relabeled rows.
+    //
+    if (options.relabel != ORDER_NONE) {
+        if (!relabel_and_compare(options.relabel, queries, query_count)) {
+            return 1;
+        }
+        reset_alloc_profile();
+    }
+
+    // Everything after this searches the updated graph.
+    //
+    if (options.edge_deltas != NULL) {
+        if (!apply_edge_deltas(&options, queries, query_count)) {
+            return 1;
+        }
+        reset_alloc_profile();
+    }
+
+    // The concurrent scheduler searches the compressed rows from
+    // here on, the default sequential loop keeps the original
+    // breadth_first_search().
+    //
+    if (options.compress) {
+        if (!compress_and_compare(queries, query_count)) {
+            return 1;
+        }
+        reset_alloc_profile();
+    }
+
+    // Everything from here on, the allocator regions included, follows
+    // the placement.
+    //
+    if (options.place_memory) {
+        if (!place_and_compare(&options, queries, query_count)) {
+            return 1;
+        }
+        reset_alloc_profile();
+    }
+
+    // Last, so that it compares the pipeline on the final layout.
+    //
+    if (options.prefetch) {
+        if (!prefetch_and_compare(queries, query_count)) {
+            return 1;
+        }
+        reset_alloc_profile();
+    }
+
+    if (options.weighted) {
+        if (!has_values) {
+            printf("The matrix has no values, every edge has length 1.\n");
+        }
+        bool ok = run_weighted_queries(queries, query_count);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        free(queries);
+        teardown(fptr, node_fptr);
+        return ok ? 0 : 1;
+    }
+
+    if (options.zero_one) {
+        if (!has_values) {
+            printf("The matrix has no values, every edge weighs 1.\n");
+        }
+        bool ok = run_zero_one_queries(queries, query_count);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        free(queries);
+        teardown(fptr, node_fptr);
+        return ok ? 0 : 1;
+    }
+
+    if (options.allocators != NULL) {
+        bool ok = compare_allocators(options.allocators, queries, query_count);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        free(queries);
+        teardown(fptr, node_fptr);
+        return ok ? 0 : 1;
+    }
+
+    if (options.max_processes > 0) {
+        bool ok = run_partitioned_scaling(queries, query_count, options.max_processes);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        free(queries);
+        teardown(fptr, node_fptr);
+        return ok ? 0 : 1;
+    }
+
+    if (options.max_threads > 0) {
+        bool consistent = run_concurrent_queries(queries, query_count, options.max_threads);
+        printf("All work complete, exit.\n");
+        fflush(stdout);
+        free(queries);
+        teardown(fptr, node_fptr);
+        return consistent ? 0 : 1;
+    }
+
     // Start the BFS.
     //
-    for (size_t i = 0; i < 100; i++) {
-        unsigned int node_i = 0; 
-        unsigned int node_j = 0;
-        int retval = fscanf(node_fptr, "%d %d\n", &node_i, &node_j);	
-	if (!(retval == 2 || retval == -1)) {
-            printf("Parsing error.\n");
-	    return 1;
-	}
+    for (size_t i = 0; i < query_count; i++) {
+        unsigned int node_i = queries[i].from;
+        unsigned int node_j = queries[i].to;
         printf("(%ld / %ld) Searching for a connection between node %d -> %d\n", 
-               i + 1, 100L, node_i, node_j);
+               i + 1, query_count, to_external_id(node_i), to_external_id(node_j));
 #ifdef COMPILE_ARM_PMU_CODE
 	reset_and_start_pmu_counters();
 #endif
+	reset_and_start_perf_counters();
         bool success = breadth_first_search(node_i, node_j);
+	stop_perf_counters();
 #ifdef COMPILE_ARM_PMU_CODE
 	stop_pmu_counters();
 #endif
@@ -310,11 +1735,13 @@ int main(void) {
 
 	// Clear visited fields for next run.
 	//
+	TRACE_BEGIN(reset_visited);
         for (int j = 0; j < m + 1; j++) {
             if (rows[j]) {
                 rows[j]->visited = false;
 	    }
 	}
+	TRACE_END(reset_visited);
 
 	// Grab PMU data.
 	//
@@ -330,26 +1757,21 @@ int main(void) {
 	//printf("L2D load hit rate %0.3f\n", 1.0f - ((float)pmu_counters[3] / (float)pmu_counters[2]));
 	//printf("Branch prediction accuracy: %0.3f\n", 1.0f - ((float)pmu_counters[5] / (float)pmu_counters[4]));
 #endif
+	uint64_t perf_counters[PERF_COUNTER_COUNT];
+	read_perf_data(perf_counters);
+	print_perf_summary("", perf_counters, edges_scanned);
 
-	// Clear malloc and free invocation counts.
-	//
-	malloc_invocations = 0;
-	free_invocations   = 0;
+	edges_scanned = 0;
     }
 
+    print_alloc_profile(total_search_nanoseconds);
     printf("All work complete, exit.\n");
     fflush(stdout);
 
     // Free
     //
-    for (int i = 0; i < m + 1; i++) {
-        if (rows[i] == NULL) continue;
-	free(rows[i]->adjacent_nodes);
-	free(rows[i]);
-    }
-
-    free(rows);
-    fclose(fptr);
+    free(queries);
+    teardown(fptr, node_fptr);
 
     return 0;
 }
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "relabel.h"
+#include "trace.h"
+
+unsigned int * internal_ids = NULL;
+unsigned int * external_ids = NULL;
+
+void free_relabeling(void) {
+    free(internal_ids);
+    free(external_ids);
+    internal_ids = NULL;
+    external_ids = NULL;
+}
+
+bool parse_vertex_order(const char * name, enum vertex_order * order) {
+    if (strcmp(name, "none") == 0) {
+        *order = ORDER_NONE;
+    } else if (strcmp(name, "degree") == 0) {
+        *order = ORDER_DEGREE;
+    } else if (strcmp(name, "bfs") == 0) {
+        *order = ORDER_BFS;
+    } else if (strcmp(name, "rcm") == 0) {
+        *order = ORDER_RCM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char * vertex_order_name(enum vertex_order order) {
+    switch (order) {
+        case ORDER_DEGREE: return "degree";
+        case ORDER_BFS:    return "bfs";
+        case ORDER_RCM:    return "rcm";
+        default:           return "none";
+    }
+}
+
+static size_t row_size(unsigned int v) {
+    return rows[v] == NULL ? 0 : rows[v]->size;
+}
+
+// In + out degree of every vertex.
+//
+static size_t * compute_degrees(void) {
+    size_t * degrees = (size_t*)calloc(row_count, sizeof(size_t));
+    if (degrees == NULL) {
+        return NULL;
+    }
+
+    for (size_t v = 0; v < row_count; v++) {
+        if (rows[v] == NULL) continue;
+        degrees[v] += rows[v]->size;
+        for (size_t k = 0; k < rows[v]->size; k++) {
+            ++degrees[rows[v]->adjacent_nodes[k]];
+        }
+    }
+    return degrees;
+}
+
+// Counting sort of vertices 1 .. row_count - 1 by degree, stable
+// by id. Fills order[1 ..], order[0] is left as 0.
+//
+static bool sort_by_degree(const size_t * degrees, unsigned int * order,
+                           bool descending) {
+    size_t max_degree = 0;
+    for (size_t v = 1; v < row_count; v++) {
+        if (degrees[v] > max_degree) max_degree = degrees[v];
+    }
+
+    size_t * starts = (size_t*)calloc(max_degree + 2, sizeof(size_t));
+    if (starts == NULL) {
+        return false;
+    }
+
+    for (size_t v = 1; v < row_count; v++) {
+        size_t bucket = descending ? max_degree - degrees[v] : degrees[v];
+        ++starts[bucket + 1];
+    }
+    for (size_t b = 1; b < max_degree + 2; b++) {
+        starts[b] += starts[b - 1];
+    }
+
+    order[0] = 0;
+    for (size_t v = 1; v < row_count; v++) {
+        size_t bucket = descending ? max_degree - degrees[v] : degrees[v];
+        order[1 + starts[bucket]++] = v;
+    }
+
+    free(starts);
+    return true;
+}
+
+// Breadth first numbering. The order array doubles as the FIFO.
+// Unreached vertices start new searches, highest degree first.
+//
+static bool order_bfs(const size_t * degrees, unsigned int * order) {
+    unsigned int * roots = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    bool * placed        = (bool*)calloc(row_count, sizeof(bool));
+    if (roots == NULL || placed == NULL || !sort_by_degree(degrees, roots, true)) {
+        free(roots);
+        free(placed);
+        return false;
+    }
+
+    size_t tail = 1;
+    order[0]    = 0;
+    for (size_t r = 1; r < row_count; r++) {
+        if (placed[roots[r]]) continue;
+        placed[roots[r]] = true;
+        size_t head      = tail;
+        order[tail++]    = roots[r];
+
+        while (head < tail) {
+            unsigned int v = order[head++];
+            for (size_t k = 0; k < row_size(v); k++) {
+                unsigned int neighbor = rows[v]->adjacent_nodes[k];
+                if (neighbor == 0 || placed[neighbor]) continue;
+                placed[neighbor] = true;
+                order[tail++]    = neighbor;
+            }
+        }
+    }
+
+    free(roots);
+    free(placed);
+    return true;
+}
+
+static const size_t * rcm_degrees = NULL;
+
+static int compare_by_degree(const void * a, const void * b) {
+    size_t x = rcm_degrees[*(const unsigned int*)a];
+    size_t y = rcm_degrees[*(const unsigned int*)b];
+    return (x > y) - (x < y);
+}
+
+// Cuthill-McKee: a breadth first numbering that starts from low
+// degree vertices and visits each vertex's neighbors in increasing
+// degree order, then reversed.
+//
+static bool order_rcm(const size_t * degrees, unsigned int * order) {
+    unsigned int * roots = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    bool * placed        = (bool*)calloc(row_count, sizeof(bool));
+    if (roots == NULL || placed == NULL || !sort_by_degree(degrees, roots, false)) {
+        free(roots);
+        free(placed);
+        return false;
+    }
+
+    rcm_degrees = degrees;
+    size_t tail = 1;
+    order[0]    = 0;
+    for (size_t r = 1; r < row_count; r++) {
+        if (placed[roots[r]]) continue;
+        placed[roots[r]] = true;
+        size_t head      = tail;
+        order[tail++]    = roots[r];
+
+        while (head < tail) {
+            unsigned int v = order[head++];
+            size_t first   = tail;
+            for (size_t k = 0; k < row_size(v); k++) {
+                unsigned int neighbor = rows[v]->adjacent_nodes[k];
+                if (neighbor == 0 || placed[neighbor]) continue;
+                placed[neighbor] = true;
+                order[tail++]    = neighbor;
+            }
+            qsort(&order[first], tail - first, sizeof(unsigned int), compare_by_degree);
+        }
+    }
+    rcm_degrees = NULL;
+
+    for (size_t lo = 1, hi = row_count - 1; lo < hi; lo++, hi--) {
+        unsigned int swap = order[lo];
+        order[lo]         = order[hi];
+        order[hi]         = swap;
+    }
+
+    free(roots);
+    free(placed);
+    return true;
+}
+
+// Builds the new rows array in new id order, so that the row
+// structs and adjacency lists are also laid out in that order.
+//
+static struct row ** rebuild_rows(const unsigned int * order,
+                                  const unsigned int * new_ids) {
+    struct row ** relabeled = (struct row**)calloc(row_count, sizeof(struct row*));
+    if (relabeled == NULL) {
+        return NULL;
+    }
+
+    for (size_t n = 0; n < row_count; n++) {
+        struct row * old_row = rows[order[n]];
+        if (old_row == NULL) continue;
+
+        // Keep the capacity that add_edge() expects, a multiple
+        // of 16 with at least one free slot.
+        //
+        size_t capacity     = ((old_row->size + 1 + 15) / 16) * 16;
+        struct row * row    = (struct row*)malloc(sizeof(struct row));
+        unsigned int * adj  = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+        if (row == NULL || adj == NULL) {
+            free(row);
+            free(adj);
+            for (size_t k = 0; k < n; k++) {
+                if (relabeled[k] == NULL) continue;
+                free(relabeled[k]->adjacent_nodes);
+                free(relabeled[k]);
+            }
+            free(relabeled);
+            return NULL;
+        }
+
+        for (size_t k = 0; k < old_row->size; k++) {
+            adj[k] = new_ids[old_row->adjacent_nodes[k]];
+        }
+        row->size           = old_row->size;
+        row->adjacent_nodes = adj;
+        row->visited        = false;
+        relabeled[n]        = row;
+    }
+    return relabeled;
+}
+
+bool relabel_graph(enum vertex_order order) {
+    TRACE_SPAN("relabel_graph");
+    if (order == ORDER_NONE) {
+        return true;
+    }
+
+    size_t * degrees      = compute_degrees();
+    unsigned int * sorted = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    unsigned int * ids    = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    if (degrees == NULL || sorted == NULL || ids == NULL) {
+        free(degrees);
+        free(sorted);
+        free(ids);
+        return false;
+    }
+
+    bool ok;
+    switch (order) {
+        case ORDER_DEGREE: ok = sort_by_degree(degrees, sorted, true); break;
+        case ORDER_BFS:    ok = order_bfs(degrees, sorted);            break;
+        default:           ok = order_rcm(degrees, sorted);            break;
+    }
+    free(degrees);
+
+    // sorted[new] = old, ids[old] = new.
+    //
+    struct row ** relabeled = NULL;
+    if (ok) {
+        for (size_t n = 0; n < row_count; n++) {
+            ids[sorted[n]] = n;
+        }
+        relabeled = rebuild_rows(sorted, ids);
+    }
+    if (relabeled == NULL) {
+        free(sorted);
+        free(ids);
+        return false;
+    }
+
+    // Compose with any earlier relabeling, so the mapping always
+    // goes from file ids to the current ids.
+    //
+    if (internal_ids != NULL) {
+        for (size_t f = 0; f < row_count; f++) {
+            internal_ids[f] = ids[internal_ids[f]];
+        }
+        free(ids);
+    } else {
+        internal_ids = ids;
+    }
+    if (external_ids == NULL) {
+        external_ids = sorted;
+    } else {
+        for (size_t n = 0; n < row_count; n++) {
+            sorted[n] = external_ids[sorted[n]];
+        }
+        free(external_ids);
+        external_ids = sorted;
+    }
+
+    size_t count = row_count;
+    free_graph();
+    rows      = relabeled;
+    row_count = count;
+    return true;
+}
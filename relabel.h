@@ -0,0 +1,57 @@
+#ifndef RELABEL_H_
+#define RELABEL_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+
+// Vertex orderings that relabel_graph() can renumber the graph by.
+//
+// ORDER_DEGREE puts high degree (in + out) vertices first, so the
+// hubs that most searches touch share cache lines and pages.
+// ORDER_BFS numbers vertices in the order a breadth first search
+// from the highest degree vertex reaches them. ORDER_RCM is Reverse
+// Cuthill-McKee over the out-edges, which keeps every vertex's
+// neighbors close to it in id space.
+//
+enum vertex_order {
+    ORDER_NONE,
+    ORDER_DEGREE,
+    ORDER_BFS,
+    ORDER_RCM
+};
+
+// Returns FALSE if name is not one of "none", "degree", "bfs", "rcm".
+//
+bool parse_vertex_order(const char * name, enum vertex_order * order);
+const char * vertex_order_name(enum vertex_order order);
+
+// Renumbers every vertex in the graph by order, and rebuilds rows
+// in the new id order with rewritten adjacency lists. Id 0, unused
+// by Matrix Market files, keeps its id.
+//
+// Returns FALSE on allocation failure, in which case the graph is
+// left untouched.
+//
+bool relabel_graph(enum vertex_order order);
+
+// Mapping between the ids in the input files and the ids used in
+// rows. Both are NULL until the graph has been relabeled.
+//
+extern unsigned int * internal_ids;
+extern unsigned int * external_ids;
+
+void free_relabeling(void);
+
+// Translates an id from the 'nodes' file or a client into rows,
+// and back. Out of range ids pass through unchanged.
+//
+static inline unsigned int to_internal_id(unsigned int id) {
+    return (internal_ids == NULL || id >= row_count) ? id : internal_ids[id];
+}
+
+static inline unsigned int to_external_id(unsigned int id) {
+    return (external_ids == NULL || id >= row_count) ? id : external_ids[id];
+}
+
+#endif
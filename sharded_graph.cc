@@ -0,0 +1,507 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "mmio.h"
+#include "sharded_graph.h"
+#include "timing.h"
+#include "trace.h"
+
+// Edges collected per shard while converting before they are written
+// to the scratch file, 32 KiB worth.
+//
+#define SHARD_BUCKET_EDGES 4096
+
+// Shards start on a page boundary.
+//
+#define SHARD_ALIGNMENT 4096
+
+struct sharded_header {
+    char magic[8];
+    uint64_t vertex_count;
+    uint64_t edge_count;
+    uint64_t shard_count;
+};
+
+struct sharded_graph sharded = { -1, 0, 0, 0, NULL, 0 };
+
+static bool write_fully(int fd, const void * data, size_t bytes, off_t offset) {
+    const char * from = static_cast<const char*>(data);
+    while (bytes != 0) {
+        ssize_t written = pwrite(fd, from, bytes, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        from   += written;
+        bytes  -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool read_fully(int fd, void * data, size_t bytes, off_t offset) {
+    char * to = static_cast<char*>(data);
+    while (bytes != 0) {
+        ssize_t got = pread(fd, to, bytes, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        to     += got;
+        bytes  -= got;
+        offset += got;
+    }
+    return true;
+}
+
+static size_t align_up(size_t value) {
+    return (value + SHARD_ALIGNMENT - 1) / SHARD_ALIGNMENT * SHARD_ALIGNMENT;
+}
+
+// Bytes shard s takes on disk, from its offsets to its last neighbor.
+//
+static size_t shard_size(const struct shard_extent * shards, size_t s) {
+    size_t vertices = shards[s + 1].first_vertex - shards[s].first_vertex;
+    return (vertices + 1 + shards[s].edge_count) * sizeof(uint32_t);
+}
+
+// The shard holding vertex v.
+//
+static size_t shard_of(const struct shard_extent * shards, size_t shard_count, uint64_t v) {
+    size_t low  = 0;
+    size_t high = shard_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (shards[middle].first_vertex <= v) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Opens a Matrix Market file and reads up to its first edge.
+//
+static FILE * open_matrix(const char * matrix_path, size_t * vertex_count) {
+    FILE * matrix = fopen(matrix_path, "r");
+    if (matrix == NULL) {
+        printf("Error opening matrix.\n");
+        return NULL;
+    }
+    MM_typecode matrix_code;
+    int m, n, nz;
+    if (mm_read_banner(matrix, &matrix_code) != 0 ||
+        mm_read_mtx_crd_size(matrix, &m, &n, &nz) != 0 || m != n || m < 0) {
+        printf("Malformed Matrix Market file.\n");
+        fclose(matrix);
+        return NULL;
+    }
+    *vertex_count = (size_t)m + 1;
+    return matrix;
+}
+
+// Reads the next edge. Returns FALSE at the end of the file, and
+// sets *failed if the file is malformed there instead.
+//
+static bool read_edge(FILE * matrix, size_t vertex_count, unsigned int * i, unsigned int * j,
+                      bool * failed) {
+    int retval = fscanf(matrix, "%u %u", i, j);
+    if (retval == 2 && *i < vertex_count && *j < vertex_count) {
+        return true;
+    }
+    if (retval != EOF) {
+        printf("Edge parsing error or vertex out of range.\n");
+        *failed = true;
+    }
+    return false;
+}
+
+// Splits the vertices into shards of up to shard_bytes, a vertex
+// with more edges than that getting a shard of its own, and lays
+// them out after the header. Returns the table with a terminating
+// entry, or NULL on allocation failure.
+//
+static struct shard_extent * plan_shards(const uint32_t * degrees, size_t vertex_count,
+                                         size_t shard_bytes, size_t * shard_count) {
+    size_t capacity = 64;
+    size_t count    = 0;
+    struct shard_extent * shards = static_cast<struct shard_extent*>(
+        malloc(capacity * sizeof(struct shard_extent)));
+    if (shards == NULL) {
+        return NULL;
+    }
+
+    size_t first = 0;
+    size_t bytes = sizeof(uint32_t);
+    size_t edges = 0;
+    for (size_t v = 0; v <= vertex_count; v++) {
+        size_t row = v < vertex_count ? (1 + (size_t)degrees[v]) * sizeof(uint32_t) : 0;
+        if (v == vertex_count || (v != first && bytes + row > shard_bytes)) {
+            // Room for this shard and the terminating entry.
+            //
+            if (count + 2 > capacity) {
+                capacity *= 2;
+                struct shard_extent * grown = static_cast<struct shard_extent*>(
+                    realloc(shards, capacity * sizeof(struct shard_extent)));
+                if (grown == NULL) {
+                    free(shards);
+                    return NULL;
+                }
+                shards = grown;
+            }
+            shards[count].first_vertex = first;
+            shards[count].edge_count   = edges;
+            ++count;
+            first = v;
+            bytes = sizeof(uint32_t);
+            edges = 0;
+        }
+        bytes += row;
+        edges += v < vertex_count ? degrees[v] : 0;
+    }
+    shards[count].first_vertex = vertex_count;
+    shards[count].edge_count   = 0;
+
+    size_t offset = align_up(sizeof(struct sharded_header) + (count + 1) * sizeof(struct shard_extent));
+    for (size_t s = 0; s <= count; s++) {
+        shards[s].offset = offset;
+        if (s < count) {
+            offset += align_up(shard_size(shards, s));
+        }
+    }
+    *shard_count = count;
+    return shards;
+}
+
+// Opens an unlinked scratch file next to path.
+//
+static int open_scratch_file(const char * path) {
+    size_t length = strlen(path) + sizeof(".XXXXXX");
+    char * name   = static_cast<char*>(malloc(length));
+    if (name == NULL) {
+        return -1;
+    }
+    snprintf(name, length, "%s.XXXXXX", path);
+    int fd = mkstemp(name);
+    if (fd >= 0) {
+        unlink(name);
+    }
+    free(name);
+    return fd;
+}
+
+// Second pass: appends every edge, as an (i, j) pair, to its shard's
+// region of the scratch file, SHARD_BUCKET_EDGES at a time.
+//
+static bool bucket_edges(const char * matrix_path, const struct shard_extent * shards,
+                         size_t shard_count, int scratch) {
+    size_t vertex_count;
+    FILE * matrix = open_matrix(matrix_path, &vertex_count);
+    uint32_t * buckets = static_cast<uint32_t*>(
+        malloc(shard_count * SHARD_BUCKET_EDGES * 2 * sizeof(uint32_t)));
+    size_t * filled    = static_cast<size_t*>(calloc(shard_count, sizeof(size_t)));
+    off_t * next_write = static_cast<off_t*>(malloc(shard_count * sizeof(off_t)));
+    bool ok = matrix != NULL && buckets != NULL && filled != NULL && next_write != NULL;
+    if (ok) {
+        off_t region = 0;
+        for (size_t s = 0; s < shard_count; s++) {
+            next_write[s] = region;
+            region       += shards[s].edge_count * 2 * sizeof(uint32_t);
+        }
+    } else if (matrix != NULL) {
+        printf("Failed to allocate shard buckets.\n");
+    }
+
+    unsigned int i, j;
+    bool failed = !ok;
+    while (!failed && read_edge(matrix, vertex_count, &i, &j, &failed)) {
+        size_t s         = shard_of(shards, shard_count, i);
+        uint32_t * pairs = buckets + s * SHARD_BUCKET_EDGES * 2;
+        pairs[2 * filled[s]]     = i;
+        pairs[2 * filled[s] + 1] = j;
+        if (++filled[s] == SHARD_BUCKET_EDGES) {
+            failed = !write_fully(scratch, pairs, SHARD_BUCKET_EDGES * 2 * sizeof(uint32_t), next_write[s]);
+            next_write[s] += SHARD_BUCKET_EDGES * 2 * sizeof(uint32_t);
+            filled[s]      = 0;
+        }
+    }
+    for (size_t s = 0; s < shard_count && !failed; s++) {
+        failed = !write_fully(scratch, buckets + s * SHARD_BUCKET_EDGES * 2,
+                              filled[s] * 2 * sizeof(uint32_t), next_write[s]);
+    }
+
+    if (matrix != NULL) fclose(matrix);
+    free(buckets);
+    free(filled);
+    free(next_write);
+    return !failed;
+}
+
+// Third pass: turns each shard's pairs into its offsets and neighbor
+// arrays, keeping the matrix order within a row, and writes it out.
+// degrees is used up as the fill position of each row.
+//
+static bool write_shards(const struct shard_extent * shards, size_t shard_count, uint32_t * degrees,
+                         int scratch, int out) {
+    size_t max_edges = 0;
+    size_t max_bytes = 0;
+    for (size_t s = 0; s < shard_count; s++) {
+        max_edges = std::max(max_edges, (size_t)shards[s].edge_count);
+        max_bytes = std::max(max_bytes, shard_size(shards, s));
+    }
+    uint32_t * pairs = static_cast<uint32_t*>(malloc(max_edges * 2 * sizeof(uint32_t) + 1));
+    uint32_t * shard = static_cast<uint32_t*>(malloc(max_bytes));
+    bool ok = pairs != NULL && shard != NULL;
+    if (!ok) {
+        printf("Failed to allocate shard buffers.\n");
+    }
+
+    off_t region = 0;
+    for (size_t s = 0; s < shard_count && ok; s++) {
+        size_t first    = shards[s].first_vertex;
+        size_t vertices = shards[s + 1].first_vertex - first;
+        size_t edges    = shards[s].edge_count;
+        ok = read_fully(scratch, pairs, edges * 2 * sizeof(uint32_t), region);
+        region += edges * 2 * sizeof(uint32_t);
+
+        uint32_t * offsets   = shard;
+        uint32_t * neighbors = shard + vertices + 1;
+        offsets[0] = 0;
+        for (size_t k = 0; k < vertices; k++) {
+            offsets[k + 1]     = offsets[k] + degrees[first + k];
+            degrees[first + k] = offsets[k];
+        }
+        for (size_t e = 0; e < edges && ok; e++) {
+            neighbors[degrees[pairs[2 * e]]++] = pairs[2 * e + 1];
+        }
+        ok = ok && write_fully(out, shard, shard_size(shards, s), shards[s].offset);
+    }
+    free(pairs);
+    free(shard);
+    return ok;
+}
+
+bool write_sharded_graph(const char * matrix_path, const char * path, size_t shard_bytes) {
+    TRACE_SPAN("write_sharded_graph");
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+
+    // First pass: the degree of every vertex, which fixes where
+    // everything goes.
+    //
+    size_t vertex_count;
+    FILE * matrix = open_matrix(matrix_path, &vertex_count);
+    if (matrix == NULL) {
+        return false;
+    }
+    uint32_t * degrees = static_cast<uint32_t*>(calloc(vertex_count, sizeof(uint32_t)));
+    if (degrees == NULL) {
+        printf("Failed to allocate degree array.\n");
+        fclose(matrix);
+        return false;
+    }
+    size_t edge_count = 0;
+    unsigned int i, j;
+    bool failed = false;
+    while (read_edge(matrix, vertex_count, &i, &j, &failed)) {
+        ++degrees[i];
+        ++edge_count;
+    }
+    fclose(matrix);
+
+    size_t shard_count = 0;
+    struct shard_extent * shards = failed ? NULL : plan_shards(degrees, vertex_count, shard_bytes, &shard_count);
+    int out     = shards == NULL ? -1 : open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int scratch = out < 0 ? -1 : open_scratch_file(path);
+    bool ok = scratch >= 0;
+    if (!ok && !failed) {
+        printf("Failed to create %s.\n", path);
+    }
+
+    struct sharded_header header;
+    memcpy(header.magic, SHARDED_GRAPH_MAGIC, sizeof(header.magic));
+    header.vertex_count = vertex_count;
+    header.edge_count   = edge_count;
+    header.shard_count  = shard_count;
+    ok = ok && bucket_edges(matrix_path, shards, shard_count, scratch) &&
+         write_shards(shards, shard_count, degrees, scratch, out) &&
+         write_fully(out, &header, sizeof(header), 0) &&
+         write_fully(out, shards, (shard_count + 1) * sizeof(struct shard_extent), sizeof(header)) &&
+         ftruncate(out, shards[shard_count].offset) == 0;
+    GRAB_CLOCK(stop)
+
+    if (ok) {
+        size_t largest = 0;
+        for (size_t s = 0; s < shard_count; s++) {
+            largest = std::max(largest, shard_size(shards, s));
+        }
+        printf("Wrote %ld vertices and %ld edges in %ld shards (largest %0.1f MiB) to %s in %0.3f s.\n",
+               vertex_count, edge_count, shard_count, (double)largest / (1024.0 * 1024.0), path,
+               (float)compute_timespec_diff(start, stop) / 1000000000.0f);
+    } else if (out >= 0) {
+        printf("Failed to write sharded graph.\n");
+        unlink(path);
+    }
+    if (scratch >= 0) close(scratch);
+    if (out >= 0) close(out);
+    free(shards);
+    free(degrees);
+    return ok;
+}
+
+bool open_sharded_graph(const char * path) {
+    struct sharded_header header;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || !read_fully(fd, &header, sizeof(header), 0) ||
+        memcmp(header.magic, SHARDED_GRAPH_MAGIC, sizeof(header.magic)) != 0 ||
+        header.shard_count == 0) {
+        printf("%s is not a sharded graph.\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    size_t table_bytes = (header.shard_count + 1) * sizeof(struct shard_extent);
+    struct shard_extent * shards = static_cast<struct shard_extent*>(malloc(table_bytes));
+    if (shards == NULL || !read_fully(fd, shards, table_bytes, sizeof(header))) {
+        printf("Failed to read the shard table of %s.\n", path);
+        free(shards);
+        close(fd);
+        return false;
+    }
+
+    sharded.fd              = fd;
+    sharded.vertex_count    = header.vertex_count;
+    sharded.edge_count      = header.edge_count;
+    sharded.shard_count     = header.shard_count;
+    sharded.shards          = shards;
+    sharded.max_shard_bytes = 0;
+    for (size_t s = 0; s < sharded.shard_count; s++) {
+        sharded.max_shard_bytes = std::max(sharded.max_shard_bytes, shard_size(shards, s));
+    }
+    return true;
+}
+
+void close_sharded_graph(void) {
+    if (sharded.fd >= 0) {
+        close(sharded.fd);
+    }
+    free(sharded.shards);
+    sharded.fd     = -1;
+    sharded.shards = NULL;
+}
+
+bool init_sharded_search(struct sharded_search * search) {
+    size_t words          = (sharded.vertex_count + 63) / 64;
+    search->visited       = static_cast<uint64_t*>(malloc(words * sizeof(uint64_t)));
+    search->frontier      = static_cast<unsigned int*>(malloc(sharded.vertex_count * sizeof(unsigned int)));
+    search->next_frontier = static_cast<unsigned int*>(malloc(sharded.vertex_count * sizeof(unsigned int)));
+    search->shard_buffer  = static_cast<uint32_t*>(malloc(sharded.max_shard_bytes));
+    search->levels        = 0;
+    search->shards_read   = 0;
+    search->bytes_read    = 0;
+    if (search->visited == NULL || search->frontier == NULL ||
+        search->next_frontier == NULL || search->shard_buffer == NULL) {
+        destroy_sharded_search(search);
+        return false;
+    }
+    return true;
+}
+
+void destroy_sharded_search(struct sharded_search * search) {
+    free(search->visited);
+    free(search->frontier);
+    free(search->next_frontier);
+    free(search->shard_buffer);
+    search->visited       = NULL;
+    search->frontier      = NULL;
+    search->next_frontier = NULL;
+    search->shard_buffer  = NULL;
+}
+
+bool sharded_breadth_first_search(struct sharded_search * search,
+                                  unsigned int i, unsigned int j,
+                                  struct search_result * result) {
+    TRACE_SPAN("sharded_bfs");
+    const struct shard_extent * shards = sharded.shards;
+    uint64_t * visited = search->visited;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    memset(visited, 0, (sharded.vertex_count + 63) / 64 * sizeof(uint64_t));
+
+    bool found_path       = false;
+    bool read_error       = false;
+    size_t node_count     = 0;
+    size_t edge_count     = 0;
+    size_t frontier_count = 0;
+    if (i < sharded.vertex_count) {
+        visited[i / 64] |= 1UL << (i % 64);
+        search->frontier[frontier_count++] = i;
+    }
+
+    while (frontier_count != 0 && !found_path && !read_error) {
+        ++search->levels;
+        unsigned int * frontier = search->frontier;
+        std::sort(frontier, frontier + frontier_count);
+
+        size_t next_count = 0;
+        size_t begin      = 0;
+        size_t s          = shard_of(shards, sharded.shard_count, frontier[0]);
+        while (begin < frontier_count && !found_path) {
+            size_t first = shards[s].first_vertex;
+            size_t end   = std::lower_bound(frontier + begin, frontier + frontier_count,
+                                            shards[s + 1].first_vertex) - frontier;
+            size_t bytes = shard_size(shards, s);
+            if (!read_fully(sharded.fd, search->shard_buffer, bytes, shards[s].offset)) {
+                printf("Failed to read shard %ld.\n", s);
+                read_error = true;
+                break;
+            }
+            ++search->shards_read;
+            search->bytes_read += bytes;
+
+            // Have the kernel read the next shard of this level while
+            // this one is searched.
+            //
+            size_t next_shard = s;
+            if (end < frontier_count) {
+                next_shard = shard_of(shards, sharded.shard_count, frontier[end]);
+                posix_fadvise(sharded.fd, shards[next_shard].offset, shard_size(shards, next_shard),
+                              POSIX_FADV_WILLNEED);
+            }
+
+            const uint32_t * offsets   = search->shard_buffer;
+            const uint32_t * neighbors = offsets + (shards[s + 1].first_vertex - first) + 1;
+            for (size_t k = begin; k < end && !found_path; k++) {
+                size_t v = frontier[k] - first;
+                ++node_count;
+                for (uint32_t e = offsets[v]; e < offsets[v + 1]; e++) {
+                    unsigned int data = neighbors[e];
+                    if (j == data) {
+                        found_path = true;
+                    }
+                    if ((visited[data / 64] & (1UL << (data % 64))) == 0) {
+                        visited[data / 64] |= 1UL << (data % 64);
+                        search->next_frontier[next_count++] = data;
+                    }
+                }
+                edge_count += offsets[v + 1] - offsets[v];
+            }
+            begin = end;
+            s     = next_shard;
+        }
+
+        search->frontier      = search->next_frontier;
+        search->next_frontier = frontier;
+        frontier_count        = next_count;
+    }
+    GRAB_CLOCK(stop)
+
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
@@ -0,0 +1,91 @@
+#ifndef SHARDED_GRAPH_H_
+#define SHARDED_GRAPH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// An on-disk copy of the adjacency for graphs that do not fit in
+// memory, searched without ever loading all of it.
+//
+// The vertices are split into shards of consecutive ids, each up to
+// about shard_bytes on disk. After a header and the shard table,
+// every shard starts on a page boundary and holds
+//
+//     uint32_t offsets[vertices + 1];
+//     uint32_t neighbors[edges];
+//
+// where the neighbors of the shard's vertex first_vertex + k are
+// neighbors[offsets[k]] up to neighbors[offsets[k + 1]], in the
+// order they appear in the matrix. Only the shard table is kept in
+// memory.
+//
+#define SHARDED_GRAPH_MAGIC "BFSSHRD1"
+
+struct shard_extent {
+    uint64_t first_vertex;
+    uint64_t offset;
+    uint64_t edge_count;
+};
+
+struct sharded_graph {
+    int fd;
+    size_t vertex_count;
+    size_t edge_count;
+    size_t shard_count;
+    // shard_count + 1 entries, the last one only marking the end of
+    // the vertices.
+    //
+    struct shard_extent * shards;
+    size_t max_shard_bytes;
+};
+
+extern struct sharded_graph sharded;
+
+// Converts the Matrix Market file at matrix_path into a sharded graph
+// at path, streaming it twice rather than loading it. Memory use is
+// one degree counter per vertex, a small edge buffer per shard and
+// a few shards' worth of buffers. Returns FALSE on a parsing, I/O or
+// allocation failure.
+//
+bool write_sharded_graph(const char * matrix_path, const char * path, size_t shard_bytes);
+
+// Returns FALSE if path is not a sharded graph or cannot be read.
+//
+bool open_sharded_graph(const char * path);
+void close_sharded_graph(void);
+
+// Per-searcher state of the sharded search: a visited bitmap and two
+// frontiers, one bit and two ids per vertex, and one shard buffer.
+//
+struct sharded_search {
+    uint64_t * visited;
+    unsigned int * frontier;
+    unsigned int * next_frontier;
+    uint32_t * shard_buffer;
+
+    // Totals over every search so far.
+    //
+    size_t levels;
+    size_t shards_read;
+    size_t bytes_read;
+};
+
+// Returns FALSE on allocation failure.
+//
+bool init_sharded_search(struct sharded_search * search);
+void destroy_sharded_search(struct sharded_search * search);
+
+// Level-synchronous BFS from i until j is reached. Each level sorts
+// its frontier, which groups it by shard, and reads every shard
+// holding part of it once, in one pread(), while the kernel is asked
+// to read ahead the next shard the level needs. Whether a path is
+// found agrees with shared_breadth_first_search(); nodes_visited
+// counts the vertices expanded, each at most once.
+//
+bool sharded_breadth_first_search(struct sharded_search * search,
+                                  unsigned int i, unsigned int j,
+                                  struct search_result * result);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "shortest_path.h"
+#include "timing.h"
+#include "trace.h"
+
+double ** edge_lengths = NULL;
+static size_t length_row_count = 0;
+
+bool allocate_edge_lengths(size_t node_count) {
+    edge_lengths = (double**)calloc(node_count, sizeof(double*));
+    if (edge_lengths == NULL) {
+        return false;
+    }
+    length_row_count = node_count;
+    return true;
+}
+
+void add_edge_length(unsigned int i, double length) {
+    // The edge is the last one in its row. Grows 16 lengths at a
+    // time, like add_edge().
+    //
+    size_t index = rows[i]->size - 1;
+    if (index % 16 == 0) {
+        double * grown = (double*)realloc(edge_lengths[i], (index + 16) * sizeof(double));
+        if (grown == NULL) {
+            printf("Failed to allocate edge lengths, exiting.\n");
+            exit(1);
+        }
+        edge_lengths[i] = grown;
+    }
+    edge_lengths[i][index] = length;
+}
+
+void free_edge_lengths(void) {
+    for (size_t v = 0; v < length_row_count; v++) {
+        free(edge_lengths[v]);
+    }
+    free(edge_lengths);
+    edge_lengths     = NULL;
+    length_row_count = 0;
+}
+
+const char * frontier_kind_name(enum frontier_kind kind) {
+    switch (kind) {
+    case FRONTIER_RADIX_HEAP:         return "radix heap";
+    case FRONTIER_BINARY_HEAP:        return "binary heap";
+    case FRONTIER_STD_PRIORITY_QUEUE: return "std::priority_queue";
+    default:                          return "unknown";
+    }
+}
+
+// The same interface as monotone_queue, so that dijkstra() runs the
+// same code over both. Pairs compare by key first.
+//
+struct std_frontier {
+    std::priority_queue<std::pair<uint64_t, unsigned int>,
+                        std::vector<std::pair<uint64_t, unsigned int> >,
+                        std::greater<std::pair<uint64_t, unsigned int> > > heap;
+
+    bool push(uint64_t key, unsigned int value) {
+        heap.push(std::make_pair(key, value));
+        return true;
+    }
+
+    bool pop(uint64_t * key, unsigned int * value) {
+        if (heap.empty()) {
+            return false;
+        }
+        *key   = heap.top().first;
+        *value = heap.top().second;
+        heap.pop();
+        return true;
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+
+    void clear() {
+        while (!heap.empty()) {
+            heap.pop();
+        }
+    }
+};
+
+bool init_shortest_path_search(struct shortest_path_search * search, enum frontier_kind kind) {
+    search->kind          = kind;
+    search->frontier      = NULL;
+    search->baseline      = NULL;
+    search->distance      = (double*)malloc(row_count * sizeof(double));
+    search->reached_epoch = (unsigned int*)calloc(row_count, sizeof(unsigned int));
+    search->settled_epoch = (unsigned int*)calloc(row_count, sizeof(unsigned int));
+    search->epoch         = 0;
+    search->max_frontier  = 0;
+    search->pushes        = 0;
+
+    bool ok = search->distance != NULL && search->reached_epoch != NULL &&
+              search->settled_epoch != NULL;
+    if (ok && kind == FRONTIER_STD_PRIORITY_QUEUE) {
+        search->baseline = new std_frontier();
+    } else if (ok) {
+        search->frontier = new monotone_queue();
+        ok = search->frontier != NULL &&
+             (kind != FRONTIER_BINARY_HEAP || search->frontier->use_binary_heap());
+    }
+    if (!ok) {
+        destroy_shortest_path_search(search);
+        return false;
+    }
+    return true;
+}
+
+void destroy_shortest_path_search(struct shortest_path_search * search) {
+    delete search->frontier;
+    delete search->baseline;
+    free(search->distance);
+    free(search->reached_epoch);
+    free(search->settled_epoch);
+    search->frontier      = NULL;
+    search->baseline      = NULL;
+    search->distance      = NULL;
+    search->reached_epoch = NULL;
+    search->settled_epoch = NULL;
+}
+
+// Non-negative doubles order the same as their bits.
+//
+static inline uint64_t distance_key(double distance) {
+    uint64_t key;
+    memcpy(&key, &distance, sizeof(key));
+    return key;
+}
+
+template <class frontier_type>
+static bool dijkstra(struct shortest_path_search * search, frontier_type * frontier,
+                     unsigned int i, unsigned int j,
+                     struct search_result * result,
+                     double * distance) {
+    unsigned int * reached_epoch = search->reached_epoch;
+    unsigned int * settled_epoch = search->settled_epoch;
+    double * distances           = search->distance;
+
+    ++search->epoch;
+    if (search->epoch == 0) {
+        memset(reached_epoch, 0, row_count * sizeof(unsigned int));
+        memset(settled_epoch, 0, row_count * sizeof(unsigned int));
+        search->epoch = 1;
+    }
+    unsigned int epoch = search->epoch;
+
+    bool found_path   = false;
+    bool push_error   = false;
+    bool pop_error    = false;
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    size_t pushes     = 1;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+
+    distances[i]     = 0.0;
+    reached_epoch[i] = epoch;
+    push_error       = !frontier->push(distance_key(0.0), i);
+    uint64_t key;
+    unsigned int vertex;
+    while (!push_error) {
+        // A pop fails on an empty frontier, or on allocation failure
+        // with elements left.
+        //
+        if (!frontier->pop(&key, &vertex)) {
+            pop_error = frontier->size() != 0;
+            break;
+        }
+        // Entries left behind by a drop in distance find their
+        // vertex settled.
+        //
+        if (settled_epoch[vertex] == epoch) continue;
+        settled_epoch[vertex] = epoch;
+        ++node_count;
+        if (vertex == j) {
+            found_path = true;
+            *distance  = distances[vertex];
+            break;
+        }
+
+        struct row * row = rows[vertex];
+        if (row == NULL) continue;
+        edge_count += row->size;
+        const double * lengths = edge_lengths[vertex];
+        double base = distances[vertex];
+        for (size_t k = 0; k < row->size; k++) {
+            unsigned int neighbor = row->adjacent_nodes[k];
+            double through        = base + lengths[k];
+            if (settled_epoch[neighbor] == epoch ||
+                (reached_epoch[neighbor] == epoch && distances[neighbor] <= through)) {
+                continue;
+            }
+            distances[neighbor]     = through;
+            reached_epoch[neighbor] = epoch;
+            if (!frontier->push(distance_key(through), neighbor)) {
+                push_error = true;
+                break;
+            }
+            ++pushes;
+        }
+        if (frontier->size() > search->max_frontier) {
+            search->max_frontier = frontier->size();
+        }
+    }
+    if (push_error) {
+        printf("Error pushing into %s.\n", frontier_kind_name(search->kind));
+    }
+    if (pop_error) {
+        printf("Error popping from %s.\n", frontier_kind_name(search->kind));
+    }
+    // Empty the frontier so that it can be reused by the next
+    // search. Popping keeps a forced binary heap one, clear() drops
+    // whatever a failed pop leaves behind.
+    //
+    while (frontier->pop(&key, &vertex)) {
+    }
+    if (frontier->size() != 0) {
+        frontier->clear();
+    }
+    GRAB_CLOCK(stop)
+
+    search->pushes       += pushes;
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
+
+bool dijkstra_search(struct shortest_path_search * search,
+                     unsigned int i, unsigned int j,
+                     struct search_result * result,
+                     double * distance) {
+    TRACE_SPAN("dijkstra");
+    if (search->kind == FRONTIER_STD_PRIORITY_QUEUE) {
+        return dijkstra(search, search->baseline, i, j, result, distance);
+    }
+    return dijkstra(search, search->frontier, i, j, result, distance);
+}
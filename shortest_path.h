@@ -0,0 +1,85 @@
+#ifndef SHORTEST_PATH_H_
+#define SHORTEST_PATH_H_
+
+#include <stddef.h>
+
+#include "graph.h"
+#include "monotone_queue.h"
+
+// Weighted shortest paths with Dijkstra's algorithm.
+//
+// The length of rows[v]->adjacent_nodes[k] is edge_lengths[v][k],
+// the value of that entry in the matrix, or 1 for every edge of a
+// pattern matrix. Lengths must be finite and non-negative. As for
+// edge_weights in zero_one_bfs.h, edge_lengths follows the rows as
+// add_edge() and place_graph() leave them, but not relabel_graph()
+// or the dynamic graph.
+//
+extern double ** edge_lengths;
+
+// Returns FALSE on allocation failure.
+//
+bool allocate_edge_lengths(size_t node_count);
+
+// Records the length of the edge the last add_edge(i, j) appended.
+// Exits on allocation failure, like add_edge().
+//
+void add_edge_length(unsigned int i, double length);
+void free_edge_lengths(void);
+
+// The priority queue a search keeps its frontier in. The first two
+// are monotone_queue, as a radix heap and forced into its binary
+// heap fallback, the last the standard library's binary heap, as a
+// baseline.
+//
+enum frontier_kind {
+    FRONTIER_RADIX_HEAP,
+    FRONTIER_BINARY_HEAP,
+    FRONTIER_STD_PRIORITY_QUEUE,
+    FRONTIER_KIND_COUNT
+};
+
+const char * frontier_kind_name(enum frontier_kind kind);
+
+// Wraps std::priority_queue, see shortest_path.cc.
+//
+struct std_frontier;
+
+// A vertex's distance is valid when its reached entry equals the
+// current epoch, and it is final when its settled entry does, as in
+// zero_one_search. Distances are keyed by their bits in the priority
+// queue, see monotone_queue.h.
+//
+struct shortest_path_search {
+    enum frontier_kind kind;
+    monotone_queue * frontier;
+    struct std_frontier * baseline;
+
+    double * distance;
+    unsigned int * reached_epoch;
+    unsigned int * settled_epoch;
+    unsigned int epoch;
+
+    // Largest frontier, and pushes, over every search so far.
+    //
+    size_t max_frontier;
+    size_t pushes;
+};
+
+// Returns FALSE on allocation failure.
+//
+bool init_shortest_path_search(struct shortest_path_search * search, enum frontier_kind kind);
+void destroy_shortest_path_search(struct shortest_path_search * search);
+
+// Settles vertices in order of distance from i until j is settled,
+// and returns TRUE with the length of the shortest path from i to j
+// in distance if there is one. A vertex is pushed again whenever its
+// distance drops, instead of decreasing its key, and nodes_visited
+// counts the vertices settled.
+//
+bool dijkstra_search(struct shortest_path_search * search,
+                     unsigned int i, unsigned int j,
+                     struct search_result * result,
+                     double * distance);
+
+#endif
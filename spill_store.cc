@@ -0,0 +1,433 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spill_store.h"
+#include "timing.h"
+
+// A block is written in the background (WRITING), then is only on
+// disk (ON_DISK) until the I/O thread reads it back into a buffer
+// (READING), ready to be popped (READY). A block that is at the front
+// when its write finishes, or that is taken before its write starts,
+// goes straight to READY and keeps its buffer.
+//
+enum block_state {
+    BLOCK_WRITING,
+    BLOCK_ON_DISK,
+    BLOCK_READING,
+    BLOCK_READY
+};
+
+struct spilled_block {
+    off_t offset;
+    size_t count;
+    int buffer;
+    enum block_state state;
+    bool in_progress;
+};
+
+struct spill_store {
+    int fd;
+    size_t block_elements;
+    size_t tail_limit;
+
+    // Between spill_store_reserve_block() and the commit.
+    //
+    int reserved_buffer;
+
+    unsigned int * buffers[SPILL_BUFFERS];
+    bool buffer_free[SPILL_BUFFERS];
+
+    // The block being popped from. Only touched by the queue.
+    //
+    int head_buffer;
+    size_t head_position;
+    size_t head_count;
+
+    // Spilled blocks in FIFO order, block s at blocks[s % capacity].
+    // The elements count is only touched by the queue, the rest is
+    // shared with the I/O thread under lock.
+    //
+    struct spilled_block * blocks;
+    size_t block_capacity;
+    size_t first_block;
+    size_t block_count;
+    size_t next_write;
+    size_t spilled_elements;
+    off_t write_offset;
+
+    bool io_failed;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+
+    struct spill_stats stats;
+};
+
+static struct spilled_block * block_at(struct spill_store * store, size_t sequence) {
+    return &store->blocks[sequence % store->block_capacity];
+}
+
+// Caller holds the lock. Returns -1 if every buffer is in use.
+//
+static int take_free_buffer(struct spill_store * store) {
+    for (int b = 0; b < SPILL_BUFFERS; b++) {
+        if (store->buffer_free[b]) {
+            store->buffer_free[b] = false;
+            return b;
+        }
+    }
+    return -1;
+}
+
+static bool write_fully(int fd, const char * data, size_t bytes, off_t offset) {
+    while (bytes != 0) {
+        ssize_t written = pwrite(fd, data, bytes, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data   += written;
+        bytes  -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool read_fully(int fd, char * data, size_t bytes, off_t offset) {
+    while (bytes != 0) {
+        ssize_t got = pread(fd, data, bytes, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data   += got;
+        bytes  -= got;
+        offset += got;
+    }
+    return true;
+}
+
+// Writes blocks in the order they were spilled, and otherwise reads
+// the front block back if it is only on disk and a buffer is free.
+//
+static void * spill_io_thread(void * argument) {
+    struct spill_store * store = static_cast<struct spill_store*>(argument);
+    pthread_mutex_lock(&store->lock);
+    while (!store->stopping) {
+        if (store->next_write < store->first_block) {
+            store->next_write = store->first_block;
+        }
+        while (store->next_write < store->first_block + store->block_count &&
+               block_at(store, store->next_write)->state != BLOCK_WRITING) {
+            ++store->next_write;
+        }
+
+        size_t sequence;
+        bool writing;
+        struct spilled_block * front = block_at(store, store->first_block);
+        if (store->next_write < store->first_block + store->block_count) {
+            sequence = store->next_write++;
+            writing  = true;
+        } else if (store->block_count != 0 && front->state == BLOCK_ON_DISK &&
+                   (front->buffer = take_free_buffer(store)) >= 0) {
+            sequence     = store->first_block;
+            writing      = false;
+            front->state = BLOCK_READING;
+        } else {
+            pthread_cond_wait(&store->work, &store->lock);
+            continue;
+        }
+
+        struct spilled_block * block = block_at(store, sequence);
+        block->in_progress = true;
+        char * data  = reinterpret_cast<char*>(store->buffers[block->buffer]);
+        size_t bytes = block->count * sizeof(unsigned int);
+        off_t offset = block->offset;
+        pthread_mutex_unlock(&store->lock);
+
+        bool ok = writing ? write_fully(store->fd, data, bytes, offset)
+                          : read_fully(store->fd, data, bytes, offset);
+
+        pthread_mutex_lock(&store->lock);
+        // The ring may have grown while unlocked.
+        //
+        block              = block_at(store, sequence);
+        block->in_progress = false;
+        if (!ok) {
+            store->io_failed = true;
+        } else if (!writing) {
+            block->state = BLOCK_READY;
+            ++store->stats.blocks_read;
+        } else {
+            ++store->stats.blocks_written;
+            store->stats.bytes_written += bytes;
+            if (sequence == store->first_block) {
+                block->state = BLOCK_READY;
+            } else {
+                store->buffer_free[block->buffer] = true;
+                block->buffer = -1;
+                block->state  = BLOCK_ON_DISK;
+            }
+        }
+        pthread_cond_broadcast(&store->done);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return NULL;
+}
+
+static int open_spill_file(const char * directory) {
+    if (directory == NULL) {
+        directory = getenv("TMPDIR");
+    }
+    if (directory == NULL || directory[0] == '\0') {
+        directory = "/tmp";
+    }
+    size_t length = strlen(directory) + sizeof("/queue-spill-XXXXXX");
+    char * path   = static_cast<char*>(malloc(length));
+    if (path == NULL) {
+        return -1;
+    }
+    snprintf(path, length, "%s/queue-spill-XXXXXX", directory);
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    free(path);
+    return fd;
+}
+
+struct spill_store * create_spill_store(size_t memory_budget, size_t element_bytes,
+                                        const char * directory) {
+    // A quarter of the budget for the buffers, in whole pages, and
+    // the rest for the tail, which has to hold at least a block.
+    //
+    size_t block_bytes = memory_budget / (4 * SPILL_BUFFERS);
+    if (block_bytes > SPILL_BLOCK_BYTES) {
+        block_bytes = SPILL_BLOCK_BYTES;
+    }
+    block_bytes -= block_bytes % 4096;
+    if (block_bytes == 0) {
+        return NULL;
+    }
+    size_t block_elements = block_bytes / sizeof(unsigned int);
+    size_t tail_limit     = (memory_budget - SPILL_BUFFERS * block_bytes) / element_bytes;
+    if (tail_limit < block_elements) {
+        return NULL;
+    }
+
+    struct spill_store * store = static_cast<struct spill_store*>(calloc(1, sizeof(struct spill_store)));
+    if (store == NULL) {
+        return NULL;
+    }
+    store->fd             = -1;
+    store->block_elements = block_elements;
+    store->tail_limit     = tail_limit;
+    store->head_buffer    = -1;
+    store->reserved_buffer = -1;
+    store->block_capacity = 16;
+    store->blocks         = static_cast<struct spilled_block*>(
+        malloc(store->block_capacity * sizeof(struct spilled_block)));
+    bool ok = store->blocks != NULL;
+    for (int b = 0; b < SPILL_BUFFERS; b++) {
+        store->buffers[b]     = static_cast<unsigned int*>(malloc(block_bytes));
+        store->buffer_free[b] = true;
+        ok = ok && store->buffers[b] != NULL;
+    }
+    if (ok) {
+        store->fd = open_spill_file(directory);
+    }
+    if (!ok || store->fd < 0) {
+        for (int b = 0; b < SPILL_BUFFERS; b++) free(store->buffers[b]);
+        free(store->blocks);
+        if (store->fd >= 0) close(store->fd);
+        free(store);
+        return NULL;
+    }
+
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->work, NULL);
+    pthread_cond_init(&store->done, NULL);
+    if (pthread_create(&store->thread, NULL, spill_io_thread, store) != 0) {
+        pthread_mutex_destroy(&store->lock);
+        pthread_cond_destroy(&store->work);
+        pthread_cond_destroy(&store->done);
+        for (int b = 0; b < SPILL_BUFFERS; b++) free(store->buffers[b]);
+        free(store->blocks);
+        close(store->fd);
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+void destroy_spill_store(struct spill_store * store) {
+    if (store == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&store->lock);
+    store->stopping = true;
+    pthread_cond_signal(&store->work);
+    pthread_mutex_unlock(&store->lock);
+    pthread_join(store->thread, NULL);
+
+    pthread_mutex_destroy(&store->lock);
+    pthread_cond_destroy(&store->work);
+    pthread_cond_destroy(&store->done);
+    for (int b = 0; b < SPILL_BUFFERS; b++) free(store->buffers[b]);
+    free(store->blocks);
+    close(store->fd);
+    free(store);
+}
+
+size_t spill_store_tail_limit(const struct spill_store * store) {
+    return store->tail_limit;
+}
+
+size_t spill_store_size(const struct spill_store * store) {
+    return store->head_count - store->head_position + store->spilled_elements;
+}
+
+// Caller holds the lock. Waits on done, counting the time spent.
+//
+static void wait_for_io(struct spill_store * store) {
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    pthread_cond_wait(&store->done, &store->lock);
+    GRAB_CLOCK(stop)
+    store->stats.wait_nanoseconds += compute_timespec_diff(start, stop);
+}
+
+// Caller holds the lock. Doubles the ring, keeping every block at
+// its sequence number modulo the new capacity.
+//
+static bool grow_blocks(struct spill_store * store) {
+    size_t capacity = store->block_capacity * 2;
+    struct spilled_block * blocks = static_cast<struct spilled_block*>(
+        malloc(capacity * sizeof(struct spilled_block)));
+    if (blocks == NULL) {
+        return false;
+    }
+    for (size_t s = store->first_block; s < store->first_block + store->block_count; s++) {
+        blocks[s % capacity] = *block_at(store, s);
+    }
+    free(store->blocks);
+    store->blocks         = blocks;
+    store->block_capacity = capacity;
+    return true;
+}
+
+unsigned int * spill_store_reserve_block(struct spill_store * store, size_t * capacity) {
+    pthread_mutex_lock(&store->lock);
+    int buffer;
+    while ((buffer = take_free_buffer(store)) < 0 && !store->io_failed) {
+        wait_for_io(store);
+    }
+    bool ok = !store->io_failed &&
+              (store->block_count < store->block_capacity || grow_blocks(store));
+    if (!ok && buffer >= 0) {
+        store->buffer_free[buffer] = true;
+    }
+    pthread_mutex_unlock(&store->lock);
+    if (!ok) {
+        return NULL;
+    }
+
+    // Filling the buffer needs no lock, it is not in the ring yet.
+    //
+    store->reserved_buffer = buffer;
+    *capacity = store->block_elements;
+    return store->buffers[buffer];
+}
+
+void spill_store_commit_block(struct spill_store * store, size_t count) {
+    pthread_mutex_lock(&store->lock);
+    int buffer             = store->reserved_buffer;
+    store->reserved_buffer = -1;
+    if (count == 0) {
+        store->buffer_free[buffer] = true;
+        pthread_mutex_unlock(&store->lock);
+        return;
+    }
+    struct spilled_block * block = block_at(store, store->first_block + store->block_count);
+    block->offset      = store->write_offset;
+    block->count       = count;
+    block->buffer      = buffer;
+    block->state       = BLOCK_WRITING;
+    block->in_progress = false;
+    ++store->block_count;
+    store->write_offset     += count * sizeof(unsigned int);
+    store->spilled_elements += count;
+    pthread_cond_signal(&store->work);
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Makes the front block the head once the last one is used up.
+// Returns FALSE if there is none, or it could not be read.
+//
+static bool advance_head(struct spill_store * store) {
+    pthread_mutex_lock(&store->lock);
+    if (store->head_buffer >= 0) {
+        store->buffer_free[store->head_buffer] = true;
+        store->head_buffer = -1;
+        pthread_cond_signal(&store->work);
+    }
+    while (store->block_count != 0 && !store->io_failed) {
+        struct spilled_block * front = block_at(store, store->first_block);
+        if (front->state == BLOCK_WRITING && !front->in_progress) {
+            front->state = BLOCK_READY;
+            ++store->stats.blocks_short_circuited;
+        }
+        if (front->state == BLOCK_READY) {
+            store->head_buffer   = front->buffer;
+            store->head_position = 0;
+            store->head_count    = front->count;
+            store->spilled_elements -= front->count;
+            ++store->first_block;
+            --store->block_count;
+            if (store->block_count == 0) {
+                // Nothing left on disk, start the file over.
+                //
+                store->write_offset = 0;
+                if (ftruncate(store->fd, 0) != 0) {
+                    store->io_failed = true;
+                }
+            }
+            // The new front may be read ahead now.
+            //
+            pthread_cond_signal(&store->work);
+            pthread_mutex_unlock(&store->lock);
+            return true;
+        }
+        pthread_cond_signal(&store->work);
+        wait_for_io(store);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return false;
+}
+
+bool spill_store_pop(struct spill_store * store, unsigned int * data) {
+    if (store->head_position == store->head_count && !advance_head(store)) {
+        return false;
+    }
+    *data = store->buffers[store->head_buffer][store->head_position++];
+    return true;
+}
+
+bool spill_store_next(struct spill_store * store, unsigned int * data) {
+    if (store->head_position == store->head_count && !advance_head(store)) {
+        return false;
+    }
+    *data = store->buffers[store->head_buffer][store->head_position];
+    return true;
+}
+
+void spill_store_stats(const struct spill_store * store, struct spill_stats * stats) {
+    struct spill_store * shared = const_cast<struct spill_store*>(store);
+    pthread_mutex_lock(&shared->lock);
+    *stats = store->stats;
+    pthread_mutex_unlock(&shared->lock);
+}
@@ -0,0 +1,84 @@
+#ifndef SPILL_STORE_H_
+#define SPILL_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The on-disk middle of a queue with a memory budget, see
+// queue::set_memory_budget().
+//
+// The queue keeps its youngest elements, the tail, in its list as
+// usual. When a push finds spill_store_tail_limit() elements in the
+// list, it first moves the oldest block of them into a buffer from
+// spill_store_reserve_block() and hands it to the store with
+// spill_store_commit_block(), which appends it to an unlinked
+// temporary file. Pops
+// take from the store for as long as it holds anything, as all of
+// it is older than the list.
+//
+// Blocks are large and the file is only ever appended to and read
+// front to back. A background I/O thread per store writes blocks
+// behind the pushes and reads the next block to be popped ahead of
+// the pops, so the queue rarely waits on the disk. A block still
+// waiting to be written when it comes up for popping is taken as it
+// is, never touching the disk.
+//
+// The store's memory is its block buffers, SPILL_BUFFERS blocks of
+// up to SPILL_BLOCK_BYTES, taken from malloc() rather than the
+// queue's allocator as they are shared with the I/O thread. Once the
+// store runs empty the file is truncated.
+//
+#define SPILL_BUFFERS     4
+#define SPILL_BLOCK_BYTES (4UL << 20)
+
+struct spill_store;
+
+struct spill_stats {
+    size_t blocks_written;
+    size_t blocks_read;
+    // Blocks popped straight from memory before being written.
+    //
+    size_t blocks_short_circuited;
+    size_t bytes_written;
+    // Time the queue spent waiting for a buffer to spill into or for
+    // a block to be read.
+    //
+    long wait_nanoseconds;
+};
+
+// element_bytes is what one element of the queue's list costs in
+// memory. Returns NULL if memory_budget is too small to hold the
+// buffers and a tail of at least a block, or the temporary file or
+// I/O thread cannot be created. directory NULL means $TMPDIR, or
+// /tmp.
+//
+struct spill_store * create_spill_store(size_t memory_budget, size_t element_bytes,
+                                        const char * directory);
+void destroy_spill_store(struct spill_store * store);
+
+// The most elements the queue's list may hold before it spills.
+//
+size_t spill_store_tail_limit(const struct spill_store * store);
+
+// Returns a buffer for the next block, holding up to *capacity
+// elements, waiting for one to be written out if need be. Returns
+// NULL if the store ran out of memory or the disk failed. Every
+// reserved block must be committed, with the number of elements put
+// in it, before the next is reserved.
+//
+unsigned int * spill_store_reserve_block(struct spill_store * store, size_t * capacity);
+void spill_store_commit_block(struct spill_store * store, size_t count);
+
+// Elements held by the store, on disk or in its buffers.
+//
+size_t spill_store_size(const struct spill_store * store);
+
+// Pop and peek the store's oldest element. Return FALSE if the store
+// is empty or a read failed.
+//
+bool spill_store_pop(struct spill_store * store, unsigned int * data);
+bool spill_store_next(struct spill_store * store, unsigned int * data);
+
+void spill_store_stats(const struct spill_store * store, struct spill_stats * stats);
+
+#endif
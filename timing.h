@@ -0,0 +1,19 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <time.h>
+
+// Wall clock helpers shared by the performance programs.
+//
+#define GRAB_CLOCK(x) clock_gettime(CLOCK_MONOTONIC, &x);
+
+static inline long compute_timespec_diff(struct timespec start,
+                                         struct timespec stop) {
+    // tv_nsec may be smaller in stop than in start, the difference
+    // is then negative and borrows from the seconds.
+    //
+    return (stop.tv_sec - start.tv_sec) * 1000000000L +
+           (stop.tv_nsec - start.tv_nsec);
+}
+
+#endif
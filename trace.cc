@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACING
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <mutex>
+
+// One ring per thread. Rings are never freed, so spans of threads
+// that have already exited still make it into the trace.
+//
+struct trace_ring {
+    struct trace_event events[TRACE_RING_CAPACITY];
+    size_t recorded;
+    unsigned int thread_id;
+    char thread_name[48];
+    struct trace_ring * next;
+};
+
+static std::mutex rings_lock;
+static struct trace_ring * rings = NULL;
+static std::atomic<unsigned int> next_thread_id(1);
+static thread_local struct trace_ring * local_ring = NULL;
+static const char * exit_trace_path = NULL;
+
+static struct trace_ring * get_local_ring(void) {
+    if (local_ring != NULL) {
+        return local_ring;
+    }
+
+    struct trace_ring * ring = (struct trace_ring*)malloc(sizeof(struct trace_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->recorded  = 0;
+    ring->thread_id = next_thread_id.fetch_add(1);
+    snprintf(ring->thread_name, sizeof(ring->thread_name),
+             ring->thread_id == 1 ? "main" : "thread %u", ring->thread_id);
+
+    std::lock_guard<std::mutex> guard(rings_lock);
+    ring->next = rings;
+    rings      = ring;
+    local_ring = ring;
+    return ring;
+}
+
+uint64_t trace_clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void trace_record(const char * name, uint64_t start_ns, uint64_t end_ns, uint64_t arg) {
+    struct trace_ring * ring = get_local_ring();
+    if (ring == NULL) return;
+
+    struct trace_event * event = &ring->events[ring->recorded % TRACE_RING_CAPACITY];
+    event->name     = name;
+    event->start_ns = start_ns;
+    event->end_ns   = end_ns;
+    event->arg      = arg;
+    ++ring->recorded;
+}
+
+void trace_set_thread_name(const char * name) {
+    struct trace_ring * ring = get_local_ring();
+    if (ring == NULL) return;
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name);
+}
+
+// Span names are literals from this program, but keep the JSON
+// valid whatever they contain.
+//
+static void write_json_string(FILE * file, const char * text) {
+    fputc('"', file);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', file);
+        }
+        fputc((unsigned char)*text < 0x20 ? ' ' : *text, file);
+    }
+    fputc('"', file);
+}
+
+bool write_chrome_trace(const char * path) {
+    FILE * file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Unable to open trace file %s.\n", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(rings_lock);
+
+    // Timestamps are printed relative to the earliest span so that
+    // they stay small.
+    //
+    uint64_t origin = UINT64_MAX;
+    for (struct trace_ring * ring = rings; ring != NULL; ring = ring->next) {
+        size_t kept = ring->recorded < TRACE_RING_CAPACITY ? ring->recorded : TRACE_RING_CAPACITY;
+        for (size_t k = 0; k < kept; k++) {
+            if (ring->events[k].start_ns < origin) origin = ring->events[k].start_ns;
+        }
+    }
+
+    size_t written = 0;
+    size_t dropped = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (struct trace_ring * ring = rings; ring != NULL; ring = ring->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+                first ? "" : ",\n", ring->thread_id);
+        write_json_string(file, ring->thread_name);
+        fprintf(file, "}}");
+        first = false;
+
+        size_t kept = ring->recorded < TRACE_RING_CAPACITY ? ring->recorded : TRACE_RING_CAPACITY;
+        size_t begin = ring->recorded - kept;
+        dropped += begin;
+        for (size_t k = begin; k < ring->recorded; k++) {
+            const struct trace_event * event = &ring->events[k % TRACE_RING_CAPACITY];
+            fprintf(file, ",\n{\"name\": ");
+            write_json_string(file, event->name);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %0.3f, \"dur\": %0.3f",
+                    ring->thread_id, (double)(event->start_ns - origin) / 1000.0,
+                    (double)(event->end_ns - event->start_ns) / 1000.0);
+            if (event->arg != TRACE_NO_ARG) {
+                fprintf(file, ", \"args\": {\"value\": %lu}", event->arg);
+            }
+            fprintf(file, "}");
+            ++written;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %ld trace spans to %s", written, path);
+    if (dropped > 0) {
+        printf(" (%ld older spans overwritten)", dropped);
+    }
+    printf(".\n");
+    return true;
+}
+
+static void write_trace_at_exit(void) {
+    fflush(stdout);
+    write_chrome_trace(exit_trace_path);
+    fflush(stdout);
+}
+
+void write_chrome_trace_at_exit(const char * path) {
+    if (exit_trace_path == NULL) {
+        atexit(write_trace_at_exit);
+    }
+    exit_trace_path = path;
+}
+#endif
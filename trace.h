@@ -0,0 +1,98 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scoped-span tracing of the performance program's phases.
+//
+// Built only with ENABLE_TRACING defined ('make TRACING=1', after a
+// 'make clean'). Otherwise every macro below expands to nothing and
+// no tracing code is compiled in at all.
+//
+//   TRACE_SPAN("parse banner");
+//
+// records the time from that line to the end of the enclosing scope.
+// TRACE_SPAN_ARG() does the same and attaches a number, for example
+// a query index. Phases that do not line up with a scope are marked
+//
+//   TRACE_BEGIN(parse_edges);
+//   ...
+//   TRACE_END(parse_edges);
+//
+// which records a span named "parse_edges" if TRACE_END is reached.
+//
+// A span costs two clock_gettime() calls (vDSO, no system call) and
+// a 32 byte store into a ring buffer owned by the calling thread, so
+// there is no locking on the recording path.
+// When a ring fills up the oldest spans are overwritten and counted
+// as dropped.
+//
+// write_chrome_trace() dumps every thread's ring as a Chrome trace
+// event file, which chrome://tracing and ui.perfetto.dev open
+// directly, with one track per thread.
+//
+#ifdef ENABLE_TRACING
+
+#define TRACE_RING_CAPACITY (1 << 16)
+#define TRACE_NO_ARG UINT64_MAX
+
+struct trace_event {
+    const char * name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t arg;
+};
+
+uint64_t trace_clock_ns(void);
+void trace_record(const char * name, uint64_t start_ns, uint64_t end_ns, uint64_t arg);
+
+// Names the calling thread's track. name is copied.
+//
+void trace_set_thread_name(const char * name);
+
+// Writes every span recorded so far to path. Returns FALSE if the
+// file cannot be written.
+//
+bool write_chrome_trace(const char * path);
+
+// Writes the trace to path when the program exits, after every
+// other scope in main() has closed.
+//
+void write_chrome_trace_at_exit(const char * path);
+
+// name must be a string literal, or otherwise outlive the trace.
+//
+class trace_span {
+public:
+    trace_span(const char * name, uint64_t arg = TRACE_NO_ARG)
+        : name(name), arg(arg), start_ns(trace_clock_ns()) {}
+    ~trace_span() { trace_record(name, start_ns, trace_clock_ns(), arg); }
+
+private:
+    const char * name;
+    uint64_t arg;
+    uint64_t start_ns;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) trace_span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_SPAN_ARG(name, arg) trace_span TRACE_CONCAT(trace_span_, __LINE__)(name, (uint64_t)(arg))
+#define TRACE_BEGIN(phase) uint64_t trace_##phase##_start = trace_clock_ns()
+#define TRACE_END(phase) trace_record(#phase, trace_##phase##_start, trace_clock_ns(), TRACE_NO_ARG)
+#define TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+#define TRACING_ENABLED 1
+
+#else
+
+#define TRACE_SPAN(name)
+#define TRACE_SPAN_ARG(name, arg)
+#define TRACE_BEGIN(phase)
+#define TRACE_END(phase)
+#define TRACE_THREAD_NAME(name)
+#define TRACING_ENABLED 0
+
+#endif
+
+#endif
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency_histogram.h"
+#include "timing.h"
+#include "trace.h"
+#include "workload.h"
+
+// splitmix64, enough for picking vertices.
+//
+static inline uint64_t next_random(uint64_t * state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline size_t random_below(uint64_t * state, size_t bound) {
+    return (size_t)(((unsigned __int128)next_random(state) * bound) >> 64);
+}
+
+// Level-synchronous BFS used only to label queries with their
+// distance, never timed. order holds the vertices in the order they
+// were reached, so vertices at the same level are contiguous.
+//
+struct distance_search {
+    unsigned int * level;
+    unsigned int * order;
+    size_t reached;
+};
+
+static bool init_distance_search(struct distance_search * search) {
+    search->level   = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    search->order   = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    search->reached = 0;
+    if (search->level == NULL || search->order == NULL) {
+        free(search->level);
+        free(search->order);
+        return false;
+    }
+    for (size_t v = 0; v < row_count; v++) {
+        search->level[v] = WORKLOAD_UNREACHABLE;
+    }
+    return true;
+}
+
+static void destroy_distance_search(struct distance_search * search) {
+    free(search->level);
+    free(search->order);
+}
+
+// Searches from source until target is seen in an adjacency list,
+// or, for target == WORKLOAD_UNREACHABLE, until every vertex within
+// max_level hops is reached. Returns the distance to target, which
+// like the timed searches counts only paths of at least one edge.
+//
+static unsigned int search_levels(struct distance_search * search,
+                                  unsigned int source, unsigned int target,
+                                  unsigned int max_level) {
+    for (size_t k = 0; k < search->reached; k++) {
+        search->level[search->order[k]] = WORKLOAD_UNREACHABLE;
+    }
+    search->order[0]      = source;
+    search->level[source] = 0;
+    search->reached       = 1;
+
+    for (size_t head = 0; head < search->reached; head++) {
+        unsigned int vertex = search->order[head];
+        unsigned int level  = search->level[vertex];
+        struct row * row    = rows[vertex];
+        if (row == NULL || level >= max_level) continue;
+
+        for (size_t e = 0; e < row->size; e++) {
+            unsigned int next = row->adjacent_nodes[e];
+            if (next == target) {
+                return level + 1;
+            }
+            if (search->level[next] == WORKLOAD_UNREACHABLE) {
+                search->level[next]               = level + 1;
+                search->order[search->reached++] = next;
+            }
+        }
+    }
+    return WORKLOAD_UNREACHABLE;
+}
+
+static unsigned int random_source(uint64_t * state) {
+    while (true) {
+        unsigned int vertex = random_below(state, row_count);
+        if (rows[vertex] != NULL && rows[vertex]->size > 0) {
+            return vertex;
+        }
+    }
+}
+
+struct workload_query * generate_workload(size_t * count, uint64_t seed,
+                                          unsigned int max_distance) {
+    TRACE_SPAN("generate_workload");
+    bool has_edges = false;
+    for (size_t v = 0; v < row_count && !has_edges; v++) {
+        has_edges = rows[v] != NULL && rows[v]->size > 0;
+    }
+    if (!has_edges) {
+        printf("Graph has no edges to draw queries from.\n");
+        return NULL;
+    }
+
+    struct workload_query * queries = (struct workload_query*)malloc(*count * sizeof(struct workload_query));
+    size_t * per_distance           = (size_t*)calloc(max_distance + 1, sizeof(size_t));
+    struct distance_search search;
+    if (queries == NULL || per_distance == NULL || !init_distance_search(&search)) {
+        printf("Failed to allocate workload.\n");
+        free(queries);
+        free(per_distance);
+        return NULL;
+    }
+
+    uint64_t state   = seed;
+    size_t generated = 0;
+    if (max_distance == 0) {
+        // Id 0 is never used by Matrix Market files.
+        //
+        size_t first_id = row_count > 1 ? 1 : 0;
+        for (; generated < *count; generated++) {
+            unsigned int from = random_source(&state);
+            unsigned int to   = first_id + random_below(&state, row_count - first_id);
+            queries[generated].from     = from;
+            queries[generated].to       = to;
+            queries[generated].distance = search_levels(&search, from, to, WORKLOAD_UNREACHABLE);
+        }
+    } else {
+        // Every distance gets an equal share. Give up on the ones
+        // still short once many sources in a row added nothing.
+        //
+        size_t quota      = (*count + max_distance - 1) / max_distance;
+        size_t idle       = 0;
+        size_t idle_limit = 1000 + 16 * max_distance;
+        while (generated < *count && idle < idle_limit) {
+            unsigned int from = random_source(&state);
+            search_levels(&search, from, WORKLOAD_UNREACHABLE, max_distance);
+
+            bool added   = false;
+            size_t start = 1;
+            for (unsigned int d = 1; d <= max_distance && generated < *count; d++) {
+                size_t end = start;
+                while (end < search.reached && search.level[search.order[end]] == d) {
+                    ++end;
+                }
+                if (end > start && per_distance[d] < quota) {
+                    queries[generated].from     = from;
+                    queries[generated].to       = search.order[start + random_below(&state, end - start)];
+                    queries[generated].distance = d;
+                    ++generated;
+                    ++per_distance[d];
+                    added = true;
+                }
+                start = end;
+            }
+            idle = added ? 0 : idle + 1;
+        }
+
+        if (generated < *count) {
+            printf("Only %ld of %ld pairs found within distance %u.\n",
+                   generated, *count, max_distance);
+        }
+    }
+
+    *count = generated;
+    free(per_distance);
+    destroy_distance_search(&search);
+    return queries;
+}
+
+bool measure_workload_distances(struct workload_query * queries, size_t count) {
+    struct distance_search search;
+    if (!init_distance_search(&search)) {
+        printf("Failed to allocate distance search.\n");
+        return false;
+    }
+    for (size_t k = 0; k < count; k++) {
+        queries[k].distance = search_levels(&search, queries[k].from, queries[k].to,
+                                            WORKLOAD_UNREACHABLE);
+    }
+    destroy_distance_search(&search);
+    return true;
+}
+
+static void print_latency_row(const char * label, const struct latency_histogram * histogram) {
+    printf("%-12s %9lu %10.1f %10.1f %10.1f %10.1f %10.1f\n", label, histogram->total,
+           (double)latency_at_percentile(histogram, 50.0) / 1000.0,
+           (double)latency_at_percentile(histogram, 90.0) / 1000.0,
+           (double)latency_at_percentile(histogram, 99.0) / 1000.0,
+           (double)histogram->max / 1000.0,
+           mean_latency(histogram) / 1000.0);
+}
+
+bool run_workload(const struct workload_query * queries, size_t count,
+                  uint64_t seed, const char * json_path) {
+    // One histogram per distance seen, plus the last one for
+    // unreachable targets.
+    //
+    unsigned int max_distance = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (queries[k].distance != WORKLOAD_UNREACHABLE && queries[k].distance > max_distance) {
+            max_distance = queries[k].distance;
+        }
+    }
+    size_t bucket_count = max_distance + 2;
+    size_t unreachable  = bucket_count - 1;
+
+    struct latency_histogram * overall    = (struct latency_histogram*)malloc(sizeof(struct latency_histogram));
+    struct latency_histogram * by_distance = (struct latency_histogram*)malloc(bucket_count * sizeof(struct latency_histogram));
+    struct search_state state;
+    if (overall == NULL || by_distance == NULL || !init_search_state(&state)) {
+        printf("Failed to allocate workload state.\n");
+        free(overall);
+        free(by_distance);
+        return false;
+    }
+    init_latency_histogram(overall);
+    for (size_t b = 0; b < bucket_count; b++) {
+        init_latency_histogram(&by_distance[b]);
+    }
+
+    size_t paths_found   = 0;
+    size_t edges_scanned = 0;
+    size_t mismatches    = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+    for (size_t k = 0; k < count; k++) {
+        struct search_result result;
+        search_fptr(&state, queries[k].from, queries[k].to, &result);
+
+        size_t bucket = queries[k].distance == WORKLOAD_UNREACHABLE ? unreachable : queries[k].distance;
+        record_latency(overall, result.nanoseconds);
+        record_latency(&by_distance[bucket], result.nanoseconds);
+        paths_found   += result.found_path ? 1 : 0;
+        edges_scanned += result.edges_scanned;
+
+        // The search has to agree with the distance labels.
+        //
+        if (result.found_path != (queries[k].distance != WORKLOAD_UNREACHABLE)) {
+            ++mismatches;
+        }
+    }
+    GRAB_CLOCK(stop)
+    long wall = compute_timespec_diff(start, stop);
+    double seconds = (double)wall / 1000000000.0;
+    destroy_search_state(&state);
+
+    printf("Workload: %ld queries, seed %lu, %ld paths found\n", count, seed, paths_found);
+    printf("Wall time [s]: %0.3f Queries per second: %0.2f Edges per second: %0.0f\n",
+           seconds, (double)count / seconds, (double)edges_scanned / seconds);
+    printf("%-12s %9s %10s %10s %10s %10s %10s\n", "distance", "queries",
+           "p50 [us]", "p90 [us]", "p99 [us]", "max [us]", "mean [us]");
+    print_latency_row("all", overall);
+    for (size_t b = 0; b < bucket_count; b++) {
+        if (by_distance[b].total == 0) continue;
+        char label[32];
+        if (b == unreachable) {
+            snprintf(label, sizeof(label), "unreachable");
+        } else {
+            snprintf(label, sizeof(label), "%ld", b);
+        }
+        print_latency_row(label, &by_distance[b]);
+    }
+    if (mismatches > 0) {
+        printf("Warning: %ld searches disagree with their distance label.\n", mismatches);
+    }
+
+    bool ok = true;
+    if (json_path != NULL) {
+        FILE * json = fopen(json_path, "w");
+        if (json == NULL) {
+            printf("Unable to open %s for writing.\n", json_path);
+            ok = false;
+        } else {
+            fprintf(json, "{\n  \"queries\": %ld,\n  \"seed\": %lu,\n", count, seed);
+            fprintf(json, "  \"wall_ns\": %ld,\n  \"queries_per_second\": %0.2f,\n", wall, (double)count / seconds);
+            fprintf(json, "  \"edges_scanned\": %ld,\n  \"paths_found\": %ld,\n", edges_scanned, paths_found);
+            fprintf(json, "  \"latency\": {");
+            write_latency_json(json, overall);
+            fprintf(json, "},\n  \"by_distance\": [");
+            bool first = true;
+            for (size_t b = 0; b < bucket_count; b++) {
+                if (by_distance[b].total == 0) continue;
+                fprintf(json, "%s\n    {\"distance\": ", first ? "" : ",");
+                if (b == unreachable) {
+                    fprintf(json, "\"unreachable\", ");
+                } else {
+                    fprintf(json, "%ld, ", b);
+                }
+                write_latency_json(json, &by_distance[b]);
+                fprintf(json, "}");
+                first = false;
+            }
+            fprintf(json, "\n  ]\n}\n");
+            fclose(json);
+        }
+    }
+
+    free(overall);
+    free(by_distance);
+    return ok && mismatches == 0;
+}
@@ -0,0 +1,49 @@
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// A query of the workload driver, in row ids, with the BFS distance
+// (hop count) from 'from' to 'to' worked out when it was generated.
+//
+#define WORKLOAD_UNREACHABLE UINT32_MAX
+
+struct workload_query {
+    unsigned int from;
+    unsigned int to;
+    unsigned int distance;
+};
+
+// Draws *count seeded random query pairs over the loaded graph into
+// a malloc()ed array. Sources are vertices with at least one edge.
+//
+// With max_distance == 0 targets are uniform over all vertices, so
+// the mix of distances, and of unreachable targets, is the graph's
+// own. Otherwise the pairs are spread evenly over the distances 1
+// through max_distance, for each source picking a random vertex at
+// each of those distances. If the graph has too few pairs at some
+// distance, *count is lowered to the number of pairs generated.
+//
+// The same seed and graph always give the same pairs. Returns NULL
+// on allocation failure or if the graph has no edges.
+//
+struct workload_query * generate_workload(size_t * count, uint64_t seed,
+                                          unsigned int max_distance);
+
+// Computes the distance of pairs given by the 'nodes' file, ids
+// already translated into rows.
+//
+bool measure_workload_distances(struct workload_query * queries, size_t count);
+
+// Runs every query once through search_fptr, recording its latency
+// in one histogram for the whole run and one per distance. Prints
+// p50/p90/p99/max, throughput and the per-distance breakdown, and
+// writes the same as JSON to json_path unless it is NULL.
+//
+bool run_workload(const struct workload_query * queries, size_t count,
+                  uint64_t seed, const char * json_path);
+
+#endif
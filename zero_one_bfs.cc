@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "trace.h"
+#include "zero_one_bfs.h"
+
+unsigned char ** edge_weights = NULL;
+static size_t weight_row_count = 0;
+
+bool allocate_edge_weights(size_t node_count) {
+    edge_weights = (unsigned char**)calloc(node_count, sizeof(unsigned char*));
+    if (edge_weights == NULL) {
+        return false;
+    }
+    weight_row_count = node_count;
+    return true;
+}
+
+void add_edge_weight(unsigned int i, unsigned int weight) {
+    // The edge is the last one in its row. Grows 16 weights at a
+    // time, like add_edge().
+    //
+    size_t index = rows[i]->size - 1;
+    if (index % 16 == 0) {
+        unsigned char * grown = (unsigned char*)realloc(edge_weights[i], index + 16);
+        if (grown == NULL) {
+            printf("Failed to allocate edge weights, exiting.\n");
+            exit(1);
+        }
+        edge_weights[i] = grown;
+    }
+    edge_weights[i][index] = weight == 0 ? 0 : 1;
+}
+
+void free_edge_weights(void) {
+    for (size_t v = 0; v < weight_row_count; v++) {
+        free(edge_weights[v]);
+    }
+    free(edge_weights);
+    edge_weights     = NULL;
+    weight_row_count = 0;
+}
+
+bool init_zero_one_search(struct zero_one_search * search) {
+    search->frontier      = new deque();
+    search->distance      = (unsigned int*)malloc(row_count * sizeof(unsigned int));
+    search->reached_epoch = (unsigned int*)calloc(row_count, sizeof(unsigned int));
+    search->settled_epoch = (unsigned int*)calloc(row_count, sizeof(unsigned int));
+    search->epoch         = 0;
+    search->max_frontier  = 0;
+    if (search->frontier == NULL || search->distance == NULL ||
+        search->reached_epoch == NULL || search->settled_epoch == NULL) {
+        destroy_zero_one_search(search);
+        return false;
+    }
+    return true;
+}
+
+void destroy_zero_one_search(struct zero_one_search * search) {
+    delete search->frontier;
+    free(search->distance);
+    free(search->reached_epoch);
+    free(search->settled_epoch);
+    search->frontier      = NULL;
+    search->distance      = NULL;
+    search->reached_epoch = NULL;
+    search->settled_epoch = NULL;
+}
+
+bool zero_one_breadth_first_search(struct zero_one_search * search,
+                                   unsigned int i, unsigned int j,
+                                   struct search_result * result,
+                                   unsigned int * distance) {
+    TRACE_SPAN("zero_one_bfs");
+    deque * frontier = search->frontier;
+    unsigned int * reached_epoch = search->reached_epoch;
+    unsigned int * settled_epoch = search->settled_epoch;
+    unsigned int * distances     = search->distance;
+
+    ++search->epoch;
+    if (search->epoch == 0) {
+        memset(reached_epoch, 0, row_count * sizeof(unsigned int));
+        memset(settled_epoch, 0, row_count * sizeof(unsigned int));
+        search->epoch = 1;
+    }
+    unsigned int epoch = search->epoch;
+
+    bool found_path   = false;
+    bool push_error   = false;
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    struct timespec start, stop;
+    GRAB_CLOCK(start)
+
+    distances[i]     = 0;
+    reached_epoch[i] = epoch;
+    frontier->push_back(i);
+    unsigned int vertex;
+    while (frontier->pop_front(&vertex)) {
+        // A vertex is pushed again whenever its distance drops, the
+        // older entries find it settled.
+        //
+        if (settled_epoch[vertex] == epoch) continue;
+        settled_epoch[vertex] = epoch;
+        ++node_count;
+        if (vertex == j) {
+            found_path = true;
+            *distance  = distances[vertex];
+            break;
+        }
+
+        struct row * row = rows[vertex];
+        if (row == NULL) continue;
+        edge_count += row->size;
+        const unsigned char * weights = edge_weights[vertex];
+        unsigned int base = distances[vertex];
+        for (size_t k = 0; k < row->size; k++) {
+            unsigned int neighbor = row->adjacent_nodes[k];
+            unsigned int through  = base + weights[k];
+            if (settled_epoch[neighbor] == epoch ||
+                (reached_epoch[neighbor] == epoch && distances[neighbor] <= through)) {
+                continue;
+            }
+            distances[neighbor]     = through;
+            reached_epoch[neighbor] = epoch;
+            if (!(weights[k] == 0 ? frontier->push_front(neighbor) : frontier->push_back(neighbor))) {
+                push_error = true;
+                break;
+            }
+        }
+        if (push_error) {
+            printf("Error pushing into deque.\n");
+            break;
+        }
+        if (frontier->size() > search->max_frontier) {
+            search->max_frontier = frontier->size();
+        }
+    }
+    // Empty the deque so that it can be reused by the next search,
+    // keeping its spare block.
+    //
+    unsigned int discarded;
+    while (frontier->pop_front(&discarded)) {
+    }
+    GRAB_CLOCK(stop)
+
+    result->found_path    = found_path;
+    result->nodes_visited = node_count;
+    result->edges_scanned = edge_count;
+    result->nanoseconds   = compute_timespec_diff(start, stop);
+    return found_path;
+}
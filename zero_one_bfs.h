@@ -0,0 +1,66 @@
+#ifndef ZERO_ONE_BFS_H_
+#define ZERO_ONE_BFS_H_
+
+#include <stddef.h>
+
+#include "deque.h"
+#include "graph.h"
+
+// Shortest paths over edges that weigh 0 or 1.
+//
+// The weight of rows[v]->adjacent_nodes[k] is edge_weights[v][k],
+// taken from the value of that entry in the matrix: 0 for a stored
+// 0, 1 for anything else, and 1 for every edge of a pattern matrix,
+// which has no values. edge_weights follows the rows as add_edge()
+// builds them and as place_graph() moves them, but not through
+// relabel_graph() or the dynamic graph, which rewrite them.
+//
+extern unsigned char ** edge_weights;
+
+// Returns FALSE on allocation failure.
+//
+bool allocate_edge_weights(size_t node_count);
+
+// Records the weight of the edge the last add_edge(i, j) appended.
+// Exits on allocation failure, like add_edge().
+//
+void add_edge_weight(unsigned int i, unsigned int weight);
+void free_edge_weights(void);
+
+// A 0-1 BFS keeps its frontier in a deque: a vertex reached over a
+// 0 edge is as close as the one being expanded and goes to the
+// front, one reached over a 1 edge goes to the back. The front is
+// always the closest unsettled vertex, as in Dijkstra's algorithm,
+// at O(1) per edge.
+//
+// A vertex's distance is valid when its reached entry equals the
+// current epoch, and it is final when its settled entry does, as
+// for search_state.
+//
+struct zero_one_search {
+    deque * frontier;
+    unsigned int * distance;
+    unsigned int * reached_epoch;
+    unsigned int * settled_epoch;
+    unsigned int epoch;
+
+    // Largest frontier over every search so far.
+    //
+    size_t max_frontier;
+};
+
+// Returns FALSE on allocation failure.
+//
+bool init_zero_one_search(struct zero_one_search * search);
+void destroy_zero_one_search(struct zero_one_search * search);
+
+// Settles vertices from i outwards until j is settled, and returns
+// TRUE with the weight of the lightest path from i to j in distance
+// if there is one. nodes_visited counts the vertices settled.
+//
+bool zero_one_breadth_first_search(struct zero_one_search * search,
+                                   unsigned int i, unsigned int j,
+                                   struct search_result * result,
+                                   unsigned int * distance);
+
+#endif